@@ -0,0 +1,109 @@
+"""
+Generate firmware/src/factory_cal_tables.h from exported calibration data.
+
+Input: every *.txt file in firmware/factory_cal/ containing the text printed by
+the 'e' (Export Calibration Data) serial command, e.g.
+
+    // shunt_ohms = 0.000944464
+    std::vector<CalPoint> preCalibratedPoints_100 = {
+        {12.500000, 0.000000},
+        ...
+    };
+
+The shunt_ohms comment is optional. One file may hold several shunt ratings;
+if a rating appears more than once the last occurrence wins.
+
+Runs automatically as a PlatformIO pre-build script, or standalone:
+    python firmware/scripts/gen_factory_cal.py
+"""
+import glob
+import os
+import re
+
+BLOCK_RE = re.compile(
+    r"(?://\s*shunt_ohms\s*=\s*(?P<ohms>[-+0-9.eE]+)\s*)?"
+    r"std::vector<CalPoint>\s+preCalibratedPoints_(?P<shunt>\d+)\s*=\s*\{(?P<body>.*?)\};",
+    re.S,
+)
+POINT_RE = re.compile(r"\{\s*([-+0-9.eE]+)\s*,\s*([-+0-9.eE]+)\s*\}")
+
+
+def parse_tables(text):
+    tables = {}
+    for m in BLOCK_RE.finditer(text):
+        shunt = int(m.group("shunt"))
+        ohms = float(m.group("ohms")) if m.group("ohms") else 0.0
+        points = [(float(r), float(t)) for r, t in POINT_RE.findall(m.group("body"))]
+        if not points:
+            continue
+        # Same ordering/dedup rule as sortAndDedup() on the device
+        points.sort(key=lambda p: p[0])
+        dedup = []
+        for raw, tru in points:
+            if dedup and abs(raw - dedup[-1][0]) <= 1e-6:
+                dedup[-1] = (dedup[-1][0], 0.5 * (dedup[-1][1] + tru))
+            else:
+                dedup.append((raw, tru))
+        tables[shunt] = (ohms, dedup)
+    return tables
+
+
+def render(tables, sources):
+    out = []
+    out.append("// AUTO-GENERATED by firmware/scripts/gen_factory_cal.py - do not edit.")
+    out.append("// Sources: %s" % (", ".join(sources) if sources else "(none)"))
+    out.append("#ifndef FACTORY_CAL_TABLES_H")
+    out.append("#define FACTORY_CAL_TABLES_H")
+    out.append("")
+    out.append('#include "shared_defs.h"')
+    out.append("")
+    for shunt in sorted(tables):
+        _, points = tables[shunt]
+        out.append("static constexpr CalPoint factoryCalPoints_%d[] = {" % shunt)
+        for raw, tru in points:
+            out.append("    {%.6ff, %.6ff}," % (raw, tru))
+        out.append("};")
+        out.append("")
+    out.append("// Terminated by an entry with shuntRatedA == 0")
+    out.append("static constexpr FactoryCalTable factoryCalTables[] = {")
+    for shunt in sorted(tables):
+        ohms, points = tables[shunt]
+        out.append("    {%d, %.9ff, factoryCalPoints_%d, %d}," % (shunt, ohms, shunt, len(points)))
+    out.append("    {0, 0.0f, nullptr, 0},")
+    out.append("};")
+    out.append("")
+    out.append("#endif // FACTORY_CAL_TABLES_H")
+    out.append("")
+    return "\n".join(out)
+
+
+def generate(project_dir):
+    src_dir = os.path.join(project_dir, "firmware", "factory_cal")
+    header = os.path.join(project_dir, "firmware", "src", "factory_cal_tables.h")
+
+    files = sorted(glob.glob(os.path.join(src_dir, "*.txt")))
+    tables = {}
+    for path in files:
+        with open(path, "r") as f:
+            tables.update(parse_tables(f.read()))
+
+    sources = [os.path.relpath(p, project_dir).replace(os.sep, "/") for p in files]
+    text = render(tables, sources)
+
+    # Only touch the header when it changes so incremental builds stay incremental
+    old = None
+    if os.path.exists(header):
+        with open(header, "r") as f:
+            old = f.read()
+    if old != text:
+        with open(header, "w") as f:
+            f.write(text)
+        print("gen_factory_cal: wrote %d table(s) to %s" % (len(tables), header))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        generate(os.path.abspath(os.path.join(os.path.dirname(__file__), "..", "..")))
@@ -0,0 +1,58 @@
+#include "alert_scheduler.h"
+
+AlertScheduler::AlertScheduler()
+    : m_function(ALERT_SHUNT_OVER),
+      m_sinceMs(0),
+      m_prevMs(0),
+      m_hasPrev(false),
+      m_switches(0),
+      m_armedMs{0, 0, 0, 0}
+{
+}
+
+const char *AlertScheduler::functionName(Function f) {
+    switch (f) {
+    case ALERT_SHUNT_OVER: return "SHUNT_OVER";
+    case ALERT_BUS_UNDER:  return "BUS_UNDER";
+    case ALERT_BUS_OVER:   return "BUS_OVER";
+    case ALERT_POWER_OVER: return "POWER_OVER";
+    case FUNCTION_COUNT:   break;
+    }
+    return "?";
+}
+
+bool AlertScheduler::update(const AlertLevels &levels, float current_A, float bus_V, float power_W, uint32_t nowMs) {
+    if (m_hasPrev) m_armedMs[m_function] += nowMs - m_prevMs;
+    m_hasPrev = true;
+    m_prevMs = nowMs;
+
+    Function want = ALERT_SHUNT_OVER;
+    const float discharge_A = current_A > 0.0f ? current_A : 0.0f;
+    if (!(levels.instant_A > 0.0f && discharge_A >= overcurrentRiskFraction * levels.instant_A)) {
+        float closest = riskMargin;
+        if (levels.busUnder_V > 0.0f) {
+            const float m = (bus_V - levels.busUnder_V) / levels.busUnder_V;
+            if (m < closest) { closest = m; want = ALERT_BUS_UNDER; }
+        }
+        if (levels.busOver_V > 0.0f) {
+            const float m = (levels.busOver_V - bus_V) / levels.busOver_V;
+            if (m < closest) { closest = m; want = ALERT_BUS_OVER; }
+        }
+        if (levels.powerOver_W > 0.0f) {
+            const float m = (levels.powerOver_W - power_W) / levels.powerOver_W;
+            if (m < closest) { closest = m; want = ALERT_POWER_OVER; }
+        }
+    }
+
+    if (want == m_function) return false;
+    if (want != ALERT_SHUNT_OVER && nowMs - m_sinceMs < minDwellMs) return false;
+    m_function = want;
+    m_sinceMs = nowMs;
+    m_switches++;
+    return true;
+}
+
+void AlertScheduler::force(Function f, uint32_t nowMs) {
+    m_function = f;
+    m_sinceMs = nowMs;
+}
@@ -0,0 +1,60 @@
+#ifndef ALERT_SCHEDULER_H
+#define ALERT_SCHEDULER_H
+
+#include <stdint.h>
+
+// INA226 alert function scheduler.
+//
+// The INA226 has a single limit comparator: the mask/enable register selects
+// one function and the alert limit register holds its level. Rather than
+// dedicating it to shunt over, it is lent each sample to the fault that is
+// closest:
+//
+//   discharge above overcurrentRiskFraction of the instant trip -> shunt over, at once
+//   else the smallest relative margin under riskMargin          -> bus under / bus over / power over
+//   else                                                        -> shunt over
+//
+// Shunt over is the resting choice because a short from a quiet bus develops
+// fastest. Any other choice is held for at least minDwellMs so the comparator
+// is not rewritten over I2C on every sample near a boundary; a return to shunt
+// over is never delayed. The functions that are not armed stay covered by the
+// per-sample software checks (protection_engine.h). A level of 0 disables a
+// function, and a margin already below zero arms it so it fires at once.
+struct AlertLevels {
+    float instant_A;            // shunt over (as current)
+    float busUnder_V;
+    float busOver_V;
+    float powerOver_W;
+};
+
+class AlertScheduler {
+public:
+    enum Function : uint8_t { ALERT_SHUNT_OVER, ALERT_BUS_UNDER, ALERT_BUS_OVER, ALERT_POWER_OVER, FUNCTION_COUNT };
+
+    static constexpr float overcurrentRiskFraction = 0.5f;
+    static constexpr float riskMargin = 0.10f;
+    static const uint32_t minDwellMs = 1000;
+
+    AlertScheduler();
+
+    // Per sample (current positive = discharge). True when the comparator
+    // should be switched to function().
+    bool update(const AlertLevels &levels, float current_A, float bus_V, float power_W, uint32_t nowMs);
+    // The comparator was programmed outside the scheduler
+    void force(Function f, uint32_t nowMs);
+
+    Function function() const { return m_function; }
+    static const char *functionName(Function f);
+    uint32_t switchCount() const { return m_switches; }
+    uint32_t armedTime_ms(Function f) const { return f < FUNCTION_COUNT ? m_armedMs[f] : 0; }
+
+private:
+    Function m_function;
+    uint32_t m_sinceMs;         // when the present function was armed
+    uint32_t m_prevMs;
+    bool m_hasPrev;
+    uint32_t m_switches;
+    uint32_t m_armedMs[FUNCTION_COUNT];
+};
+
+#endif // ALERT_SCHEDULER_H
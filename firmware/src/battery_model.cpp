@@ -0,0 +1,61 @@
+#include "battery_model.h"
+#include "shared_defs.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <math.h>
+
+BatteryModel::BatteryModel()
+    : m_params(ideal()),
+      m_ratedCurrentA(0.0f),
+      m_exponentMinusOne(0.0f)
+{
+}
+
+bool BatteryModel::setParams(const BatteryModelParams &params, float capacityAh) {
+    if (!(params.peukertExponent >= 1.0f && params.peukertExponent <= 1.6f)) return false;
+    if (!(params.chargeEfficiency > 0.5f && params.chargeEfficiency <= 1.0f)) return false;
+    if (!(params.ratedHours > 0.0f) || !(capacityAh > 0.0f)) return false;
+    m_params = params;
+    m_ratedCurrentA = capacityAh / params.ratedHours;
+    m_exponentMinusOne = params.peukertExponent - 1.0f;
+    return true;
+}
+
+void BatteryModel::load(float capacityAh) {
+    const BatteryModelParams preset = BatteryModel::preset<DefaultChemistry>();
+    Preferences prefs;
+    prefs.begin(NVS_BATTERY_MODEL_NAMESPACE, true);
+    BatteryModelParams p;
+    p.peukertExponent = prefs.getFloat(NVS_KEY_PEUKERT, preset.peukertExponent);
+    p.chargeEfficiency = prefs.getFloat(NVS_KEY_CHARGE_EFFICIENCY, preset.chargeEfficiency);
+    p.ratedHours = prefs.getFloat(NVS_KEY_RATED_HOURS, preset.ratedHours);
+    prefs.end();
+    if (!setParams(p, capacityAh)) {
+        Serial.println("Stored battery model invalid, using chemistry preset.");
+        setParams(preset, capacityAh);
+    }
+    Serial.printf("Battery model (%s preset): Peukert %.3f, charge efficiency %.3f, rated %.0fh\n",
+                  DefaultChemistry::name(), m_params.peukertExponent, m_params.chargeEfficiency, m_params.ratedHours);
+}
+
+void BatteryModel::save() const {
+    Preferences prefs;
+    prefs.begin(NVS_BATTERY_MODEL_NAMESPACE, false);
+    prefs.putFloat(NVS_KEY_PEUKERT, m_params.peukertExponent);
+    prefs.putFloat(NVS_KEY_CHARGE_EFFICIENCY, m_params.chargeEfficiency);
+    prefs.putFloat(NVS_KEY_RATED_HOURS, m_params.ratedHours);
+    prefs.end();
+}
+
+float BatteryModel::effectiveCurrent_A(float currentA) const {
+    if (currentA < 0.0f) {
+        return currentA * m_params.chargeEfficiency;
+    }
+    // Peukert: capacity at current I is C * (I_rated / I)^(k-1), which is the same
+    // as draining rated capacity with I * (I / I_rated)^(k-1). Below the rated
+    // current no extra capacity is credited.
+    if (m_exponentMinusOne <= 0.0f || currentA <= m_ratedCurrentA) {
+        return currentA;
+    }
+    return currentA * powf(currentA / m_ratedCurrentA, m_exponentMinusOne);
+}
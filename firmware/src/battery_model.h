@@ -0,0 +1,124 @@
+#ifndef BATTERY_MODEL_H
+#define BATTERY_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Usable-capacity battery model.
+//
+// Turns the measured current into the current that actually drains or fills
+// usable capacity: discharge above the rated rate (capacity / ratedHours) is
+// weighted by Peukert's law, charge is discounted by the charge efficiency.
+// Evaluated once per sample in constant time (one powf on discharge).
+//
+// The defaults come from a chemistry preset chosen at compile time with
+// -DBATTERY_CHEMISTRY_AGM or -DBATTERY_CHEMISTRY_FLOODED (LiFePO4 otherwise);
+// values saved in NVS override the preset. Each preset also carries its 12V
+// rested open-circuit-voltage curve and relaxation time (see ocv_resync.h).
+
+// One point of a rested open-circuit voltage -> SOC curve, sorted by volts
+struct OcvPoint {
+    float volts;
+    float soc;      // fraction 0..1
+};
+
+struct LiFePO4Chemistry {
+    static const char *name() { return "LiFePO4"; }
+    static constexpr float peukertExponent = 1.05f;
+    static constexpr float chargeEfficiency = 0.99f;
+    static constexpr float ratedHours = 20.0f;
+    static constexpr uint32_t restMinutes = 30;
+    static constexpr float chargedVoltage = 14.0f;   // absorption 14.2V minus 0.2V
+    // Cycle life N(DoD) = cyclesAt100Dod * DoD^-wohlerExponent (see rainflow_counter.h)
+    static constexpr float cyclesAt100Dod = 3000.0f;
+    static constexpr float wohlerExponent = 1.4f;
+    // Very flat between 30 and 90 %: the resync weights it accordingly
+    static const OcvPoint *ocvCurve(size_t &count) {
+        static const OcvPoint curve[] = {
+            {10.00f, 0.00f}, {12.50f, 0.10f}, {12.80f, 0.20f}, {12.90f, 0.30f},
+            {13.00f, 0.40f}, {13.05f, 0.50f}, {13.10f, 0.60f}, {13.20f, 0.70f},
+            {13.30f, 0.80f}, {13.40f, 0.90f}, {13.60f, 1.00f},
+        };
+        count = sizeof(curve) / sizeof(curve[0]);
+        return curve;
+    }
+};
+
+struct AgmChemistry {
+    static const char *name() { return "AGM"; }
+    static constexpr float peukertExponent = 1.15f;
+    static constexpr float chargeEfficiency = 0.90f;
+    static constexpr float ratedHours = 20.0f;
+    static constexpr uint32_t restMinutes = 120;
+    static constexpr float chargedVoltage = 14.2f;
+    static constexpr float cyclesAt100Dod = 400.0f;
+    static constexpr float wohlerExponent = 1.2f;
+    static const OcvPoint *ocvCurve(size_t &count) {
+        static const OcvPoint curve[] = {
+            {11.80f, 0.00f}, {12.00f, 0.25f}, {12.30f, 0.50f}, {12.60f, 0.75f}, {12.85f, 1.00f},
+        };
+        count = sizeof(curve) / sizeof(curve[0]);
+        return curve;
+    }
+};
+
+struct FloodedChemistry {
+    static const char *name() { return "Flooded"; }
+    static constexpr float peukertExponent = 1.25f;
+    static constexpr float chargeEfficiency = 0.85f;
+    static constexpr float ratedHours = 20.0f;
+    static constexpr uint32_t restMinutes = 240;
+    static constexpr float chargedVoltage = 14.2f;
+    static constexpr float cyclesAt100Dod = 300.0f;
+    static constexpr float wohlerExponent = 1.2f;
+    static const OcvPoint *ocvCurve(size_t &count) {
+        static const OcvPoint curve[] = {
+            {11.89f, 0.00f}, {12.06f, 0.25f}, {12.24f, 0.50f}, {12.45f, 0.75f}, {12.65f, 1.00f},
+        };
+        count = sizeof(curve) / sizeof(curve[0]);
+        return curve;
+    }
+};
+
+#if defined(BATTERY_CHEMISTRY_AGM)
+typedef AgmChemistry DefaultChemistry;
+#elif defined(BATTERY_CHEMISTRY_FLOODED)
+typedef FloodedChemistry DefaultChemistry;
+#else
+typedef LiFePO4Chemistry DefaultChemistry;
+#endif
+
+struct BatteryModelParams {
+    float peukertExponent;      // 1.0 = no rate dependence
+    float chargeEfficiency;     // fraction of charge current that is stored
+    float ratedHours;           // discharge time the rated capacity is specified at
+};
+
+class BatteryModel {
+public:
+    BatteryModel();             // ideal battery until setParams()/load()
+
+    template <typename Chemistry>
+    static BatteryModelParams preset() {
+        return BatteryModelParams{Chemistry::peukertExponent, Chemistry::chargeEfficiency, Chemistry::ratedHours};
+    }
+    static BatteryModelParams ideal() { return BatteryModelParams{1.0f, 1.0f, 20.0f}; }
+
+    // Rejects out-of-range values; capacityAh sets the rated current
+    bool setParams(const BatteryModelParams &params, float capacityAh);
+    const BatteryModelParams &params() const { return m_params; }
+
+    // NVS values, else the DefaultChemistry preset
+    void load(float capacityAh);
+    void save() const;
+
+    // Current seen by usable capacity (A, positive = discharge)
+    float effectiveCurrent_A(float currentA) const;
+
+private:
+    BatteryModelParams m_params;
+    float m_ratedCurrentA;
+    float m_exponentMinusOne;
+};
+
+#endif // BATTERY_MODEL_H
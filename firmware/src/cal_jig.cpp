@@ -0,0 +1,313 @@
+#include "cal_jig.h"
+#include "cal_math.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+CalJig::CalJig(CalJigTarget &target)
+    : m_target(target),
+      m_active(false),
+      m_seq(0),
+      m_shuntA(0),
+      m_hasTarget(false),
+      m_target_mA(0.0f)
+{
+}
+
+void CalJig::begin() {
+    m_active = true;
+    m_seq = 0;
+    m_shuntA = 0;
+    m_hasTarget = false;
+    m_points.clear();
+    m_ohmsCurrentA.clear();
+    m_ohmsShunt_mV.clear();
+    m_sweep.clear();
+}
+
+uint8_t CalJig::checksum(const char *begin, const char *end) {
+    uint8_t sum = 0;
+    for (const char *p = begin; p < end; ++p) sum ^= (uint8_t)*p;
+    return sum;
+}
+
+void CalJig::reply(bool ok, const char *payload) {
+    char frame[160];
+    int n = snprintf(frame, sizeof(frame), "#%u,%s,%s", (unsigned)m_seq++, ok ? "OK" : "ERR", payload);
+    if (n < 0 || n >= (int)sizeof(frame) - 4) n = (int)sizeof(frame) - 4;
+    uint8_t sum = checksum(frame + 1, frame + n);
+    snprintf(frame + n, sizeof(frame) - n, "*%02X", sum);
+    m_target.writeLine(frame);
+}
+
+// Wait until the last few raw readings agree within tolerance_mA.
+bool CalJig::settle(float tolerance_mA, unsigned long timeout_ms, unsigned long &elapsedOut) {
+    const int window = 4;
+    float history[window];
+    int filled = 0;
+    unsigned long start = m_target.nowMs();
+
+    while (true) {
+        float raw, cal, shunt, bus;
+        m_target.readSample(raw, cal, shunt, bus);
+        history[filled % window] = raw;
+        filled++;
+
+        if (filled >= window) {
+            float lo = history[0], hi = history[0];
+            for (int i = 1; i < window; ++i) {
+                if (history[i] < lo) lo = history[i];
+                if (history[i] > hi) hi = history[i];
+            }
+            if (hi - lo <= tolerance_mA) {
+                elapsedOut = m_target.nowMs() - start;
+                return true;
+            }
+        }
+        if (m_target.nowMs() - start >= timeout_ms) {
+            elapsedOut = m_target.nowMs() - start;
+            return false;
+        }
+        m_target.delayMs(sampleIntervalMs);
+    }
+}
+
+void CalJig::handleLine(const char *line) {
+    // Split "<COMMAND> <args>" and upper-case the command for matching
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0') return;
+
+    char cmd[24];
+    size_t n = 0;
+    while (line[n] && line[n] != ' ' && line[n] != '\t' && line[n] != '\r' && line[n] != '\n' && n < sizeof(cmd) - 1) {
+        cmd[n] = (char)toupper((unsigned char)line[n]);
+        n++;
+    }
+    cmd[n] = '\0';
+    const char *args = line + n;
+    while (*args == ' ' || *args == '\t') args++;
+
+    char buf[128];
+
+    if (strcmp(cmd, "*IDN?") == 0) {
+        reply(true, "AE-SMART-SHUNT,CALJIG,1");
+    } else if (strcmp(cmd, "*RST") == 0) {
+        uint32_t seq = m_seq;
+        begin();
+        m_seq = seq;
+        reply(true, "");
+    } else if (strcmp(cmd, "MEAS?") == 0) {
+        float raw, cal, shunt, bus;
+        m_target.readSample(raw, cal, shunt, bus);
+        snprintf(buf, sizeof(buf), "%.3f,%.3f,%.4f,%.3f", raw, cal, shunt, bus);
+        reply(true, buf);
+    } else if (strcmp(cmd, "LOAD") == 0) {
+        m_target.setLoadConnected(atoi(args) != 0);
+        reply(true, "");
+    } else if (strcmp(cmd, "CAL:SHUNT") == 0) {
+        int shuntA = atoi(args);
+        if (shuntA < 50 || shuntA > 500 || (shuntA % 50) != 0) {
+            reply(false, "BAD_SHUNT");
+        } else if (!m_target.selectShunt((uint16_t)shuntA)) {
+            reply(false, "SELECT_FAILED");
+        } else {
+            m_shuntA = (uint16_t)shuntA;
+            reply(true, "");
+        }
+    } else if (strcmp(cmd, "CAL:SHUNT?") == 0) {
+        snprintf(buf, sizeof(buf), "%u", (unsigned)m_shuntA);
+        reply(true, buf);
+    } else if (strcmp(cmd, "CAL:TARGET") == 0) {
+        char *end = nullptr;
+        float t = strtof(args, &end);
+        if (end == args) {
+            reply(false, "BAD_VALUE");
+        } else {
+            m_target_mA = t;
+            m_hasTarget = true;
+            reply(true, "");
+        }
+    } else if (strcmp(cmd, "CAL:SETTLE") == 0) {
+        char *end = nullptr;
+        float tol = strtof(args, &end);
+        unsigned long timeout = 5000;
+        if (end && *end == ',') timeout = strtoul(end + 1, nullptr, 10);
+        if (end == args || tol <= 0.0f) {
+            reply(false, "BAD_VALUE");
+            return;
+        }
+        unsigned long elapsed = 0;
+        bool ok = settle(tol, timeout, elapsed);
+        snprintf(buf, sizeof(buf), "%s%lu", ok ? "" : "TIMEOUT,", elapsed);
+        reply(ok, buf);
+    } else if (strcmp(cmd, "CAL:SAMPLE") == 0) {
+        int samples = atoi(args);
+        if (samples <= 0) samples = 8;
+        if (samples > 1000) samples = 1000;
+        if (!m_hasTarget) {
+            reply(false, "NO_TARGET");
+            return;
+        }
+        // Welford's running mean and variance: sum(x^2)/n - mean^2 cancels in
+        // float when the spread is tiny next to a 50A reading
+        double meanRaw = 0.0, m2Raw = 0.0, meanShunt = 0.0;
+        for (int s = 0; s < samples; ++s) {
+            float raw, cal, shunt, bus;
+            m_target.readSample(raw, cal, shunt, bus);
+            const double d = raw - meanRaw;
+            meanRaw += d / (s + 1);
+            m2Raw += d * (raw - meanRaw);
+            meanShunt += (shunt - meanShunt) / (s + 1);
+            if (s + 1 < samples) m_target.delayMs(sampleIntervalMs);
+        }
+        float avgRaw = (float)meanRaw;
+        float avgShunt = (float)meanShunt;
+        float stdev = (float)sqrt(m2Raw / samples);
+
+        m_points.push_back({avgRaw, m_target_mA});
+        if (m_target_mA > 0.0f) {
+            m_ohmsCurrentA.push_back(m_target_mA / 1000.0f);
+            m_ohmsShunt_mV.push_back(avgShunt);
+        }
+        snprintf(buf, sizeof(buf), "%.3f,%.4f,%.3f,%u", avgRaw, avgShunt, stdev, (unsigned)m_points.size());
+        reply(true, buf);
+    } else if (strcmp(cmd, "CAL:POINT") == 0) {
+        char *end = nullptr;
+        float raw = strtof(args, &end);
+        if (end == args || *end != ',') {
+            reply(false, "BAD_VALUE");
+            return;
+        }
+        const char *second = end + 1;
+        float tru = strtof(second, &end);
+        if (end == second) {
+            reply(false, "BAD_VALUE");
+            return;
+        }
+        m_points.push_back({raw, tru});
+        snprintf(buf, sizeof(buf), "%u", (unsigned)m_points.size());
+        reply(true, buf);
+    } else if (strcmp(cmd, "CAL:POINTS?") == 0) {
+        snprintf(buf, sizeof(buf), "%u", (unsigned)m_points.size());
+        reply(true, buf);
+    } else if (strcmp(cmd, "CAL:CLEAR") == 0) {
+        m_points.clear();
+        m_ohmsCurrentA.clear();
+        m_ohmsShunt_mV.clear();
+        reply(true, "");
+    } else if (strcmp(cmd, "CAL:COMMIT") == 0) {
+        if (m_shuntA == 0) {
+            reply(false, "NO_SHUNT");
+        } else if (m_points.empty()) {
+            reply(false, "NO_POINTS");
+        } else if (!m_target.commitTable(m_shuntA, m_points)) {
+            reply(false, "SAVE_FAILED");
+        } else {
+            snprintf(buf, sizeof(buf), "%u", (unsigned)m_points.size());
+            reply(true, buf);
+        }
+    } else if (strcmp(cmd, "CAL:OHMS") == 0) {
+        float ohms = strtof(args, nullptr);
+        if (!(ohms > 0.0f)) {
+            reply(false, "BAD_VALUE");
+        } else {
+            m_target.commitShuntOhms(ohms);
+            snprintf(buf, sizeof(buf), "%.9f", ohms);
+            reply(true, buf);
+        }
+    } else if (strcmp(cmd, "CAL:OHMS:COMMIT") == 0) {
+        // Same R = V/I averaging as the interactive resistance wizard
+        size_t valid = 0;
+        float ohms = averageShuntOhms(m_ohmsCurrentA.data(), m_ohmsShunt_mV.data(),
+                                      m_ohmsCurrentA.size(), valid);
+        if (valid == 0) {
+            reply(false, "NO_POINTS");
+            return;
+        }
+        m_target.commitShuntOhms(ohms);
+        snprintf(buf, sizeof(buf), "%.9f,%u", ohms, (unsigned)valid);
+        reply(true, buf);
+    } else if (strcmp(cmd, "CAL:SWEEP:START") == 0) {
+        char *end = nullptr;
+        float binWidth = strtof(args, &end);
+        float maxRef = (end && *end == ',') ? strtof(end + 1, nullptr) : 0.0f;
+        if (!m_sweep.begin(binWidth, maxRef)) {
+            reply(false, "BAD_RANGE");
+        } else {
+            snprintf(buf, sizeof(buf), "%u", (unsigned)m_sweep.binCount());
+            reply(true, buf);
+        }
+    } else if (strcmp(cmd, "CAL:SWEEP:REF") == 0) {
+        char *end = nullptr;
+        float ref = strtof(args, &end);
+        if (end == args) {
+            reply(false, "BAD_VALUE");
+            return;
+        }
+        float raw, cal, shunt, bus;
+        m_target.readSample(raw, cal, shunt, bus);
+        if (!m_sweep.addSample(raw, ref)) {
+            reply(false, "OUT_OF_RANGE");
+        } else {
+            snprintf(buf, sizeof(buf), "%.3f,%u", raw, (unsigned)m_sweep.sampleCount());
+            reply(true, buf);
+        }
+    } else if (strcmp(cmd, "CAL:SWEEP:FIT") == 0) {
+        float budget = strtof(args, nullptr);
+        if (!(budget > 0.0f)) budget = 10.0f;
+        std::vector<CalPoint> dense;
+        size_t rejected = m_sweep.buildDenseTable(dense);
+        if (dense.size() < 2) {
+            reply(false, "NOT_ENOUGH_BINS");
+            return;
+        }
+        float worst = CalSweep::decimate(dense, budget, m_points);
+        snprintf(buf, sizeof(buf), "%u,%u,%u,%.3f", (unsigned)dense.size(), (unsigned)rejected,
+                 (unsigned)m_points.size(), worst);
+        reply(true, buf);
+    } else if (strcmp(cmd, "TEST:SWITCH?") == 0) {
+        float raw, before, after, shunt, bus;
+        m_target.setLoadConnected(true);
+        m_target.delayMs(500);
+        m_target.readSample(raw, before, shunt, bus);
+        m_target.setLoadConnected(false);
+        m_target.delayMs(500);
+        m_target.readSample(raw, after, shunt, bus);
+        m_target.setLoadConnected(true);
+        bool pass = fabsf(after) < 50.0f; // same 50mA tolerance as the guided test
+        snprintf(buf, sizeof(buf), "%.3f,%.3f,%s", before, after, pass ? "PASS" : "FAIL");
+        reply(pass, buf);
+    } else if (strcmp(cmd, "TEST:ALERT") == 0) {
+        char *end = nullptr;
+        float amps = strtof(args, &end);
+        unsigned long timeout = 15000;
+        if (end && *end == ',') timeout = strtoul(end + 1, nullptr, 10);
+        if (end == args || amps <= 0.0f) {
+            reply(false, "BAD_VALUE");
+            return;
+        }
+        m_target.setLoadConnected(true);
+        m_target.armAlert(amps);
+        unsigned long start = m_target.nowMs();
+        bool fired = false;
+        while (m_target.nowMs() - start < timeout) {
+            if (m_target.pollAlertFired()) {
+                fired = true;
+                break;
+            }
+            m_target.delayMs(50);
+        }
+        unsigned long elapsed = m_target.nowMs() - start;
+        m_target.restoreAlert();
+        m_target.setLoadConnected(true);
+        snprintf(buf, sizeof(buf), "%s,%lu", fired ? "PASS" : "FAIL", elapsed);
+        reply(fired, buf);
+    } else if (strcmp(cmd, "JIG:EXIT") == 0) {
+        reply(true, "");
+        m_active = false;
+    } else {
+        reply(false, "UNKNOWN_COMMAND");
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef CAL_JIG_H
+#define CAL_JIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "shared_defs.h"
+#include "cal_sweep.h"
+
+// Machine command set for unattended calibration on a production jig.
+//
+// Commands are SCPI-like text lines (case-insensitive), one per line:
+//   *IDN?                      identify
+//   *RST                       discard captured points/targets
+//   MEAS?                      raw_mA,cal_mA,shunt_mV,bus_V
+//   LOAD <0|1>                 drive the load switch
+//   CAL:SHUNT <A> / CAL:SHUNT? select the shunt rating being calibrated
+//   CAL:TARGET <mA>            true current the jig is now applying
+//   CAL:SETTLE <tol_mA>,<timeout_ms>
+//                              wait until raw readings stop moving
+//   CAL:SAMPLE <N>             average N readings, record (raw, target) point
+//   CAL:POINT <raw_mA>,<true_mA>  add a point directly (offline solver import)
+//   CAL:POINTS? / CAL:CLEAR    captured point count / discard points
+//   CAL:COMMIT                 save captured points as the shunt's table
+//   CAL:OHMS <ohms>            save a shunt resistance directly
+//   CAL:OHMS:COMMIT            solve resistance from sampled (target, shunt_mV)
+//   CAL:SWEEP:START <bin_mA>,<max_mA>
+//                              begin a ramp sweep (see cal_sweep.h)
+//   CAL:SWEEP:REF <ref_mA>     take one reading paired with the jig's reference
+//   CAL:SWEEP:FIT <budget_mA>  fit dense table, decimate, replace captured points
+//   TEST:SWITCH?               load switch self-test
+//   TEST:ALERT <A>,<timeout_ms>  hardware alert self-test
+//   JIG:EXIT                   leave jig mode
+//
+// Every command gets exactly one framed reply:
+//   #<seq>,<OK|ERR>,<payload>*<XX>
+// where <seq> counts replies since jig mode started and <XX> is the two-digit
+// hex XOR of all characters between '#' and '*' (NMEA style).
+
+// Hardware the protocol drives. Implemented on INA226_ADC in the firmware and by
+// a simulated load in tools/cal_jig_client.
+class CalJigTarget {
+public:
+    virtual ~CalJigTarget() {}
+    virtual void readSample(float &raw_mA, float &cal_mA, float &shunt_mV, float &bus_V) = 0;
+    virtual unsigned long nowMs() = 0;
+    virtual void delayMs(unsigned long ms) = 0;
+    virtual bool selectShunt(uint16_t shuntRatedA) = 0;
+    virtual bool commitTable(uint16_t shuntRatedA, const std::vector<CalPoint> &points) = 0;
+    virtual bool commitShuntOhms(float ohms) = 0;
+    virtual void setLoadConnected(bool connected) = 0;
+    virtual void armAlert(float amps) = 0;           // temporary alert threshold
+    virtual bool pollAlertFired() = 0;               // true once the armed alert tripped
+    virtual void restoreAlert() = 0;
+    virtual void writeLine(const char *line) = 0;    // one framed reply, no newline
+};
+
+class CalJig {
+public:
+    explicit CalJig(CalJigTarget &target);
+
+    void handleLine(const char *line);  // parse + execute + reply
+    bool isActive() const { return m_active; }
+    void begin();                       // enter jig mode, reset sequence/state
+
+    // Frame checksum helper, shared with the host client
+    static uint8_t checksum(const char *begin, const char *end);
+
+    static const int sampleIntervalMs = 120;  // same pacing as the interactive wizard
+
+private:
+    void reply(bool ok, const char *payload);
+    bool settle(float tolerance_mA, unsigned long timeout_ms, unsigned long &elapsedOut);
+
+    CalJigTarget &m_target;
+    bool m_active;
+    uint32_t m_seq;
+    uint16_t m_shuntA;
+    bool m_hasTarget;
+    float m_target_mA;
+    std::vector<CalPoint> m_points;
+    std::vector<float> m_ohmsCurrentA;    // targets sampled for resistance solve (A)
+    std::vector<float> m_ohmsShunt_mV;    // matching averaged shunt voltages
+    CalSweep m_sweep;
+};
+
+#endif // CAL_JIG_H
@@ -0,0 +1,73 @@
+#include "cal_math.h"
+#include <math.h>
+#include <algorithm>
+
+void sortAndDedupCalPoints(std::vector<CalPoint> &pts) {
+    std::sort(pts.begin(), pts.end(), [](const CalPoint &a, const CalPoint &b){
+        return a.raw_mA < b.raw_mA;
+    });
+    // Collapse any duplicate raw_mA by averaging their true_mA
+    std::vector<CalPoint> out;
+    for (const auto &p : pts) {
+        if (out.empty() || fabsf(p.raw_mA - out.back().raw_mA) > 1e-6f) {
+            out.push_back(p);
+        } else {
+            // average
+            out.back().true_mA = 0.5f * (out.back().true_mA + p.true_mA);
+        }
+    }
+    pts.swap(out);
+}
+
+float interpolateCalTable(const CalPoint *pts, size_t count, float raw_mA) {
+    if (count == 0) return raw_mA;
+
+    // Below/above range -> clamp to edge true values
+    if (raw_mA <= pts[0].raw_mA) return pts[0].true_mA;
+    if (raw_mA >= pts[count - 1].raw_mA) return pts[count - 1].true_mA;
+
+    // Find interval [i-1, i] such that raw_mA < points[i].raw_mA
+    for (size_t i = 1; i < count; ++i) {
+        if (raw_mA < pts[i].raw_mA) {
+            const float x0 = pts[i-1].raw_mA;
+            const float y0 = pts[i-1].true_mA;
+            const float x1 = pts[i].raw_mA;
+            const float y1 = pts[i].true_mA;
+            if (fabsf(x1 - x0) < 1e-9f) return y0; // degenerate
+            return y0 + (raw_mA - x0) * (y1 - y0) / (x1 - x0);
+        }
+    }
+    return raw_mA; // should not hit
+}
+
+float invertCalTable(const CalPoint *pts, size_t count, float true_mA) {
+    if (count == 0) return true_mA;
+
+    if (true_mA <= pts[0].true_mA) return pts[0].raw_mA;
+    if (true_mA >= pts[count - 1].true_mA) return pts[count - 1].raw_mA;
+
+    for (size_t i = 1; i < count; ++i) {
+        if (true_mA < pts[i].true_mA) {
+            const float x0 = pts[i-1].true_mA;
+            const float y0 = pts[i-1].raw_mA;
+            const float x1 = pts[i].true_mA;
+            const float y1 = pts[i].raw_mA;
+            if (fabsf(x1 - x0) < 1e-9f) return y0; // degenerate
+            return y0 + (true_mA - x0) * (y1 - y0) / (x1 - x0);
+        }
+    }
+    return true_mA; // should not hit
+}
+
+float averageShuntOhms(const float *current_A, const float *shunt_mV, size_t count, size_t &validOut) {
+    // R = V/I for each point, averaged for a more stable value
+    float sumOhms = 0.0f;
+    validOut = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (current_A[i] > 0.0f) { // Avoid division by zero
+            sumOhms += (shunt_mV[i] / 1000.0f) / current_A[i];
+            validOut++;
+        }
+    }
+    return validOut > 0 ? sumOhms / (float)validOut : 0.0f;
+}
@@ -0,0 +1,27 @@
+#ifndef CAL_MATH_H
+#define CAL_MATH_H
+
+#include <stddef.h>
+#include <vector>
+#include "shared_defs.h"
+
+// Calibration arithmetic shared by the firmware (INA226_ADC, serial wizards,
+// jig protocol) and the host tools, so a table solved offline behaves exactly
+// like one captured on the device.
+
+// Sort by raw_mA and collapse duplicate raw values by averaging their true_mA
+void sortAndDedupCalPoints(std::vector<CalPoint> &pts);
+
+// Piecewise-linear raw -> true lookup over a table sorted by raw_mA. Readings
+// outside the table clamp to the edge true values; an empty table is identity.
+float interpolateCalTable(const CalPoint *pts, size_t count, float raw_mA);
+
+// Inverse lookup true -> raw over the same table, for thresholds set in true
+// current; assumes true_mA rises with raw_mA. Clamps like the forward lookup.
+float invertCalTable(const CalPoint *pts, size_t count, float true_mA);
+
+// Shunt resistance as the average of R = V/I over every point with a positive
+// current. Returns 0 and validOut = 0 if no point is usable.
+float averageShuntOhms(const float *current_A, const float *shunt_mV, size_t count, size_t &validOut);
+
+#endif // CAL_MATH_H
@@ -0,0 +1,108 @@
+#include "cal_sweep.h"
+#include "cal_math.h"
+#include <math.h>
+#include <algorithm>
+
+CalSweep::CalSweep()
+    : m_binWidth_mA(0.0f),
+      m_samples(0),
+      m_minSamples(3),
+      m_absTol_mA(20.0f),
+      m_relTol(0.005f)
+{
+}
+
+bool CalSweep::begin(float binWidth_mA, float maxRef_mA) {
+    clear();
+    if (!(binWidth_mA > 0.0f) || !(maxRef_mA > 0.0f)) return false;
+    size_t bins = (size_t)ceilf(maxRef_mA / binWidth_mA) + 1;
+    if (bins > maxBins) return false;
+    m_binWidth_mA = binWidth_mA;
+    m_bins.assign(bins, Bin{0, 0.0f, 0.0f, 0.0f});
+    return true;
+}
+
+void CalSweep::clear() {
+    std::vector<Bin>().swap(m_bins);
+    m_binWidth_mA = 0.0f;
+    m_samples = 0;
+}
+
+void CalSweep::setRejection(uint16_t minSamples, float absTol_mA, float relTol) {
+    m_minSamples = minSamples;
+    m_absTol_mA = absTol_mA;
+    m_relTol = relTol;
+}
+
+bool CalSweep::addSample(float raw_mA, float ref_mA) {
+    if (m_bins.empty() || ref_mA < -0.5f * m_binWidth_mA) return false;
+    size_t idx = (size_t)lroundf(ref_mA / m_binWidth_mA);
+    if (idx >= m_bins.size()) return false;
+
+    Bin &b = m_bins[idx];
+    const float diff = raw_mA - ref_mA;
+    const float delta = diff - (b.meanRaw - b.meanRef);
+    b.n++;
+    b.meanRaw += (raw_mA - b.meanRaw) / (float)b.n;
+    b.meanRef += (ref_mA - b.meanRef) / (float)b.n;
+    b.m2Diff += delta * (diff - (b.meanRaw - b.meanRef));
+    m_samples++;
+    return true;
+}
+
+size_t CalSweep::buildDenseTable(std::vector<CalPoint> &dense) const {
+    dense.clear();
+    size_t rejected = 0;
+    for (const Bin &b : m_bins) {
+        if (b.n == 0) continue;
+        float sd = b.n > 1 ? sqrtf(b.m2Diff / (float)(b.n - 1)) : 0.0f;
+        float tol = std::max(m_absTol_mA, m_relTol * fabsf(b.meanRaw));
+        if (b.n < m_minSamples || sd > tol) {
+            rejected++;
+            continue;
+        }
+        dense.push_back({b.meanRaw, b.meanRef});
+    }
+    sortAndDedupCalPoints(dense);
+    return rejected;
+}
+
+// Interpolation error of dense[k] on the chord dense[i]..dense[j]
+static float chordError(const std::vector<CalPoint> &d, size_t i, size_t j, size_t k) {
+    float dx = d[j].raw_mA - d[i].raw_mA;
+    float y = (fabsf(dx) < 1e-9f)
+                  ? d[i].true_mA
+                  : d[i].true_mA + (d[k].raw_mA - d[i].raw_mA) * (d[j].true_mA - d[i].true_mA) / dx;
+    return fabsf(y - d[k].true_mA);
+}
+
+float CalSweep::decimate(const std::vector<CalPoint> &dense, float budget_mA, std::vector<CalPoint> &out) {
+    out.clear();
+    if (dense.size() <= 2) {
+        out = dense;
+        return 0.0f;
+    }
+
+    float worst = 0.0f;
+    size_t start = 0;
+    out.push_back(dense[0]);
+    while (start < dense.size() - 1) {
+        // Extend the segment from 'start' as far as the budget allows
+        size_t best = start + 1;
+        float bestErr = 0.0f;
+        for (size_t end = start + 2; end < dense.size(); ++end) {
+            float segErr = 0.0f;
+            for (size_t k = start + 1; k < end; ++k) {
+                segErr = std::max(segErr, chordError(dense, start, end, k));
+                if (segErr > budget_mA) break;
+            }
+            if (segErr > budget_mA) break;
+            best = end;
+            bestErr = segErr;
+        }
+        out.push_back(dense[best]);
+        worst = std::max(worst, bestErr);
+        start = best;
+    }
+    return worst;
+}
@@ -0,0 +1,65 @@
+#ifndef CAL_SWEEP_H
+#define CAL_SWEEP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "shared_defs.h"
+
+// Dense calibration capture while an external load ramps slowly.
+//
+// Each sample pairs a raw INA226 reading with the jig's true-current reference.
+// Samples are binned by reference current; each bin keeps running (Welford)
+// statistics so memory is fixed at one small struct per bin. Bins with too few
+// samples or too much spread (outliers, load still moving) are rejected, the
+// rest become a dense table with one point per bin, which decimate() then
+// reduces to the fewest breakpoints that stay within an error budget.
+class CalSweep {
+public:
+    static const size_t maxBins = 512;
+
+    CalSweep();
+
+    // Start a sweep covering 0..maxRef_mA in bins of binWidth_mA. Returns false if
+    // the range needs more than maxBins bins.
+    bool begin(float binWidth_mA, float maxRef_mA);
+    void clear();
+
+    // Returns false if the reference is outside the sweep range
+    bool addSample(float raw_mA, float ref_mA);
+
+    // Bin acceptance: at least minSamples, and std dev of (raw - ref) within
+    // max(absTol_mA, relTol * |mean raw|)
+    void setRejection(uint16_t minSamples, float absTol_mA, float relTol);
+
+    // One point per accepted bin, sorted by raw_mA. Returns number of rejected
+    // bins that had samples.
+    size_t buildDenseTable(std::vector<CalPoint> &dense) const;
+
+    size_t binCount() const { return m_bins.size(); }
+    uint32_t sampleCount() const { return m_samples; }
+
+    // Greedy piecewise-linear simplification: keep the fewest points such that
+    // interpolating between kept points reproduces every dropped point's true_mA
+    // within budget_mA. Returns the worst error of the result.
+    static float decimate(const std::vector<CalPoint> &dense, float budget_mA, std::vector<CalPoint> &out);
+
+private:
+    // Spread is tracked on (raw - ref) so the ramp moving through a bin does
+    // not count as noise; only disagreement between sensor and reference does.
+    struct Bin {
+        uint32_t n;
+        float meanRaw;
+        float meanRef;
+        float m2Diff;    // sum of squared deviations of raw - ref (Welford)
+    };
+
+    std::vector<Bin> m_bins;
+    float m_binWidth_mA;
+    uint32_t m_samples;
+    uint16_t m_minSamples;
+    float m_absTol_mA;
+    float m_relTol;
+};
+
+#endif // CAL_SWEEP_H
@@ -0,0 +1,88 @@
+#include "capacity_estimator.h"
+#include "coulomb_counter.h"
+#include "shared_defs.h"
+#include <Preferences.h>
+
+const float CapacityEstimator::filterGain = 0.5f;
+
+CapacityEstimator::CapacityEstimator(float ratedAh)
+    : m_ratedAh(ratedAh),
+      m_capacityAh(ratedAh),
+      m_minSpan(0.3f),
+      m_maxChargeFraction(0.05f),
+      m_maxSigma(0.04f),
+      m_hasAnchor(false),
+      m_anchorSoc(0.0f),
+      m_anchorIn_nAs(0),
+      m_anchorOut_nAs(0),
+      m_lastEstimateAh(0.0f),
+      m_estimates(0)
+{
+}
+
+void CapacityEstimator::setPolicy(float minSpan, float maxChargeFraction, float maxSigma) {
+    m_minSpan = minSpan;
+    m_maxChargeFraction = maxChargeFraction;
+    m_maxSigma = maxSigma;
+}
+
+bool CapacityEstimator::addAnchor(float soc, float sigma, uint64_t chargeIn_nAs, uint64_t chargeOut_nAs) {
+    if (sigma > m_maxSigma) return false;
+
+    bool updated = false;
+    bool keepOld = false;
+    if (m_hasAnchor && chargeIn_nAs >= m_anchorIn_nAs && chargeOut_nAs >= m_anchorOut_nAs) {
+        const double in_Ah = (double)(chargeIn_nAs - m_anchorIn_nAs) / (double)CoulombCounter::nAsPerAh;
+        const double out_Ah = (double)(chargeOut_nAs - m_anchorOut_nAs) / (double)CoulombCounter::nAsPerAh;
+        const float span = m_anchorSoc - soc;
+        const bool clean = out_Ah > 0.0 && in_Ah <= m_maxChargeFraction * out_Ah;
+
+        if (clean && span >= m_minSpan) {
+            const float estimate = (float)((out_Ah - in_Ah) / span);
+            // Outside this range an anchor was wrong, not the battery
+            if (estimate > 0.5f * m_ratedAh && estimate < 1.2f * m_ratedAh) {
+                float gain = filterGain * span;
+                m_capacityAh += gain * (estimate - m_capacityAh);
+                if (m_capacityAh > m_ratedAh) m_capacityAh = m_ratedAh;
+                if (m_capacityAh < 0.5f * m_ratedAh) m_capacityAh = 0.5f * m_ratedAh;
+                m_lastEstimateAh = estimate;
+                m_estimates++;
+                updated = true;
+            }
+        } else if (clean && span > 0.0f) {
+            // Still discharging from a higher anchor: keep it, the span will grow
+            keepOld = true;
+        }
+    }
+
+    if (!keepOld) {
+        m_hasAnchor = true;
+        m_anchorSoc = soc;
+        m_anchorIn_nAs = chargeIn_nAs;
+        m_anchorOut_nAs = chargeOut_nAs;
+    }
+    return updated;
+}
+
+bool CapacityEstimator::load() {
+    Preferences prefs;
+    prefs.begin(NVS_SOH_NAMESPACE, true);
+    float cap = prefs.getFloat(NVS_KEY_LEARNED_CAPACITY, 0.0f);
+    m_estimates = prefs.getUInt(NVS_KEY_CAPACITY_ESTIMATES, 0);
+    prefs.end();
+    // Nothing stored, or learned for a different rated capacity
+    if (!(cap >= 0.5f * m_ratedAh && cap <= m_ratedAh)) {
+        m_capacityAh = m_ratedAh;
+        return false;
+    }
+    m_capacityAh = cap;
+    return true;
+}
+
+void CapacityEstimator::save() const {
+    Preferences prefs;
+    prefs.begin(NVS_SOH_NAMESPACE, false);
+    prefs.putFloat(NVS_KEY_LEARNED_CAPACITY, m_capacityAh);
+    prefs.putUInt(NVS_KEY_CAPACITY_ESTIMATES, m_estimates);
+    prefs.end();
+}
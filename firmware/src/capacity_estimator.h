@@ -0,0 +1,58 @@
+#ifndef CAPACITY_ESTIMATOR_H
+#define CAPACITY_ESTIMATOR_H
+
+#include <stdint.h>
+
+// State-of-health capacity learning.
+//
+// Capacity is measured, not assumed: between two points of independently known
+// SOC (anchors) the charge actually delivered is divided by the SOC difference.
+// Anchors are a detected full charge (SOC 1, exact) and OCV readings at rest
+// (their uncertainty comes from the curve slope, see ocv_resync.h; readings on
+// a plateau are not offered as anchors at all), so partial
+// cycles count as well as full-to-empty ones. A pair is only used if it spans at
+// least minSpan of SOC and the battery was (almost) only discharging between
+// them, since charge efficiency would otherwise leak into the result.
+//
+// Estimates are blended into the learned capacity with a gain proportional to
+// the span, so one deep cycle moves it more than a shallow one, and a single
+// bad anchor cannot wreck it. The learned capacity is kept between 50 % and
+// 100 % of rated: a pack does not grow, and an estimate above rated is noise.
+class CapacityEstimator {
+public:
+    explicit CapacityEstimator(float ratedAh);
+
+    // minSpan: SOC between anchors; maxChargeFraction: charge allowed in between,
+    // as a fraction of the delivered charge; maxSigma: worst OCV anchor accepted
+    void setPolicy(float minSpan, float maxChargeFraction, float maxSigma);
+
+    // A point of known SOC, with the counter's lifetime totals at that moment.
+    // True if it completed a measurement and the learned capacity changed.
+    bool addAnchor(float soc, float sigma, uint64_t chargeIn_nAs, uint64_t chargeOut_nAs);
+
+    bool load();        // learned capacity from NVS; true if one was stored
+    void save() const;
+
+    float rated_Ah() const { return m_ratedAh; }
+    float capacity_Ah() const { return m_capacityAh; }
+    float stateOfHealth() const { return m_capacityAh / m_ratedAh; }   // 0..1
+    float lastEstimate_Ah() const { return m_lastEstimateAh; }
+    uint32_t estimateCount() const { return m_estimates; }
+
+    static const float filterGain;      // per unit of SOC span
+
+private:
+    float m_ratedAh;
+    float m_capacityAh;
+    float m_minSpan;
+    float m_maxChargeFraction;
+    float m_maxSigma;
+    bool m_hasAnchor;
+    float m_anchorSoc;
+    uint64_t m_anchorIn_nAs;
+    uint64_t m_anchorOut_nAs;
+    float m_lastEstimateAh;
+    uint32_t m_estimates;
+};
+
+#endif // CAPACITY_ESTIMATOR_H
@@ -0,0 +1,80 @@
+#include "charge_detector.h"
+#include "battery_model.h"
+#include "shared_defs.h"
+#include <Arduino.h>
+#include <Preferences.h>
+
+const float ChargeDetector::rearmDrop = 0.02f;
+
+ChargeDetector::ChargeDetector()
+    : m_params{DefaultChemistry::chargedVoltage, 4.0f, 180},
+      m_tailCurrentA(4.0f),
+      m_conditionMet(false),
+      m_conditionStartMs(0),
+      m_armed(true),
+      m_hasEvent(false),
+      m_lastEventMs(0),
+      m_fullCount(0)
+{
+}
+
+bool ChargeDetector::setParams(const ChargeDetectorParams &params, float capacityAh) {
+    if (!(params.chargedVoltage > 5.25f && params.chargedVoltage < 20.0f)) return false;
+    if (!(params.tailPercent > 0.0f && params.tailPercent <= 20.0f)) return false;
+    if (params.dwellSeconds == 0 || !(capacityAh > 0.0f)) return false;
+    m_params = params;
+    m_tailCurrentA = capacityAh * params.tailPercent / 100.0f;
+    return true;
+}
+
+void ChargeDetector::load(float capacityAh) {
+    ChargeDetectorParams defaults = {DefaultChemistry::chargedVoltage, 4.0f, 180};
+    Preferences prefs;
+    prefs.begin(NVS_CHARGE_DETECT_NAMESPACE, true);
+    ChargeDetectorParams p;
+    p.chargedVoltage = prefs.getFloat(NVS_KEY_CHARGED_VOLTAGE, defaults.chargedVoltage);
+    p.tailPercent = prefs.getFloat(NVS_KEY_TAIL_PERCENT, defaults.tailPercent);
+    p.dwellSeconds = prefs.getUInt(NVS_KEY_CHARGED_DWELL, defaults.dwellSeconds);
+    m_fullCount = prefs.getUInt(NVS_KEY_FULL_CHARGE_COUNT, 0);
+    m_armed = prefs.getBool(NVS_KEY_FULL_CHARGE_ARMED, true);
+    prefs.end();
+    if (!setParams(p, capacityAh)) {
+        setParams(defaults, capacityAh);
+    }
+    Serial.printf("Charged detection: >= %.2fV, tail < %.1f%% (%.2fA) for %lus; %lu full charges so far\n",
+                  m_params.chargedVoltage, m_params.tailPercent, m_tailCurrentA,
+                  (unsigned long)m_params.dwellSeconds, (unsigned long)m_fullCount);
+}
+
+void ChargeDetector::save() const {
+    Preferences prefs;
+    prefs.begin(NVS_CHARGE_DETECT_NAMESPACE, false);
+    prefs.putFloat(NVS_KEY_CHARGED_VOLTAGE, m_params.chargedVoltage);
+    prefs.putFloat(NVS_KEY_TAIL_PERCENT, m_params.tailPercent);
+    prefs.putUInt(NVS_KEY_CHARGED_DWELL, m_params.dwellSeconds);
+    prefs.putUInt(NVS_KEY_FULL_CHARGE_COUNT, m_fullCount);
+    prefs.putBool(NVS_KEY_FULL_CHARGE_ARMED, m_armed);
+    prefs.end();
+}
+
+bool ChargeDetector::update(float currentA, float busVoltage_V, float soc, uint32_t nowMs) {
+    if (!m_armed && soc <= 1.0f - rearmDrop) m_armed = true;
+
+    // Charging, and tapered below the tail
+    const bool condition = busVoltage_V >= m_params.chargedVoltage && currentA < 0.0f && -currentA < m_tailCurrentA;
+    if (!condition) {
+        m_conditionMet = false;
+        return false;
+    }
+    if (!m_conditionMet) {
+        m_conditionMet = true;
+        m_conditionStartMs = nowMs;
+    }
+    if (!m_armed || nowMs - m_conditionStartMs < m_params.dwellSeconds * 1000UL) return false;
+
+    m_armed = false;
+    m_hasEvent = true;
+    m_lastEventMs = nowMs;
+    m_fullCount++;
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef CHARGE_DETECTOR_H
+#define CHARGE_DETECTOR_H
+
+#include <stdint.h>
+
+// Full-charge detection.
+//
+// The battery is considered charged once, for a continuous dwell time, the bus
+// voltage is at or above the charged voltage and a charging current (negative,
+// positive is discharge) has tapered below the tail current (a percentage of
+// rated capacity). Rest and discharge never qualify. That is the moment the
+// coulomb counter is snapped to 100 %. A new event is only reported after SOC
+// has dropped rearmDrop below full again, so hours of absorption or float
+// count as one charge. The armed state is saved with the count, so a reboot
+// during float does not count the same charge again.
+struct ChargeDetectorParams {
+    float chargedVoltage;   // V
+    float tailPercent;      // tail current as % of rated capacity per hour (C/25 = 4 %)
+    uint32_t dwellSeconds;
+};
+
+class ChargeDetector {
+public:
+    ChargeDetector();
+
+    bool setParams(const ChargeDetectorParams &params, float capacityAh);
+    const ChargeDetectorParams &params() const { return m_params; }
+    float tailCurrent_A() const { return m_tailCurrentA; }
+    void load(float capacityAh);    // NVS values, else chemistry preset defaults
+    void save() const;              // parameters, count and armed state
+
+    // Call every sample. True exactly once per detected full charge.
+    bool update(float currentA, float busVoltage_V, float soc, uint32_t nowMs);
+
+    uint32_t fullChargeCount() const { return m_fullCount; }
+    void setFullChargeCount(uint32_t count) { m_fullCount = count; }
+    bool hasFullCharge() const { return m_hasEvent; }
+    bool armed() const { return m_armed; }
+    uint32_t lastFullChargeMs() const { return m_lastEventMs; }
+
+    static const float rearmDrop;   // SOC fraction below full before re-arming
+
+private:
+    ChargeDetectorParams m_params;
+    float m_tailCurrentA;
+    bool m_conditionMet;
+    uint32_t m_conditionStartMs;
+    bool m_armed;
+    bool m_hasEvent;
+    uint32_t m_lastEventMs;
+    uint32_t m_fullCount;
+};
+
+#endif // CHARGE_DETECTOR_H
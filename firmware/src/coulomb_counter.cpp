@@ -0,0 +1,117 @@
+#include "coulomb_counter.h"
+
+static int64_t ahToNAs(float ah) {
+    double v = (double)ah * (double)CoulombCounter::nAsPerAh;
+    return (int64_t)(v < 0.0 ? v - 0.5 : v + 0.5);
+}
+
+CoulombCounter::CoulombCounter(float capacityAh)
+    : m_capacity_nAs(ahToNAs(capacityAh)),
+      m_remaining_nAs(m_capacity_nAs),
+      m_chargeIn_nAs(0),
+      m_chargeOut_nAs(0),
+      m_prev_uA(0),
+      m_prevEffective_uA(0),
+      m_prevMs(0),
+      m_hasPrev(false),
+      m_halfCarry(0),
+      m_halfCarryTotals(0)
+{
+}
+
+void CoulombCounter::restart() {
+    m_hasPrev = false;
+}
+
+void CoulombCounter::creditDischarge_nAs(uint64_t discharged_nAs) {
+    m_remaining_nAs -= (int64_t)discharged_nAs;
+    m_chargeOut_nAs += discharged_nAs;
+    clampRemaining();
+}
+
+int64_t CoulombCounter::trapezoid(int32_t i0, int32_t i1, uint32_t dt, int8_t &halfCarry) {
+    // (i0 + i1) * dt / 2. (i0 + i1) * dt fits int64 for any current
+    // representable in int32 uA over maxGapMs.
+    int64_t twice = ((int64_t)i0 + (int64_t)i1) * (int64_t)dt + halfCarry;
+    int64_t delta = twice / 2;
+    halfCarry = (int8_t)(twice - delta * 2);
+    return delta;
+}
+
+void CoulombCounter::addSample(int32_t current_uA, uint32_t now_ms) {
+    addSample(current_uA, current_uA, now_ms);
+}
+
+void CoulombCounter::addSample(int32_t current_uA, int32_t effective_uA, uint32_t now_ms) {
+    uint32_t dt = now_ms - m_prevMs;
+    if (!m_hasPrev || dt > maxGapMs) {
+        m_prev_uA = current_uA;
+        m_prevEffective_uA = effective_uA;
+        m_prevMs = now_ms;
+        m_hasPrev = true;
+        return;
+    }
+
+    // Lifetime totals: split the trapezoid at the zero crossing if the current
+    // changed direction during the interval
+    const int64_t a = m_prev_uA, b = current_uA;
+    const int64_t measured = trapezoid(m_prev_uA, current_uA, dt, m_halfCarryTotals);
+    if (a >= 0 && b >= 0) {
+        m_chargeOut_nAs += (uint64_t)measured;
+    } else if (a <= 0 && b <= 0) {
+        m_chargeIn_nAs += (uint64_t)(-measured);
+    } else {
+        // Areas of the two triangles either side of the crossing
+        const double hi = (double)(a > b ? a : b);
+        const double lo = (double)(a > b ? b : a);
+        const double scale = (double)dt / (2.0 * (hi - lo));
+        const double pos = hi * hi * scale;
+        const double neg = lo * lo * scale;
+        m_chargeOut_nAs += (uint64_t)(pos + 0.5);
+        m_chargeIn_nAs += (uint64_t)(neg + 0.5);
+    }
+
+    m_remaining_nAs -= trapezoid(m_prevEffective_uA, effective_uA, dt, m_halfCarry);
+    clampRemaining();
+    m_prev_uA = current_uA;
+    m_prevEffective_uA = effective_uA;
+    m_prevMs = now_ms;
+}
+
+void CoulombCounter::setCapacity_Ah(float capacityAh) {
+    m_capacity_nAs = ahToNAs(capacityAh);
+    clampRemaining();
+}
+
+void CoulombCounter::setRemaining_Ah(float remainingAh) {
+    m_remaining_nAs = ahToNAs(remainingAh);
+    clampRemaining();
+}
+
+void CoulombCounter::setRemaining_nAs(int64_t remaining_nAs) {
+    m_remaining_nAs = remaining_nAs;
+    clampRemaining();
+}
+
+void CoulombCounter::setTotals_nAs(uint64_t chargeIn_nAs, uint64_t chargeOut_nAs) {
+    m_chargeIn_nAs = chargeIn_nAs;
+    m_chargeOut_nAs = chargeOut_nAs;
+}
+
+float CoulombCounter::capacity_Ah() const {
+    return (float)((double)m_capacity_nAs / (double)nAsPerAh);
+}
+
+float CoulombCounter::remaining_Ah() const {
+    return (float)((double)m_remaining_nAs / (double)nAsPerAh);
+}
+
+float CoulombCounter::stateOfCharge() const {
+    if (m_capacity_nAs <= 0) return 0.0f;
+    return (float)((double)m_remaining_nAs / (double)m_capacity_nAs);
+}
+
+void CoulombCounter::clampRemaining() {
+    if (m_remaining_nAs < 0) m_remaining_nAs = 0;
+    if (m_remaining_nAs > m_capacity_nAs) m_remaining_nAs = m_capacity_nAs;
+}
@@ -0,0 +1,69 @@
+#ifndef COULOMB_COUNTER_H
+#define COULOMB_COUNTER_H
+
+#include <stdint.h>
+
+// Integer coulomb counter.
+//
+// Charge is kept in nano-amp-seconds (nAs) in 64-bit integers, so a 100 Ah
+// battery (3.6e14 nAs) is tracked to the last nAs and a 50 mA step is never lost
+// to float rounding against the full capacity. Each sample is integrated with
+// the trapezoid rule between it and the previous sample: current in uA times
+// time in ms is exactly nAs.
+//
+// Sign convention matches INA226_ADC::updateBatteryCapacity(): positive current
+// is discharge. Remaining charge is clamped to 0..capacity; the lifetime in/out
+// totals are not. Remaining charge may be integrated from a model-corrected
+// current (battery_model.h) while the totals always count measured charge.
+class CoulombCounter {
+public:
+    static const int64_t nAsPerAh = 3600LL * 1000000000LL;
+    // Longest gap integrated as one trapezoid. A blocking menu or a stalled loop
+    // is still integrated (the load keeps drawing, and a reseed would drop that
+    // charge); only a gap over a day, which means a clock jump, reseeds the
+    // previous sample.
+    static const uint32_t maxGapMs = 24UL * 60UL * 60UL * 1000UL;
+
+    explicit CoulombCounter(float capacityAh);
+
+    // Integrate one sample taken at now_ms. The first sample after construction
+    // or restart() only seeds the previous point.
+    void addSample(int32_t current_uA, uint32_t now_ms);
+    // Same, with remaining charge following effective_uA instead
+    void addSample(int32_t current_uA, int32_t effective_uA, uint32_t now_ms);
+    void restart();
+    // Charge drawn while no samples were taken (deep sleep), already integrated
+    void creditDischarge_nAs(uint64_t discharged_nAs);
+
+    void setCapacity_Ah(float capacityAh);      // rated capacity; remaining is clamped to it
+    void setRemaining_Ah(float remainingAh);
+    void setRemaining_nAs(int64_t remaining_nAs);
+    void setTotals_nAs(uint64_t chargeIn_nAs, uint64_t chargeOut_nAs);
+
+    int64_t capacity_nAs() const { return m_capacity_nAs; }
+    int64_t remaining_nAs() const { return m_remaining_nAs; }
+    uint64_t chargeIn_nAs() const { return m_chargeIn_nAs; }    // total charged
+    uint64_t chargeOut_nAs() const { return m_chargeOut_nAs; }  // total discharged
+
+    float capacity_Ah() const;
+    float remaining_Ah() const;
+    float stateOfCharge() const;                // fraction 0..1
+
+private:
+    void clampRemaining();
+
+    int64_t m_capacity_nAs;
+    int64_t m_remaining_nAs;
+    uint64_t m_chargeIn_nAs;
+    uint64_t m_chargeOut_nAs;
+    static int64_t trapezoid(int32_t i0, int32_t i1, uint32_t dt, int8_t &halfCarry);
+
+    int32_t m_prev_uA;
+    int32_t m_prevEffective_uA;
+    uint32_t m_prevMs;
+    bool m_hasPrev;
+    int8_t m_halfCarry;     // trapezoid area is in half-nAs; carry the odd half
+    int8_t m_halfCarryTotals;
+};
+
+#endif // COULOMB_COUNTER_H
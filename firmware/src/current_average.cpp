@@ -0,0 +1,46 @@
+#include "current_average.h"
+#include <math.h>
+
+CurrentAverage::CurrentAverage()
+    : m_tau_s(defaultTimeConstant_s),
+      m_average_A(0.0f),
+      m_hasValue(false),
+      m_firstMs(0),
+      m_lastMs(0),
+      m_alphaDtMs(0),
+      m_alpha(0.0f)
+{
+}
+
+bool CurrentAverage::setTimeConstant_s(float seconds) {
+    if (!(seconds >= minTimeConstant_s && seconds <= maxTimeConstant_s)) return false;
+    m_tau_s = seconds;
+    m_alphaDtMs = 0;    // recompute alpha for the new time constant
+    return true;
+}
+
+void CurrentAverage::addSample(float currentA, uint32_t nowMs) {
+    if (!m_hasValue) {
+        m_average_A = currentA;
+        m_hasValue = true;
+        m_firstMs = nowMs;
+        m_lastMs = nowMs;
+        return;
+    }
+
+    const uint32_t dt = nowMs - m_lastMs;
+    if (dt == 0) return;
+    if (dt != m_alphaDtMs) {
+        m_alpha = 1.0f - expf(-(float)dt / (m_tau_s * 1000.0f));
+        m_alphaDtMs = dt;
+    }
+    m_average_A += m_alpha * (currentA - m_average_A);
+    m_lastMs = nowMs;
+}
+
+void CurrentAverage::reset() {
+    m_average_A = 0.0f;
+    m_hasValue = false;
+    m_firstMs = 0;
+    m_lastMs = 0;
+}
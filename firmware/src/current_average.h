@@ -0,0 +1,44 @@
+#ifndef CURRENT_AVERAGE_H
+#define CURRENT_AVERAGE_H
+
+#include <stdint.h>
+
+// Time-constant exponential average of the battery current for run-flat time.
+//
+// Each sample moves the average by alpha = 1 - exp(-dt / tau) towards it, so
+// the weight of a sample depends on the time it covers, not on how often the
+// filter is fed: a steady current gives the same average at 4 Hz or 0.1 Hz,
+// and repeated samples at the same millisecond change nothing. O(1) per
+// sample; expf only runs when the sample interval changes. Averaging current
+// (not hours) keeps a near-zero-current sample from dominating the result.
+class CurrentAverage {
+public:
+    static constexpr float defaultTimeConstant_s = 300.0f;
+    static constexpr float minTimeConstant_s = 1.0f;
+    static constexpr float maxTimeConstant_s = 3600.0f;
+
+    CurrentAverage();
+
+    // Rejects values outside min..maxTimeConstant_s; keeps the average
+    bool setTimeConstant_s(float seconds);
+    float timeConstant_s() const { return m_tau_s; }
+
+    // The first sample seeds the average
+    void addSample(float currentA, uint32_t nowMs);
+    void reset();
+
+    bool hasValue() const { return m_hasValue; }
+    float average_A() const { return m_average_A; }
+    uint32_t span_ms() const { return m_lastMs - m_firstMs; }  // time covered by the samples
+
+private:
+    float m_tau_s;
+    float m_average_A;
+    bool m_hasValue;
+    uint32_t m_firstMs;
+    uint32_t m_lastMs;
+    uint32_t m_alphaDtMs;   // interval m_alpha was computed for
+    float m_alpha;
+};
+
+#endif // CURRENT_AVERAGE_H
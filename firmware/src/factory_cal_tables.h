@@ -0,0 +1,13 @@
+// AUTO-GENERATED by firmware/scripts/gen_factory_cal.py - do not edit.
+// Sources: (none)
+#ifndef FACTORY_CAL_TABLES_H
+#define FACTORY_CAL_TABLES_H
+
+#include "shared_defs.h"
+
+// Terminated by an entry with shuntRatedA == 0
+static constexpr FactoryCalTable factoryCalTables[] = {
+    {0, 0.0f, nullptr, 0},
+};
+
+#endif // FACTORY_CAL_TABLES_H
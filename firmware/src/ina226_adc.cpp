@@ -1,14 +1,28 @@
 #include "ina226_adc.h"
+#include "factory_cal_tables.h"
+#include "cal_math.h"
 #include <cfloat>
 #include <algorithm>
+#ifndef UNIT_TEST
+#include <hal/gpio_ll.h>
+#include <soc/gpio_struct.h>
+#endif
 
 INA226_ADC::INA226_ADC(uint8_t address, float shuntResistorOhms, float batteryCapacityAh)
     : ina226(address),
+      m_i2cAddress(address),
       defaultOhms(shuntResistorOhms), // Store the default value
       calibratedOhms(shuntResistorOhms), // Initialize with default
-      batteryCapacity(batteryCapacityAh),
-      maxBatteryCapacity(batteryCapacityAh),
-      lastUpdateTime(0),
+      m_coulomb(batteryCapacityAh),
+      m_soh(batteryCapacityAh),
+      m_rtcRestored(false),
+      m_rtcOcRetries(0),
+      m_rtcOcLockedOut(false),
+      m_protectionRestored(false),
+      m_supplyDip_V(9.0f),
+      m_sleepCurrent_mA(1.0f),
+      m_lastSleep_us(0),
+      m_lastSleepCurrent_uA(0),
       shuntVoltage_mV(-1),
       loadVoltage_V(-1),
       busVoltage_V(-1),
@@ -19,32 +33,53 @@ INA226_ADC::INA226_ADC(uint8_t address, float shuntResistorOhms, float batteryCa
       lowVoltageCutoff(9.0f), // Default for 3S LiFePO4
       hysteresis(0.6f),       // Default hysteresis
       overcurrentThreshold(50.0f), // Default 50A
+      m_irCompensation(true),
+      m_tripTimeAt2x_s(5.0f),
+      m_instantMultiple(3.0f),
+      m_lvdDebounce_s(2.0f),
+      m_ocMaxRetries(0),
+      m_ocCooldown_s(30.0f),
+      m_overvoltageCutoff_V(0.0f),
+      m_powerLimit_W(0.0f),
+      m_alertOverride(false),
+      m_rawCurrent_mA(0),
+      m_bus_mV(0),
       loadConnected(true),
       alertTriggered(false),
+      m_isrGateOffCycles(0),
+      m_alertEntryUs(0),
+      m_alertGatedLoad(false),
       m_isConfigured(false),
       m_activeShuntA(50), // Default to 50A
       m_disconnectReason(NONE),
       m_hardwareAlertsDisabled(false),
-      sampleIndex(0),
-      sampleCount(0),
-      lastSampleTime(0),
-      sampleIntervalSeconds(10)
+      m_calPoints(nullptr),
+      m_calCount(0),
+      m_factoryCalActive(false)
 {
-    for (int i = 0; i < maxSamples; ++i) runFlatSamples[i] = -1.0f;
+    m_chargeDetector.setParams(m_chargeDetector.params(), batteryCapacityAh);
+    refreshProtectionThresholds();
 }
 
 void INA226_ADC::begin(int sdaPin, int sclPin) {
     Wire.begin(sdaPin, sclPin);
 
+    // Before any protection action, so a trip counted here is not overwritten
+    if (!m_stats.load()) {
+        Serial.println("No lifetime statistics found. Starting a new history.");
+    }
+
+    // Load off until the protection settings are applied below
     pinMode(LOAD_SWITCH_PIN, OUTPUT);
-    setLoadConnected(true, NONE);
+    digitalWrite(LOAD_SWITCH_PIN, LOW);
 
     pinMode(INA_ALERT_PIN, INPUT_PULLUP);
 
     // Load active shunt rating
     Preferences prefs;
     prefs.begin(NVS_CAL_NAMESPACE, true);
-    m_activeShuntA = prefs.getUShort(NVS_KEY_ACTIVE_SHUNT, 50); // Default 50A
+    // A fresh board starts on the shunt its factory table was built for
+    m_activeShuntA = prefs.getUShort(NVS_KEY_ACTIVE_SHUNT, getFactoryDefaultShunt());
     prefs.end();
     Serial.printf("Using active shunt rating: %dA\n", m_activeShuntA);
 
@@ -57,8 +92,16 @@ void INA226_ADC::begin(int sdaPin, int sclPin) {
     // Load the calibrated shunt resistance from NVS, if it exists
     this->m_isConfigured = loadShuntResistance();
     if (!this->m_isConfigured) {
-        calibratedOhms = defaultOhms; // Use the default if not found
-        Serial.printf("No calibrated shunt resistance found. Using default: %.9f Ohms.\n", calibratedOhms);
+        // Boards built from a known-good shunt batch ship with the resistance in flash
+        const FactoryCalTable *factory = getFactoryCalibration(m_activeShuntA);
+        if (factory && factory->shuntOhms > 0.0f) {
+            calibratedOhms = factory->shuntOhms;
+            this->m_isConfigured = true;
+            Serial.printf("Using factory shunt resistance: %.9f Ohms.\n", calibratedOhms);
+        } else {
+            calibratedOhms = defaultOhms; // Use the default if not found
+            Serial.printf("No calibrated shunt resistance found. Using default: %.9f Ohms.\n", calibratedOhms);
+        }
     }
     
     // Set the resistor range with the calibrated or default value
@@ -67,13 +110,48 @@ void INA226_ADC::begin(int sdaPin, int sclPin) {
 
     // Load the calibration table for the active shunt
     if (loadCalibrationTable(m_activeShuntA)) {
-        Serial.printf("Loaded calibration table for %dA shunt.\n", m_activeShuntA);
+        Serial.printf("Loaded %s calibration table for %dA shunt.\n",
+                      m_factoryCalActive ? "factory" : "stored", m_activeShuntA);
     } else {
         Serial.printf("No calibration table found for %dA shunt.\n", m_activeShuntA);
     }
 
     loadProtectionSettings();
-    configureAlert(overcurrentThreshold);
+    configureAlert(getInstantTripCurrent_A());
+
+    // With the retry limit and delays loaded: after a brownout keep a tripped
+    // load off instead of briefly reconnecting it...
+    if (m_rtcRestored && m_disconnectReason != NONE) {
+        setLoadConnected(false, m_disconnectReason);
+    } else {
+        setLoadConnected(true, NONE);
+    }
+    // ...and do not hand a locked-out fault a fresh set of retries
+    if (m_rtcRestored) {
+        m_protection.restore(m_rtcOcRetries, m_rtcOcLockedOut, (uint32_t)millis());
+    }
+    m_protectionRestored = true;
+    m_model.load(m_soh.rated_Ah());
+    prefs.begin(NVS_BATTERY_MODEL_NAMESPACE, true);
+    m_runFlatAverage.setTimeConstant_s(prefs.getFloat(NVS_KEY_RUN_FLAT_TAU, CurrentAverage::defaultTimeConstant_s));
+    prefs.end();
+    m_chargeDetector.load(m_soh.rated_Ah());
+    if (m_soh.load()) {
+        // The journal/RTC restore already holds absolute remaining charge; only clamp it
+        m_coulomb.setCapacity_Ah(m_soh.capacity_Ah());
+        Serial.printf("Learned capacity %.1fAh of %.1fAh rated (SOH %.1f%%, %lu measurements)\n",
+                      m_soh.capacity_Ah(), m_soh.rated_Ah(), m_soh.stateOfHealth() * 100.0f,
+                      (unsigned long)m_soh.estimateCount());
+    }
+    m_rainflow.load();
+    WallClock::loadOffset();
+    if (m_loadProfile.load()) {
+        Serial.printf("Load profile: %u of %u bins learned\n", m_loadProfile.binsSeen(), LoadProfile::binCount);
+    }
+#ifdef USE_SOC_EKF
+    // Restored SOC (RTC or journal) is the starting point, with a generous sigma
+    m_ekf.reset(m_coulomb.stateOfCharge(), 0.1f, 0.01f);
+#endif
 }
 
 void INA226_ADC::readSensors() {
@@ -85,6 +163,15 @@ void INA226_ADC::readSensors() {
     // Use the calibrated current for this calculation.
     power_mW = getBusVoltage_V() * getCurrent_mA();
     loadVoltage_V = busVoltage_V + (shuntVoltage_mV / 1000.0f);
+    // Protection runs on the uncalibrated reading; its thresholds are converted instead
+    m_rawCurrent_mA = (int32_t)lroundf(current_mA);
+    m_bus_mV = (int32_t)lroundf(busVoltage_V * 1000.0f);
+
+    // Cranking dip: the board may brown out before the next sample. Below 5.25V
+    // we are on USB power (see checkAndHandleProtection), not dipping.
+    if (busVoltage_V > 5.25f && busVoltage_V < m_supplyDip_V) {
+        saveRtcSnapshot();
+    }
 }
 
 float INA226_ADC::getShuntVoltage_mV() const { return shuntVoltage_mV; }
@@ -92,7 +179,7 @@ float INA226_ADC::getBusVoltage_V() const { return busVoltage_V; }
 float INA226_ADC::getRawCurrent_mA() const { return current_mA; }
 
 float INA226_ADC::getCurrent_mA() const {
-    if (!calibrationTable.empty()) {
+    if (m_calCount > 0) {
         return getCalibratedCurrent_mA(current_mA);
     }
     // fallback: linear
@@ -100,34 +187,23 @@ float INA226_ADC::getCurrent_mA() const {
 }
 
 float INA226_ADC::getCalibratedCurrent_mA(float raw_mA) const {
-    if (calibrationTable.empty()) return raw_mA;
-
-    // Below/above range -> clamp to edge true values
-    if (raw_mA <= calibrationTable.front().raw_mA) return calibrationTable.front().true_mA;
-    if (raw_mA >= calibrationTable.back().raw_mA)  return calibrationTable.back().true_mA;
-
-    // Find interval [i-1, i] such that raw_mA < points[i].raw_mA
-    for (size_t i = 1; i < calibrationTable.size(); ++i) {
-        if (raw_mA < calibrationTable[i].raw_mA) {
-            const float x0 = calibrationTable[i-1].raw_mA;
-            const float y0 = calibrationTable[i-1].true_mA;
-            const float x1 = calibrationTable[i].raw_mA;
-            const float y1 = calibrationTable[i].true_mA;
-            if (fabsf(x1 - x0) < 1e-9f) return y0; // degenerate
-            return y0 + (raw_mA - x0) * (y1 - y0) / (x1 - x0);
-        }
-    }
-    return raw_mA; // should not hit
+    return interpolateCalTable(m_calPoints, m_calCount, raw_mA);
 }
 
 float INA226_ADC::getPower_mW() const { return power_mW; }
 float INA226_ADC::getLoadVoltage_V() const { return loadVoltage_V; }
-float INA226_ADC::getBatteryCapacity() const { return batteryCapacity; }
-void INA226_ADC::setBatteryCapacity(float capacity) { batteryCapacity = capacity; }
+float INA226_ADC::getBatteryCapacity() const { return m_coulomb.remaining_Ah(); }
+void INA226_ADC::setBatteryCapacity(float capacity) {
+    m_coulomb.setRemaining_Ah(capacity);
+#ifdef USE_SOC_EKF
+    m_ekf.setSoc(m_coulomb.stateOfCharge(), 0.1f);
+#endif
+}
 
 void INA226_ADC::setCalibration(float gain, float offset_mA) {
     calibrationGain = gain;
     calibrationOffset_mA = offset_mA;
+    refreshProtectionThresholds();
 }
 
 void INA226_ADC::getCalibration(float &gainOut, float &offsetOut) const {
@@ -161,6 +237,7 @@ bool INA226_ADC::loadCalibration(uint16_t shuntRatedA) {
 
     calibrationGain = g;
     calibrationOffset_mA = o;
+    refreshProtectionThresholds();
     return true;
 }
 
@@ -205,6 +282,7 @@ bool INA226_ADC::saveCalibration(uint16_t shuntRatedA, float gain, float offset_
 
     calibrationGain = gain;
     calibrationOffset_mA = offset_mA;
+    refreshProtectionThresholds();
     return true;
 }
 
@@ -257,27 +335,10 @@ bool INA226_ADC::loadShuntResistance() {
 
 // ---------------- Table-based calibration ----------------
 
-static void sortAndDedup(std::vector<CalPoint> &pts) {
-    std::sort(pts.begin(), pts.end(), [](const CalPoint &a, const CalPoint &b){
-        return a.raw_mA < b.raw_mA;
-    });
-    // Collapse any duplicate raw_mA by averaging their true_mA
-    std::vector<CalPoint> out;
-    for (const auto &p : pts) {
-        if (out.empty() || fabsf(p.raw_mA - out.back().raw_mA) > 1e-6f) {
-            out.push_back(p);
-        } else {
-            // average
-            out.back().true_mA = 0.5f * (out.back().true_mA + p.true_mA);
-        }
-    }
-    pts.swap(out);
-}
-
 bool INA226_ADC::saveCalibrationTable(uint16_t shuntRatedA, const std::vector<CalPoint> &points) {
     std::vector<CalPoint> pts = points;
     if (pts.empty()) return false;
-    sortAndDedup(pts);
+    sortAndDedupCalPoints(pts);
 
     Preferences prefs;
     prefs.begin("ina_cal", false);
@@ -298,9 +359,12 @@ bool INA226_ADC::saveCalibrationTable(uint16_t shuntRatedA, const std::vector<Ca
 
     prefs.end();
     calibrationTable = std::move(pts);
+    useRamCalibrationTable();
     return true;
 }
 
+// A table saved in NVS (field calibration) always wins. Otherwise fall back to
+// the factory table compiled into flash, which needs no heap and no further NVS reads.
 bool INA226_ADC::loadCalibrationTable(uint16_t shuntRatedA) {
     Preferences prefs;
     prefs.begin("ina_cal", true);
@@ -311,8 +375,9 @@ bool INA226_ADC::loadCalibrationTable(uint16_t shuntRatedA) {
 
     if (N == 0) {
         prefs.end();
-        calibrationTable.clear();
-        return false;
+        std::vector<CalPoint>().swap(calibrationTable); // release any previous heap table
+        useFactoryCalibrationTable(getFactoryCalibration(shuntRatedA));
+        return m_calCount > 0;
     }
 
     std::vector<CalPoint> pts;
@@ -330,19 +395,70 @@ bool INA226_ADC::loadCalibrationTable(uint16_t shuntRatedA) {
 
     if (pts.empty()) {
         calibrationTable.clear();
+        useRamCalibrationTable();
         return false;
     }
-    sortAndDedup(pts);
+    sortAndDedupCalPoints(pts);
     calibrationTable = std::move(pts);
+    useRamCalibrationTable();
     return true;
 }
 
+void INA226_ADC::useRamCalibrationTable() {
+    m_calPoints = calibrationTable.empty() ? nullptr : calibrationTable.data();
+    m_calCount = calibrationTable.size();
+    m_factoryCalActive = false;
+    refreshProtectionThresholds();
+}
+
+void INA226_ADC::useFactoryCalibrationTable(const FactoryCalTable *table) {
+    if (table && table->count > 0) {
+        m_calPoints = table->points;
+        m_calCount = table->count;
+        m_factoryCalActive = true;
+    } else {
+        m_calPoints = nullptr;
+        m_calCount = 0;
+        m_factoryCalActive = false;
+    }
+    refreshProtectionThresholds();
+}
+
+// The generated list, or a test's own
+static const FactoryCalTable *activeFactoryCalTables = factoryCalTables;
+
+#ifdef UNIT_TEST
+void INA226_ADC::setFactoryCalTables(const FactoryCalTable *tables) {
+    activeFactoryCalTables = tables ? tables : factoryCalTables;
+}
+#endif
+
+const FactoryCalTable* INA226_ADC::getFactoryCalibration(uint16_t shuntRatedA) {
+    for (const FactoryCalTable *t = activeFactoryCalTables; t->shuntRatedA != 0; ++t) {
+        if (t->shuntRatedA == shuntRatedA) return t;
+    }
+    return nullptr;
+}
+
+uint16_t INA226_ADC::getFactoryDefaultShunt() {
+    return activeFactoryCalTables[0].shuntRatedA != 0 ? activeFactoryCalTables[0].shuntRatedA : 50;
+}
+
+bool INA226_ADC::isUsingFactoryCalibration() const {
+    return m_factoryCalActive;
+}
+
+float INA226_ADC::getShuntResistance_Ohms() const {
+    return calibratedOhms;
+}
+
 bool INA226_ADC::hasCalibrationTable() const {
-    return !calibrationTable.empty();
+    return m_calCount > 0;
 }
 
-const std::vector<CalPoint>& INA226_ADC::getCalibrationTable() const {
-    return calibrationTable;
+const CalPoint* INA226_ADC::getCalibrationTable(size_t &countOut) const {
+    countOut = m_calCount;
+    return m_calPoints;
 }
 
 bool INA226_ADC::hasStoredCalibrationTable(uint16_t shuntRatedA, size_t &countOut) const {
@@ -377,38 +493,263 @@ bool INA226_ADC::clearCalibrationTable(uint16_t shuntRatedA) {
     }
 
     prefs.end();
-    calibrationTable.clear();
+    // Fall back to what is left for this shunt: the factory table, if any
+    loadCalibrationTable(shuntRatedA);
     return true;
 }
 
-// ---------------- Battery/run-flat logic (unchanged) ----------------
+// ---------------- Battery state and run-flat time ----------------
 
 void INA226_ADC::updateBatteryCapacity(float currentA) {
-    unsigned long currentTime = millis();
+    // uA keeps the counter exact; clamp to what int32 uA can hold (+-2147 A)
+    double current_uA = (double)currentA * 1e6;
+    if (current_uA > 2147483647.0) current_uA = 2147483647.0;
+    if (current_uA < -2147483647.0) current_uA = -2147483647.0;
+    const uint32_t now = (uint32_t)millis();
+    const float effectiveA = m_model.effectiveCurrent_A((float)(current_uA / 1e6));
+#ifdef USE_SOC_EKF
+    const int64_t before_nAs = m_coulomb.remaining_nAs();
+#endif
+    m_coulomb.addSample((int32_t)lround(current_uA), (int32_t)lroundf(effectiveA * 1e6f), now);
+#ifdef USE_SOC_EKF
+    // The counter's step is the filter's process model. Only the filter's
+    // correction goes back into the count, in nAs, so float SOC rounding never
+    // overwrites what the counter integrated.
+    const float deltaSoc = (float)((double)(m_coulomb.remaining_nAs() - before_nAs) / (double)m_coulomb.capacity_nAs());
+    m_ekf.update(deltaSoc, currentA, busVoltage_V, now);
+    const int64_t correction_nAs = llround((double)m_ekf.lastCorrection() * (double)m_coulomb.capacity_nAs());
+    if (correction_nAs != 0) {      // at least one count
+        m_coulomb.setRemaining_nAs(m_coulomb.remaining_nAs() + correction_nAs);
+    }
+#endif
+
+    // Rested long enough: pull the counted SOC towards the OCV curve
+    float soc = m_coulomb.stateOfCharge();
+    const float countedSoc = soc;
+    if (m_ocvResync.update(currentA, busVoltage_V, now, soc)) {
+        m_coulomb.setRemaining_nAs((int64_t)((double)soc * (double)m_coulomb.capacity_nAs()));
+        Serial.printf("OCV resync at %.2fV: SOC %.1f%% -> %.1f%% (weight %.2f)\n",
+                      busVoltage_V, countedSoc * 100.0f, soc * 100.0f, m_ocvResync.lastWeight());
+#ifdef USE_SOC_EKF
+        m_ekf.setSoc(soc, m_ocvResync.lastOcvSigma());
+#endif
+        if (!m_ocvResync.lastOnPlateau() &&
+            m_soh.addAnchor(m_ocvResync.lastOcvSoc(), m_ocvResync.lastOcvSigma(),
+                            m_coulomb.chargeIn_nAs(), m_coulomb.chargeOut_nAs())) {
+            applyLearnedCapacity();
+        }
+    }
 
-    if (lastUpdateTime == 0) {
-        lastUpdateTime = currentTime;
-        return;
+    // Charger has tapered off at the charged voltage: the battery is full, whatever the count says
+    const bool chargeArmed = m_chargeDetector.armed();
+    if (m_chargeDetector.update(currentA, busVoltage_V, m_coulomb.stateOfCharge(), now)) {
+        Serial.printf("Full charge #%lu detected at %.2fV: SOC %.1f%% -> 100%%\n",
+                      (unsigned long)m_chargeDetector.fullChargeCount(), busVoltage_V,
+                      m_coulomb.stateOfCharge() * 100.0f);
+        m_coulomb.setRemaining_nAs(m_coulomb.capacity_nAs());
+#ifdef USE_SOC_EKF
+        m_ekf.setSoc(1.0f, 0.005f);
+#endif
+        m_chargeDetector.save();
+        if (m_soh.addAnchor(1.0f, 0.0f, m_coulomb.chargeIn_nAs(), m_coulomb.chargeOut_nAs())) {
+            applyLearnedCapacity();
+        }
+        journalStateOfCharge(true);
+    } else if (m_chargeDetector.armed() != chargeArmed) {
+        m_chargeDetector.save();    // re-armed: once per cycle
+    }
+    m_timeToFull.update(currentA, busVoltage_V, m_coulomb.capacity_Ah() - m_coulomb.remaining_Ah(), now,
+                        m_chargeDetector);
+
+    m_stats.addSample(m_coulomb, busVoltage_V, lowVoltageCutoff, now);
+    if (busVoltage_V >= 5.25f) {
+        m_rainflow.addSoc(m_coulomb.stateOfCharge());
+    }
+
+    if (m_resistance.addSample(currentA, busVoltage_V, now)) {
+        refreshProtectionThresholds();
     }
 
-    float deltaTimeSec = (currentTime - lastUpdateTime) / 1000.0f;
-    float deltaAh = (currentA * deltaTimeSec) / 3600.0f;
-    batteryCapacity -= deltaAh;
-    if (batteryCapacity < 0.0f) batteryCapacity = 0.0f;
-    if (batteryCapacity > maxBatteryCapacity) batteryCapacity = maxBatteryCapacity;
-    lastUpdateTime = currentTime;
+    m_runFlatAverage.addSample(effectiveA, now);
+    if (WallClock::isSet()) {
+        m_loadProfile.addSample(effectiveA, WallClock::localSecondOfDay(), now);
+    }
+}
+
+// Keep SOC where it is and rescale remaining charge to the new capacity
+void INA226_ADC::applyLearnedCapacity() {
+    const float soc = m_coulomb.stateOfCharge();
+    m_coulomb.setCapacity_Ah(m_soh.capacity_Ah());
+    m_coulomb.setRemaining_nAs((int64_t)((double)soc * (double)m_coulomb.capacity_nAs()));
+    m_soh.save();
+    Serial.printf("Capacity measured %.1fAh: learned %.1fAh, SOH %.1f%%\n",
+                  m_soh.lastEstimate_Ah(), m_soh.capacity_Ah(), m_soh.stateOfHealth() * 100.0f);
+}
+
+bool INA226_ADC::checkpointLifetimeStats(bool force) {
+    const uint32_t now = (uint32_t)millis();
+    const bool rainflow = m_rainflow.checkpoint(now, force);
+    const bool profile = m_loadProfile.checkpoint(now, force);
+    return m_stats.checkpoint(now, force) || rainflow || profile;
+}
+
+void INA226_ADC::resetLifetimeStats() {
+    const uint32_t now = (uint32_t)millis();
+    m_stats.reset(now);
+    m_rainflow.reset(now);
+}
+
+void INA226_ADC::resetLoadProfile() {
+    m_loadProfile.reset((uint32_t)millis());
+}
+
+bool INA226_ADC::setChargeDetectorParams(const ChargeDetectorParams &params) {
+    if (!m_chargeDetector.setParams(params, m_soh.rated_Ah())) return false;
+    m_chargeDetector.save();
+    return true;
+}
+
+bool INA226_ADC::setBatteryModelParams(const BatteryModelParams &params) {
+    if (!m_model.setParams(params, m_soh.rated_Ah())) return false;
+    m_model.save();
+    return true;
+}
+
+bool INA226_ADC::setRunFlatTimeConstant_s(float seconds) {
+    if (!m_runFlatAverage.setTimeConstant_s(seconds)) return false;
+    Preferences prefs;
+    prefs.begin(NVS_BATTERY_MODEL_NAMESPACE, false);
+    prefs.putFloat(NVS_KEY_RUN_FLAT_TAU, seconds);
+    prefs.end();
+    return true;
+}
+
+float INA226_ADC::getStateOfCharge() const { return m_coulomb.stateOfCharge(); }
+
+bool INA226_ADC::restoreStateOfCharge() {
+    SocJournalRecord rec;
+    if (!m_socJournal.restore(rec)) {
+        Serial.println("No SOC journal record found. Assuming full battery.");
+        return false;
+    }
+    m_coulomb.setRemaining_nAs(rec.remaining_nAs);
+    m_coulomb.setTotals_nAs(rec.chargeIn_nAs, rec.chargeOut_nAs);
+    m_coulomb.restart();
+    Serial.printf("Restored SOC %.1f%% (journal record %lu).\n",
+                  m_coulomb.stateOfCharge() * 100.0f, (unsigned long)rec.seq);
+    return true;
+}
+
+bool INA226_ADC::restoreFromRtc() {
+    // Always close the sleep record, even if there is no state to credit it to
+    uint64_t slept_us;
+    uint32_t sleep_uA;
+    const bool woke = SleepClock::endSleep(slept_us, sleep_uA);
+    m_lastSleep_us = woke ? slept_us : 0;
+    m_lastSleepCurrent_uA = woke ? sleep_uA : 0;
+
+    RtcStateSnapshot snap;
+    if (!RtcState::load(snap)) return false;
+    m_coulomb.setRemaining_nAs(snap.remaining_nAs);
+    m_coulomb.setTotals_nAs(snap.chargeIn_nAs, snap.chargeOut_nAs);
+    m_coulomb.restart();
+    loadConnected = snap.loadConnected != 0;
+    m_disconnectReason = loadConnected ? NONE : (DisconnectReason)snap.disconnectReason;
+    m_rtcOcRetries = snap.ocRetries;
+    m_rtcOcLockedOut = !loadConnected && m_disconnectReason == OVERCURRENT && snap.ocLockedOut != 0;
+    m_rtcRestored = true;
+    Serial.printf("Restored state from RTC memory: SOC %.1f%%, load %s (reason %d).\n",
+                  m_coulomb.stateOfCharge() * 100.0f, loadConnected ? "ON" : "OFF", m_disconnectReason);
+
+    // Woke from deep sleep: nothing was sampled, so credit the estimated drain
+    if (woke) {
+        m_coulomb.creditDischarge_nAs(slept_us * sleep_uA / 1000ULL);
+        saveRtcSnapshot();
+        Serial.printf("Slept %.1fs at %.2fmA: SOC now %.2f%%\n", slept_us / 1e6,
+                      sleep_uA / 1000.0f, m_coulomb.stateOfCharge() * 100.0f);
+    }
+    return true;
+}
+
+void INA226_ADC::saveRtcSnapshot() {
+    RtcStateSnapshot snap;
+    snap.remaining_nAs = m_coulomb.remaining_nAs();
+    snap.chargeIn_nAs = m_coulomb.chargeIn_nAs();
+    snap.chargeOut_nAs = m_coulomb.chargeOut_nAs();
+    snap.disconnectReason = (uint8_t)m_disconnectReason;
+    snap.loadConnected = loadConnected ? 1 : 0;
+    if (m_rtcRestored && !m_protectionRestored) {
+        // Before begin() (the LVD fast wake, an early restart) the engine is
+        // still blank: hand the restored retry state on unchanged
+        snap.ocRetries = m_rtcOcRetries;
+        snap.ocLockedOut = m_rtcOcLockedOut ? 1 : 0;
+    } else {
+        snap.ocRetries = m_protection.retries();
+        snap.ocLockedOut = (!loadConnected && m_disconnectReason == OVERCURRENT &&
+                            m_protection.state() == ProtectionEngine::TRIPPED) ? 1 : 0;
+    }
+    RtcState::save(snap);
+}
+
+bool INA226_ADC::journalStateOfCharge(bool force) {
+    uint32_t now = (uint32_t)millis();
+    return force ? m_socJournal.save(m_coulomb, now) : m_socJournal.update(m_coulomb, now);
+}
+
+float INA226_ADC::getChargeIn_Ah() const {
+    return (float)((double)m_coulomb.chargeIn_nAs() / (double)CoulombCounter::nAsPerAh);
+}
+
+float INA226_ADC::getChargeOut_Ah() const {
+    return (float)((double)m_coulomb.chargeOut_nAs() / (double)CoulombCounter::nAsPerAh);
 }
 
 bool INA226_ADC::isOverflow() const { return ina226.overflow; }
 
+// Bounded append: never writes past size, always leaves out terminated
+static void appendText(char *out, size_t size, size_t &pos, const char *text) {
+    while (*text && pos + 1 < size) out[pos++] = *text++;
+    out[pos] = '\0';
+}
+
+static void appendUInt(char *out, size_t size, size_t &pos, uint32_t value) {
+    char digits[11];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0 && pos + 1 < size) out[pos++] = digits[--n];
+    out[pos] = '\0';
+}
+
+void INA226_ADC::calculateRunFlatTimeFormatted(float currentA, float warningThresholdHours, bool &warningTriggered,
+                                               char *out, size_t outSize) {
+    formatRunFlatTime(m_model.effectiveCurrent_A(currentA), warningThresholdHours, warningTriggered, out, outSize);
+}
+
+#ifdef UNIT_TEST
 String INA226_ADC::calculateRunFlatTimeFormatted(float currentA, float warningThresholdHours, bool &warningTriggered) {
+    char text[runFlatTextSize];
+    calculateRunFlatTimeFormatted(currentA, warningThresholdHours, warningTriggered, text, sizeof(text));
+    return String(text);
+}
+#endif
+
+// currentA here is already model-corrected, so hours are hours of usable capacity
+void INA226_ADC::formatRunFlatTime(float currentA, float warningThresholdHours, bool &warningTriggered,
+                                   char *out, size_t outSize) const {
     warningTriggered = false;
+    if (outSize == 0) return;
+    size_t pos = 0;
+    out[0] = '\0';
 
-    const float maxRunFlatHours = 24.0f * 7.0f;
     float runHours = -1.0f;
     bool charging = false;
 
     // Define a small tolerance for "fully charged" state, e.g., 99.5%
+    const float batteryCapacity = m_coulomb.remaining_Ah();
+    const float maxBatteryCapacity = m_coulomb.capacity_Ah();
     const float fullyChargedThreshold = maxBatteryCapacity * 0.995f;
 
     if (currentA > 0.001f) {
@@ -416,19 +757,34 @@ String INA226_ADC::calculateRunFlatTimeFormatted(float currentA, float warningTh
         charging = false;
     } else if (currentA < -0.20f) {
         if (batteryCapacity >= fullyChargedThreshold) {
-             return String("Fully Charged!");
+            appendText(out, outSize, pos, "Fully Charged!");
+            return;
         }
+        // The taper model once the charger is seen; else constant current to full
         float remainingToFullAh = maxBatteryCapacity - batteryCapacity;
-        runHours = remainingToFullAh / (-currentA);
+        runHours = m_timeToFull.hasPrediction() ? m_timeToFull.hours() : remainingToFullAh / (-currentA);
         charging = true;
     }
 
+    formatRunHours(runHours, charging, warningThresholdHours, warningTriggered, out, outSize);
+}
+
+void INA226_ADC::formatRunHours(float runHours, bool charging, float warningThresholdHours, bool &warningTriggered,
+                                char *out, size_t outSize) const {
+    warningTriggered = false;
+    if (outSize == 0) return;
+    size_t pos = 0;
+    out[0] = '\0';
+    const float maxRunFlatHours = 24.0f * 7.0f;
+
     if (runHours <= 0.0f) {
-      return String("Fully Charged!");
+        appendText(out, outSize, pos, "Fully Charged!");
+        return;
     }
 
     if (runHours > maxRunFlatHours) {
-        return String("> 7 days");
+        appendText(out, outSize, pos, "> 7 days");
+        return;
     }
 
     if (!charging && runHours <= warningThresholdHours) {
@@ -441,77 +797,42 @@ String INA226_ADC::calculateRunFlatTimeFormatted(float currentA, float warningTh
     totalMinutes %= (24 * 60);
     uint32_t hours = totalMinutes / 60;
 
-    String result;
     if (days > 0) {
-        result += String(days) + (days == 1 ? " day " : " days ");         
+        appendUInt(out, outSize, pos, days);
+        appendText(out, outSize, pos, days == 1 ? " day " : " days ");
     }
     if (hours > 0) {
-        result += String(hours) + (hours == 1 ? " hour " : " hours ");
+        appendUInt(out, outSize, pos, hours);
+        appendText(out, outSize, pos, hours == 1 ? " hour " : " hours ");
     }
 
     // Add "until flat" or "until full" based on charging state
-    if (!charging) {
-        result += "until flat";
-    } else {
-        result += "until full";
-    }
+    appendText(out, outSize, pos, charging ? "until full" : "until flat");
+}
 
-    return result;
+String INA226_ADC::getAveragedRunFlatTime(float warningThresholdHours, bool &warningTriggered) const {
+    char text[runFlatTextSize];
+    getAveragedRunFlatTime(warningThresholdHours, warningTriggered, text, sizeof(text));
+    return String(text);
 }
 
-String INA226_ADC::getAveragedRunFlatTime(float currentA, float warningThresholdHours, bool &warningTriggered) {
+void INA226_ADC::getAveragedRunFlatTime(float warningThresholdHours, bool &warningTriggered,
+                                        char *out, size_t outSize) const {
     warningTriggered = false;
-    const int minSamplesForAverage = 3;
-    unsigned long now = millis();
-
-    if (now - lastSampleTime < (unsigned long)sampleIntervalSeconds * 1000UL) {
-        if (sampleCount == 0) {
-            return String("Gathering data...");
-        } else if (sampleCount < minSamplesForAverage) {
-            int lastSampleIndex = (sampleIndex + maxSamples - 1) % maxSamples;
-            float lastSample = runFlatSamples[lastSampleIndex];
-            if (lastSample <= 0.0f) return String("Gathering data...");
-            warningTriggered = (lastSample <= warningThresholdHours);
-            return calculateRunFlatTimeFormatted((lastSample > 0.0f) ? (batteryCapacity / lastSample) : 0.0f, warningThresholdHours, warningTriggered);
-        } else {
-            float sum = 0.0f;
-            int validSamples = 0;
-            for (int i = 0; i < sampleCount; i++) {
-                if (runFlatSamples[i] > 0.0f) {
-                    sum += runFlatSamples[i];
-                    validSamples++;
-                }
-            }
-            float avgRunFlatHours = (validSamples > 0) ? (sum / validSamples) : -1.0f;
-            warningTriggered = (avgRunFlatHours >= 0.0f) && (avgRunFlatHours <= warningThresholdHours);
-            float approxCurrentA = (avgRunFlatHours > 0.0f) ? (batteryCapacity / avgRunFlatHours) : 0.0f;
-            return calculateRunFlatTimeFormatted(approxCurrentA, warningThresholdHours, warningTriggered);
-        }
-    }
-
-    lastSampleTime = now;
-
-    float currentRunFlatHours = (currentA > 0.001f) ? (batteryCapacity / currentA) : -1.0f;
-
-    if (currentRunFlatHours >= 0.0f) {
-        runFlatSamples[sampleIndex] = currentRunFlatHours;
-        sampleIndex = (sampleIndex + 1) % maxSamples;
-        if (sampleCount < maxSamples) sampleCount++;
+    if (outSize == 0) return;
+    if (m_runFlatAverage.span_ms() < runFlatWarmupMs) {
+        size_t pos = 0;
+        appendText(out, outSize, pos, "Gathering data...");
+        return;
     }
-
-    float sum = 0.0f;
-    int validSamples = 0;
-    for (int i = 0; i < sampleCount; i++) {
-        if (runFlatSamples[i] > 0.0f) {
-            sum += runFlatSamples[i];
-            validSamples++;
-        }
+    const float averageA = m_runFlatAverage.average_A();
+    if (averageA > 0.001f && WallClock::isSet() && m_loadProfile.binsSeen() >= minProfileBins) {
+        const float hours = m_loadProfile.hoursToEmpty(m_coulomb.remaining_Ah(), m_coulomb.capacity_Ah(),
+                                                       WallClock::localSecondOfDay(), averageA);
+        formatRunHours(hours, false, warningThresholdHours, warningTriggered, out, outSize);
+        return;
     }
-    float avgRunFlatHours = (validSamples > 0) ? (sum / validSamples) : -1.0f;
-
-    warningTriggered = (avgRunFlatHours >= 0.0f) && (avgRunFlatHours <= warningThresholdHours);
-    float approxCurrentA = (avgRunFlatHours > 0.0f) ? (batteryCapacity / avgRunFlatHours) : 0.0f;
-    return calculateRunFlatTimeFormatted(approxCurrentA, warningThresholdHours, warningTriggered);
+    formatRunFlatTime(averageA, warningThresholdHours, warningTriggered, out, outSize);
 }
 
 // ---------------- Protection Features ----------------
@@ -522,11 +843,27 @@ void INA226_ADC::loadProtectionSettings() {
     lowVoltageCutoff = prefs.getFloat(NVS_KEY_LOW_VOLTAGE_CUTOFF, 9.0f);
     hysteresis = prefs.getFloat(NVS_KEY_HYSTERESIS, 0.6f);
     overcurrentThreshold = prefs.getFloat(NVS_KEY_OVERCURRENT, 50.0f);
+    m_irCompensation = prefs.getBool(NVS_KEY_LV_IR_COMPENSATION, true);
+    m_sleepCurrent_mA = prefs.getFloat(NVS_KEY_SLEEP_CURRENT, 1.0f);
+    m_tripTimeAt2x_s = prefs.getFloat(NVS_KEY_OC_TRIP_TIME_2X, 5.0f);
+    m_instantMultiple = prefs.getFloat(NVS_KEY_OC_INSTANT_MULTIPLE, 3.0f);
+    m_lvdDebounce_s = prefs.getFloat(NVS_KEY_LV_DEBOUNCE, 2.0f);
+    m_ocMaxRetries = prefs.getUChar(NVS_KEY_OC_RETRIES, 0);
+    m_ocCooldown_s = prefs.getFloat(NVS_KEY_OC_COOLDOWN, 30.0f);
+    m_overvoltageCutoff_V = prefs.getFloat(NVS_KEY_OVERVOLTAGE, 0.0f);
+    m_powerLimit_W = prefs.getFloat(NVS_KEY_POWER_LIMIT, 0.0f);
     prefs.end();
+    refreshProtectionThresholds();
     Serial.println("Loaded protection settings:");
     Serial.printf("  LV Cutoff: %.2fV\n", lowVoltageCutoff);
     Serial.printf("  Hysteresis: %.2fV\n", hysteresis);
-    Serial.printf("  OC Threshold: %.2fA\n", overcurrentThreshold);
+    Serial.printf("  OC Threshold: %.2fA (I2t %.1fs at 2x, instant at %.1fx)\n", overcurrentThreshold,
+                  m_tripTimeAt2x_s, m_instantMultiple);
+    Serial.printf("  LV debounce: %.1fs\n", m_lvdDebounce_s);
+    Serial.printf("  OC retries: %u, first after %.0fs, doubling\n", m_ocMaxRetries, m_ocCooldown_s);
+    Serial.printf("  OV cutoff: %.2fV, power limit: %.0fW (0 = off)\n", m_overvoltageCutoff_V, m_powerLimit_W);
+    Serial.printf("  IR-compensated LV cutoff: %s\n", m_irCompensation ? "on" : "off");
+    Serial.printf("  Sleep current: %.2fmA\n", m_sleepCurrent_mA);
 }
 
 void INA226_ADC::saveProtectionSettings() {
@@ -535,6 +872,15 @@ void INA226_ADC::saveProtectionSettings() {
     prefs.putFloat(NVS_KEY_LOW_VOLTAGE_CUTOFF, lowVoltageCutoff);
     prefs.putFloat(NVS_KEY_HYSTERESIS, hysteresis);
     prefs.putFloat(NVS_KEY_OVERCURRENT, overcurrentThreshold);
+    prefs.putBool(NVS_KEY_LV_IR_COMPENSATION, m_irCompensation);
+    prefs.putFloat(NVS_KEY_SLEEP_CURRENT, m_sleepCurrent_mA);
+    prefs.putFloat(NVS_KEY_OC_TRIP_TIME_2X, m_tripTimeAt2x_s);
+    prefs.putFloat(NVS_KEY_OC_INSTANT_MULTIPLE, m_instantMultiple);
+    prefs.putFloat(NVS_KEY_LV_DEBOUNCE, m_lvdDebounce_s);
+    prefs.putUChar(NVS_KEY_OC_RETRIES, m_ocMaxRetries);
+    prefs.putFloat(NVS_KEY_OC_COOLDOWN, m_ocCooldown_s);
+    prefs.putFloat(NVS_KEY_OVERVOLTAGE, m_overvoltageCutoff_V);
+    prefs.putFloat(NVS_KEY_POWER_LIMIT, m_powerLimit_W);
     prefs.end();
     Serial.println("Saved protection settings.");
 }
@@ -544,7 +890,134 @@ void INA226_ADC::setProtectionSettings(float lv_cutoff, float hyst, float oc_thr
     hysteresis = hyst;
     overcurrentThreshold = oc_thresh;
     saveProtectionSettings();
-    configureAlert(overcurrentThreshold); // Re-configure alert with new threshold
+    warnIfInstantClamped();
+    configureAlert(getInstantTripCurrent_A()); // Re-configure alert with new threshold
+    refreshProtectionThresholds();
+}
+
+void INA226_ADC::setSleepCurrent_mA(float mA) {
+    m_sleepCurrent_mA = mA < 0.0f ? 0.0f : mA;
+    saveProtectionSettings();
+}
+
+void INA226_ADC::setIrCompensation(bool enabled) {
+    m_irCompensation = enabled;
+    saveProtectionSettings();
+    refreshProtectionThresholds();
+}
+
+bool INA226_ADC::setOvercurrentCurve(float tripTimeAt2x_s, float instantMultiple) {
+    if (!(tripTimeAt2x_s >= 0.1f && tripTimeAt2x_s <= 600.0f)) return false;
+    if (!(instantMultiple >= 1.5f && instantMultiple <= 10.0f)) return false;
+    m_tripTimeAt2x_s = tripTimeAt2x_s;
+    m_instantMultiple = instantMultiple;
+    saveProtectionSettings();
+    warnIfInstantClamped();
+    configureAlert(getInstantTripCurrent_A());
+    refreshProtectionThresholds();
+    return true;
+}
+
+bool INA226_ADC::setLowVoltageDebounce_s(float seconds) {
+    if (!(seconds >= 0.0f && seconds <= 60.0f)) return false;
+    m_lvdDebounce_s = seconds;
+    saveProtectionSettings();
+    refreshProtectionThresholds();
+    return true;
+}
+
+bool INA226_ADC::setOvercurrentRetries(uint8_t maxRetries, float cooldown_s) {
+    if (maxRetries > 10) return false;
+    if (!(cooldown_s >= 1.0f && cooldown_s <= 3600.0f)) return false;
+    m_ocMaxRetries = maxRetries;
+    m_ocCooldown_s = cooldown_s;
+    saveProtectionSettings();
+    refreshProtectionThresholds();
+    return true;
+}
+
+bool INA226_ADC::setOvervoltageCutoff_V(float volts) {
+    if (!(volts == 0.0f || (volts > lowVoltageCutoff + hysteresis && volts <= 20.0f))) return false;
+    m_overvoltageCutoff_V = volts;
+    saveProtectionSettings();
+    refreshProtectionThresholds();
+    return true;
+}
+
+bool INA226_ADC::setPowerLimit_W(float watts) {
+    if (!(watts >= 0.0f && watts <= 5000.0f)) return false;
+    m_powerLimit_W = watts;
+    saveProtectionSettings();
+    refreshProtectionThresholds();
+    return true;
+}
+
+float INA226_ADC::getMaxMeasurableCurrent_A() const {
+    return calibratedOhms > 0.0f ? instantHeadroom * shuntFullScale_V / calibratedOhms : 0.0f;
+}
+
+float INA226_ADC::getInstantTripCurrent_A() const {
+    const float requested = overcurrentThreshold * m_instantMultiple;
+    const float limit = getMaxMeasurableCurrent_A();
+    return (limit > 0.0f && requested > limit) ? limit : requested;
+}
+
+void INA226_ADC::warnIfInstantClamped() const {
+    const float requested = overcurrentThreshold * m_instantMultiple;
+    if (requested > getInstantTripCurrent_A()) {
+        Serial.printf("Instant trip %.1fA is beyond the shunt's range; using %.1fA.\n",
+                      requested, getInstantTripCurrent_A());
+    }
+}
+
+// Shunt comparator level for a current, kept inside the measurable range
+float INA226_ADC::shuntAlertLimit_V(float amps) const {
+    const float limit_V = instantHeadroom * shuntFullScale_V;
+    const float volts = amps * calibratedOhms;
+    return volts > limit_V ? limit_V : volts;
+}
+
+// Current the chip reports (before calibration) for a true current
+float INA226_ADC::rawCurrentFor_mA(float true_mA) const {
+    if (m_calCount > 0) {
+        return invertCalTable(m_calPoints, m_calCount, true_mA);
+    }
+    return calibrationGain != 0.0f ? (true_mA - calibrationOffset_mA) / calibrationGain : true_mA;
+}
+
+// Settings, calibration or resistance changed: redo the engine's raw-unit thresholds
+void INA226_ADC::refreshProtectionThresholds() {
+    ProtectionThresholds t;
+    t.pickup_mA = (int32_t)lroundf(rawCurrentFor_mA(overcurrentThreshold * 1000.0f));
+    t.instant_mA = (int32_t)lroundf(rawCurrentFor_mA(getInstantTripCurrent_A() * 1000.0f));
+    t.budget_mA2ms = ProtectionEngine::i2tBudget(t.pickup_mA, m_tripTimeAt2x_s);
+    t.lowVoltage_mV = (int32_t)lroundf(lowVoltageCutoff * 1000.0f);
+    t.reconnect_mV = (int32_t)lroundf((lowVoltageCutoff + hysteresis) * 1000.0f);
+    t.irCompQ16 = (m_irCompensation && m_resistance.hasEstimate())
+                      ? (int32_t)lroundf(m_resistance.resistance_Ohm() * 65536.0f) : 0;
+    t.irCompMax_mV = (int32_t)lroundf(getIrCompensationLimit_V() * 1000.0f);
+    t.overVoltage_mV = (int32_t)lroundf(m_overvoltageCutoff_V * 1000.0f);
+    t.ovReconnect_mV = (int32_t)lroundf((m_overvoltageCutoff_V - hysteresis) * 1000.0f);
+    // Power limit in raw units, scaled by the calibration's gain at the threshold
+    const float rawPerTrue = rawCurrentFor_mA(overcurrentThreshold * 1000.0f) / (overcurrentThreshold * 1000.0f);
+    t.overPower_mAmV = (int64_t)llroundf(m_powerLimit_W * 1.0e6f * rawPerTrue);
+    m_protection.setThresholds(t);
+
+    ProtectionTiming timing = m_protection.timing();
+    timing.lvdDebounceMs = (uint32_t)lroundf(m_lvdDebounce_s * 1000.0f);
+    timing.cooldownMs = (uint32_t)lroundf(m_ocCooldown_s * 1000.0f);
+    timing.maxRetries = m_ocMaxRetries;
+    m_protection.setTiming(timing);
+}
+
+// Terminal voltage with the ohmic drop of the present discharge added back
+float INA226_ADC::getCompensatedVoltage_V() const {
+    const float voltage = getBusVoltage_V();
+    const float current = getCurrent_mA() / 1000.0f;
+    if (!m_irCompensation || !m_resistance.hasEstimate() || current <= 0.0f) return voltage;
+    const float drop = current * m_resistance.resistance_Ohm();
+    const float limit = getIrCompensationLimit_V();
+    return voltage + (drop < limit ? drop : limit);
 }
 
 float INA226_ADC::getLowVoltageCutoff() const {
@@ -576,43 +1049,70 @@ float INA226_ADC::getHardwareAlertThreshold_A() const {
 }
 
 void INA226_ADC::checkAndHandleProtection() {
-    float voltage = getBusVoltage_V();
-    float current = getCurrent_mA() / 1000.0f;
-
-    // If the voltage is very low, it's likely that we are powered via USB
-    // for configuration and don't have a battery connected. In this case,
-    // we should not trigger low-voltage protection.
-    if (voltage < 5.25f) {
-        return;
-    }
-
-    if (isLoadConnected()) {
-        if (voltage < lowVoltageCutoff) {
-            Serial.printf("Low voltage detected (%.2fV < %.2fV). Disconnecting load.\n", voltage, lowVoltageCutoff);
-            setLoadConnected(false, LOW_VOLTAGE);
-            enterSleepMode();
-        } else if (current > overcurrentThreshold) {
-            Serial.printf("Overcurrent detected (%.2fA > %.2fA). Disconnecting load.\n", current, overcurrentThreshold);
-            setLoadConnected(false, OVERCURRENT);
-        }
-    } else {
-        // If load is disconnected, only auto-reconnect if it was for low voltage
-        if (m_disconnectReason == LOW_VOLTAGE && voltage > (lowVoltageCutoff + hysteresis)) {
-            Serial.printf("Voltage recovered (%.2fV > %.2fV). Reconnecting load.\n", voltage, lowVoltageCutoff + hysteresis);
-            setLoadConnected(true, NONE);
+    // Below 5.25V we are powered via USB for configuration, without a battery:
+    // the engine ignores low voltage there (usbPower_mV)
+    switch (m_protection.evaluate(m_rawCurrent_mA, m_bus_mV, (uint32_t)millis())) {
+    case ProtectionEngine::ACTION_TRIP_LOW_VOLTAGE:
+        Serial.printf("Low voltage for %.1fs (%.2fV, %.2fV compensated < %.2fV). Disconnecting load.\n",
+                      m_lvdDebounce_s, getBusVoltage_V(), getCompensatedVoltage_V(), lowVoltageCutoff);
+        setLoadConnected(false, LOW_VOLTAGE);
+        enterSleepMode();
+        break;
+    case ProtectionEngine::ACTION_TRIP_OVERCURRENT:
+        Serial.printf("Overcurrent (%.2fA, I2t %.0f%%, threshold %.2fA). Disconnecting load.\n",
+                      getCurrent_mA() / 1000.0f, m_protection.heat() * 100.0f, overcurrentThreshold);
+        setLoadConnected(false, OVERCURRENT);
+        break;
+    case ProtectionEngine::ACTION_TRIP_OVER_VOLTAGE:
+        Serial.printf("Overvoltage (%.2fV >= %.2fV). Disconnecting load.\n", getBusVoltage_V(), m_overvoltageCutoff_V);
+        setLoadConnected(false, OVERVOLTAGE);
+        break;
+    case ProtectionEngine::ACTION_RECONNECT:
+        if (m_protection.fault() == ProtectionEngine::FAULT_OVERCURRENT) {
+            Serial.printf("Overcurrent retry %u of %u after %lus (%.2fV). Reconnecting load.\n",
+                          m_protection.retries() + 1, m_ocMaxRetries,
+                          (unsigned long)(m_protection.recloseDelayMs() / 1000UL), getBusVoltage_V());
+            m_stats.recordRetry();
+        } else {
+            Serial.printf("Protection recovered (%.2fV). Reconnecting load.\n", getBusVoltage_V());
         }
+        setLoadConnected(true, NONE);
+        break;
+    case ProtectionEngine::ACTION_NONE:
+        break;
     }
 }
 
 void INA226_ADC::setLoadConnected(bool connected, DisconnectReason reason) {
     Serial.printf("DEBUG: setLoadConnected called. Target state: %s, Reason: %d\n", connected ? "ON" : "OFF", reason);
     digitalWrite(LOAD_SWITCH_PIN, connected ? HIGH : LOW);
+    const bool wasConnected = loadConnected;
+    // Switching off by hand is not a protection trip
+    if (wasConnected && !connected && reason != NONE && reason != MANUAL) {
+        m_stats.recordTrip((uint8_t)reason);
+    }
     loadConnected = connected;
     if (connected) {
         m_disconnectReason = NONE;
     } else {
         m_disconnectReason = reason;
     }
+    const uint32_t now = (uint32_t)millis();
+    if (connected) {
+        m_protection.onConnected(now);
+    } else if (reason == LOW_VOLTAGE) {
+        m_protection.onTripped(ProtectionEngine::FAULT_LOW_VOLTAGE, now);
+    } else if (reason == OVERCURRENT) {
+        m_protection.onTripped(ProtectionEngine::FAULT_OVERCURRENT, now);
+        if (wasConnected && m_ocMaxRetries > 0 && m_protection.state() == ProtectionEngine::TRIPPED) {
+            Serial.printf("Overcurrent lockout after %u retries. Reconnect manually.\n", m_protection.retries());
+            m_stats.recordLockout();
+        }
+    } else if (reason == OVERVOLTAGE) {
+        m_protection.onTripped(ProtectionEngine::FAULT_OVER_VOLTAGE, now);
+    } else {
+        m_protection.onManualOff(now);
+    }
     Serial.printf("DEBUG: setLoadConnected finished. Internal state: loadConnected=%s, m_disconnectReason=%d\n", loadConnected ? "true" : "false", m_disconnectReason);
 }
 
@@ -627,16 +1127,76 @@ void INA226_ADC::configureAlert(float amps) {
         Serial.println("INA226 hardware alert DISABLED.");
     } else {
         // Configure INA226 to trigger alert on overcurrent (shunt voltage over limit)
-        float shuntVoltageLimit_V = amps * calibratedOhms;
+        float shuntVoltageLimit_V = shuntAlertLimit_V(amps);
 
         ina226.setAlertType(SHUNT_OVER, shuntVoltageLimit_V);
         ina226.enableAlertLatch();
         Serial.printf("Configured INA226 alert for overcurrent threshold of %.2fA (Shunt Voltage > %.4fV)\n",
                       amps, shuntVoltageLimit_V);
     }
+    m_alertScheduler.force(AlertScheduler::ALERT_SHUNT_OVER, (uint32_t)millis());
+}
+
+void INA226_ADC::updateAlertSchedule() {
+    // A pending alert belongs to the armed function: switch only once it is handled
+    if (m_hardwareAlertsDisabled || m_alertOverride || alertTriggered) return;
+
+    const bool battery = m_bus_mV >= ProtectionEngine::usbPower_mV;
+    const float floor_V = getHardwareLowVoltageFloor_V();
+    AlertLevels levels;
+    levels.instant_A = getInstantTripCurrent_A();
+    // Low voltage is blanked while the load settles, as in the engine
+    levels.busUnder_V = (battery && loadConnected && m_protection.state() == ProtectionEngine::ARMED && floor_V > 0.0f)
+                            ? floor_V : 0.0f;
+    levels.busOver_V = (battery && loadConnected) ? m_overvoltageCutoff_V : 0.0f;
+    levels.powerOver_W = loadConnected ? m_powerLimit_W : 0.0f;
+
+    const float current_A = getCurrent_mA() / 1000.0f;
+    const float power_W = current_A > 0.0f ? current_A * getBusVoltage_V() : 0.0f;
+    if (m_alertScheduler.update(levels, current_A, getBusVoltage_V(), power_W, (uint32_t)millis())) {
+        applyAlertFunction(m_alertScheduler.function());
+    }
 }
 
-void INA226_ADC::handleAlert() {
+// Program the comparator for one function and clear any stale latched flag
+void INA226_ADC::applyAlertFunction(AlertScheduler::Function f) {
+    switch (f) {
+    case AlertScheduler::ALERT_BUS_UNDER:
+        ina226.setAlertType(BUS_UNDER, getHardwareLowVoltageFloor_V());
+        break;
+    case AlertScheduler::ALERT_BUS_OVER:
+        ina226.setAlertType(BUS_OVER, m_overvoltageCutoff_V);
+        break;
+    case AlertScheduler::ALERT_POWER_OVER:
+        ina226.setAlertType(POWER_OVER, m_powerLimit_W * 1000.0f);   // library takes mW
+        break;
+    case AlertScheduler::ALERT_SHUNT_OVER:
+    case AlertScheduler::FUNCTION_COUNT:
+        ina226.setAlertType(SHUNT_OVER, shuntAlertLimit_V(getInstantTripCurrent_A()));
+        break;
+    }
+    ina226.enableAlertLatch();
+    ina226.readAndClearFlags();
+}
+
+// Runs in the ALERT interrupt. The gate is driven low here with a single
+// register write, so a short is cut off without waiting for the loop; the I2C
+// flag read (which may block on the bus) and the bookkeeping are deferred to
+// processAlert(). Only timestamps are stored, the histograms are filled there.
+void IRAM_ATTR INA226_ADC::handleAlert() {
+    const uint32_t entry = cpuCycleCount();
+    if (alertTriggered) return;     // latched alert, not processed yet
+    m_alertGatedLoad = false;
+    if (!m_hardwareAlertsDisabled && loadConnected) {
+#ifdef UNIT_TEST
+        digitalWrite(LOAD_SWITCH_PIN, LOW);
+#else
+        gpio_ll_set_level(&GPIO, (gpio_num_t)LOAD_SWITCH_PIN, 0);
+#endif
+        m_isrGateOffCycles = cpuCycleCount() - entry;
+        m_alertGatedLoad = true;
+    }
+    m_alertEntryUs = (uint32_t)micros();
     alertTriggered = true;
 }
 
@@ -648,15 +1208,35 @@ void INA226_ADC::processAlert() {
             ina226.readAndClearFlags();
             return;
         }
-        if (isLoadConnected()) { // Only process if the load is currently connected
-            Serial.println("Short circuit or overcurrent alert triggered! Disconnecting load.");
-            setLoadConnected(false, OVERCURRENT);
+        if (m_alertGatedLoad) {
+            m_isrGateOffLatency.add(m_isrGateOffCycles);
+            m_alertHandledLatency.add((uint32_t)micros() - m_alertEntryUs);
+        }
+        const AlertScheduler::Function armed = m_alertScheduler.function();
+        if (isLoadConnected()) { // The ISR already opened the gate; record the trip
+            Serial.printf("Hardware %s alert triggered! Gate written %lu cycles after ISR entry.\n",
+                          AlertScheduler::functionName(armed), (unsigned long)m_isrGateOffCycles);
+            DisconnectReason reason = OVERCURRENT;      // shunt over and power over
+            if (armed == AlertScheduler::ALERT_BUS_UNDER) reason = LOW_VOLTAGE;
+            else if (armed == AlertScheduler::ALERT_BUS_OVER) reason = OVERVOLTAGE;
+            setLoadConnected(false, reason);
+            if (reason == LOW_VOLTAGE) {
+                ina226.readAndClearFlags();
+                alertTriggered = false;
+                enterSleepMode();       // as after a software low-voltage trip
+                return;
+            }
         }
         ina226.readAndClearFlags(); // Always clear the alert on the chip
         alertTriggered = false; // Reset the software flag
     }
 }
 
+void INA226_ADC::resetAlertLatency() {
+    m_isrGateOffLatency.reset();
+    m_alertHandledLatency.reset();
+}
+
 bool INA226_ADC::isAlertTriggered() const {
     return alertTriggered;
 }
@@ -667,26 +1247,62 @@ void INA226_ADC::clearAlerts() {
 
 void INA226_ADC::enterSleepMode() {
     Serial.println("Entering deep sleep to conserve power.");
-    esp_sleep_enable_timer_wakeup(10 * 1000000); // Wake up every 10 seconds
+    // Wakes check the battery from RTC memory instead of booting (lvd_sleep.h)
+    LvdSleep::arm(m_i2cAddress, (uint32_t)lroundf((lowVoltageCutoff + hysteresis) * 1000.0f));
+    ina226.powerDown();
+    deepSleep();
+}
+
+void INA226_ADC::deepSleep() {
+    saveRtcSnapshot();
+    // Likewise the sleep current: on a fast wake NVS has not been read
+    const uint32_t sleep_uA = (m_rtcRestored && !m_protectionRestored && m_lastSleep_us != 0)
+                                  ? m_lastSleepCurrent_uA
+                                  : (uint32_t)lroundf(m_sleepCurrent_mA * 1000.0f);
+    SleepClock::beginSleep(sleep_uA);
+    esp_sleep_enable_timer_wakeup(LvdSleep::interval_us);
     esp_deep_sleep_start();
 }
 
+bool INA226_ADC::lowVoltageFastWake(int sdaPin, int sclPin) {
+    if (!LvdSleep::armed()) return false;
+    uint32_t bus_mV = 0;
+    if (!m_rtcRestored || m_lastSleep_us == 0 || !LvdSleep::timerWake() ||
+        !LvdSleep::readBus_mV(sdaPin, sclPin, bus_mV) || bus_mV > LvdSleep::reconnect_mV()) {
+        LvdSleep::disarm();     // recovered, reset by hand, or no sensor: full boot
+        return false;
+    }
+
+    // From app start only: the measured sleep minus the interval would be mostly
+    // sleep-clock error, not boot time
+    const uint32_t awake_us = (uint32_t)LvdSleep::uptime_us();
+    LvdSleep::recordWake(awake_us, bus_mV);
+    // restoreFromRtc() charged the whole interval at the sleep current
+    if (LvdSleep::awakeCurrent_uA > m_lastSleepCurrent_uA) {
+        m_coulomb.creditDischarge_nAs((uint64_t)awake_us * (LvdSleep::awakeCurrent_uA - m_lastSleepCurrent_uA) / 1000ULL);
+    }
+    deepSleep();
+    return true;
+}
+
 bool INA226_ADC::isConfigured() const {
     return m_isConfigured;
 }
 
 void INA226_ADC::setTempOvercurrentAlert(float amps) {
+    m_alertOverride = true;
     configureAlert(amps);
 }
 
 void INA226_ADC::restoreOvercurrentAlert() {
-    configureAlert(overcurrentThreshold);
+    m_alertOverride = false;
+    configureAlert(getInstantTripCurrent_A());
 }
 
 void INA226_ADC::toggleHardwareAlerts() {
     m_hardwareAlertsDisabled = !m_hardwareAlertsDisabled;
     // Re-apply the alert configuration to either enable or disable it on the chip
-    configureAlert(overcurrentThreshold);
+    configureAlert(getInstantTripCurrent_A());
 }
 
 bool INA226_ADC::areHardwareAlertsDisabled() const {
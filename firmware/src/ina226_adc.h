@@ -8,13 +8,30 @@
 #include <Preferences.h>
 #include <vector>
 #include "shared_defs.h"
+#include "coulomb_counter.h"
+#include "soc_journal.h"
+#include "rtc_state.h"
+#include "battery_model.h"
+#include "ocv_resync.h"
+#include "charge_detector.h"
+#include "lifetime_stats.h"
+#include "capacity_estimator.h"
+#include "soc_ekf.h"
+#include "resistance_estimator.h"
+#include "rainflow_counter.h"
+#include "sleep_clock.h"
+#include "current_average.h"
+#include "time_to_full.h"
+#include "load_profile.h"
+#include "wall_clock.h"
+#include "protection_engine.h"
+#include "latency_histogram.h"
+#include "alert_scheduler.h"
+#include "lvd_sleep.h"
 
-enum DisconnectReason { NONE, LOW_VOLTAGE, OVERCURRENT, MANUAL };
-
-struct CalPoint {
-    float raw_mA;   // raw measured current from INA226 (mA)
-    float true_mA;  // ground-truth current (mA)
-};
+enum DisconnectReason { NONE, LOW_VOLTAGE, OVERCURRENT, MANUAL, OVERVOLTAGE };
+// The lifetime record keeps one trip counter per reason
+static_assert(OVERVOLTAGE < LifetimeStats::tripSlots, "lifetime trip slots do not cover every DisconnectReason");
 
 class INA226_ADC {
 public:
@@ -29,10 +46,71 @@ public:
     float getLoadVoltage_V() const;
     float getBatteryCapacity() const;
     void setBatteryCapacity(float capacity);
-    void updateBatteryCapacity(float currentA); // current in A (positive = discharge)
+    void updateBatteryCapacity(float currentA); // current in A (positive = discharge), call once per sample
+    float getStateOfCharge() const;             // remaining / rated, 0..1
+    float getChargeIn_Ah() const;               // total charged since counters were reset
+    float getChargeOut_Ah() const;              // total discharged since counters were reset
+    const CoulombCounter &getCoulombCounter() const { return m_coulomb; }
+    bool restoreStateOfCharge();                // latest SOC journal record; cold-start fallback for restoreFromRtc()
+    bool journalStateOfCharge(bool force = false); // per sample; writes only when the journal policy allows
+
+    // Emergency state in RTC memory (see rtc_state.h)
+    bool restoreFromRtc();                      // call in setup() before begin(); true if state survived the reset
+    void saveRtcSnapshot();                     // every sample, on a supply dip, and before reset/sleep
+    void setSupplyDipVoltage(float volts) { m_supplyDip_V = volts; }
+    // Drain while in deep sleep (unit + unswitched loads), credited on wake (sleep_clock.h)
+    void setSleepCurrent_mA(float mA);
+    float getSleepCurrent_mA() const { return m_sleepCurrent_mA; }
+    // After restoreFromRtc(), first thing in setup(): following a low-voltage
+    // sleep, one bus reading decides between sleeping again at once and a full
+    // boot (lvd_sleep.h). Does not return on the device when it sleeps again.
+    bool lowVoltageFastWake(int sdaPin, int sclPin);
+
+    // Peukert / charge-efficiency model applied to SOC and run-flat (battery_model.h)
+    bool setBatteryModelParams(const BatteryModelParams &params); // validates and saves to NVS
+    const BatteryModelParams &getBatteryModelParams() const { return m_model.params(); }
+    // Run-flat time follows an exponential average of the model-corrected
+    // current (current_average.h); the time constant is saved in NVS
+    bool setRunFlatTimeConstant_s(float seconds);
+    float getRunFlatTimeConstant_s() const { return m_runFlatAverage.timeConstant_s(); }
+    bool isAtRest() const { return m_ocvResync.atRest(); }   // rested long enough for an OCV reading
+
+    // Full-charge detection: snaps the counter to 100 % (charge_detector.h)
+    bool setChargeDetectorParams(const ChargeDetectorParams &params); // validates and saves to NVS
+    const ChargeDetector &getChargeDetector() const { return m_chargeDetector; }
+    // Charging time-to-full with the absorption taper (time_to_full.h); "until full" uses it
+    const TimeToFull &getTimeToFull() const { return m_timeToFull; }
+
+    // Lifetime history (lifetime_stats.h): updated per sample, checkpointed to NVS
+    const LifetimeStatsRecord &getLifetimeStats() const { return m_stats.record(); }
+    bool checkpointLifetimeStats(bool force = false);   // also the rainflow histogram
+    void resetLifetimeStats();
+    const RainflowCounter &getRainflow() const { return m_rainflow; }   // SOC cycle depth histogram
+    // Time-of-day load profile (load_profile.h), learned while the wall clock is set;
+    // checkpointed with the lifetime stats
+    const LoadProfile &getLoadProfile() const { return m_loadProfile; }
+    void resetLoadProfile();
+
+    // Capacity learned from full-charge and OCV anchors (capacity_estimator.h).
+    // SOC and run-flat use the learned capacity; the constructor value is the rating.
+    float getEffectiveCapacity_Ah() const { return m_coulomb.capacity_Ah(); }
+    float getStateOfHealth() const { return m_soh.stateOfHealth(); }   // learned / rated, 0..1
+    const CapacityEstimator &getCapacityEstimator() const { return m_soh; }
+    const OcvResync &getOcvResync() const { return m_ocvResync; }
+#ifdef USE_SOC_EKF
+    // Kalman-filter SOC (soc_ekf.h) drives the counter when built with -DUSE_SOC_EKF
+    const SocEkf &getSocEkf() const { return m_ekf; }
+#endif
     bool isOverflow() const;
-    bool clearCalibrationTable(uint16_t shuntRatedA);
-    String getAveragedRunFlatTime(float currentA, float warningThresholdHours, bool &warningTriggered);
+    bool clearCalibrationTable(uint16_t shuntRatedA);   // falls back to the factory table, if any
+    // Time to flat (or full) from the averaged current and the remaining charge,
+    // or to flat along the load profile once enough of it is learned. Only reads:
+    // the average is fed by updateBatteryCapacity(). Writes at most outSize bytes
+    // (always terminated) into out, e.g. the 40-byte telemetry field; no heap
+    // use. The String overload wraps it.
+    void getAveragedRunFlatTime(float warningThresholdHours, bool &warningTriggered,
+                                char *out, size_t outSize) const;
+    String getAveragedRunFlatTime(float warningThresholdHours, bool &warningTriggered) const;
 
     // New shunt resistance calibration methods
     bool saveShuntResistance(float resistance);
@@ -45,14 +123,64 @@ public:
     float getLowVoltageCutoff() const;
     float getHysteresis() const;
     float getOvercurrentThreshold() const;
-    void checkAndHandleProtection();
+    // Low-voltage cutoff on V + I*R once a resistance estimate exists, so a
+    // heavy load's sag does not trip it (saved with the protection settings).
+    // The drop added back is capped at the hysteresis, so a bad estimate or a
+    // surge cannot hold the load on far below the cutoff.
+    void setIrCompensation(bool enabled);
+    bool isIrCompensationEnabled() const { return m_irCompensation; }
+    float getCompensatedVoltage_V() const;
+    float getIrCompensationLimit_V() const { return hysteresis; }
+    const ResistanceEstimator &getResistanceEstimator() const { return m_resistance; }
+    // Overcurrent is an I^2t curve above the threshold (protection_engine.h):
+    // tripTimeAt2x_s at twice it, instant at instantMultiple times it (also the
+    // hardware alert level). Low voltage must last lvdDebounce_s. Saved to NVS.
+    bool setOvercurrentCurve(float tripTimeAt2x_s, float instantMultiple);
+    float getTripTimeAt2x_s() const { return m_tripTimeAt2x_s; }
+    float getInstantMultiple() const { return m_instantMultiple; }
+    // Clamped to what the shunt input can measure: the reading and the shunt
+    // comparator saturate at 81.92 mV, so a higher level could never trip
+    float getInstantTripCurrent_A() const;
+    float getMaxMeasurableCurrent_A() const;    // instantHeadroom of full scale
+    static constexpr float shuntFullScale_V = 0.08192f;
+    static constexpr float instantHeadroom = 0.95f;
+    bool setLowVoltageDebounce_s(float seconds);
+    float getLowVoltageDebounce_s() const { return m_lvdDebounce_s; }
+    // Overcurrent reclose: up to maxRetries automatic reconnects, the first
+    // after cooldown_s and each further one after twice the previous wait;
+    // then locked out until a manual reconnect (kept across resets in RTC memory). 0 retries latches on
+    // the first trip. Retries and lockouts are counted in the lifetime history.
+    bool setOvercurrentRetries(uint8_t maxRetries, float cooldown_s);
+    uint8_t getOvercurrentMaxRetries() const { return m_ocMaxRetries; }
+    float getOvercurrentCooldown_s() const { return m_ocCooldown_s; }
+    // Optional limits (0 = off): disconnect above a bus voltage, and above a
+    // discharge power (counted as an overcurrent trip). Saved to NVS.
+    bool setOvervoltageCutoff_V(float volts);
+    float getOvervoltageCutoff_V() const { return m_overvoltageCutoff_V; }
+    bool setPowerLimit_W(float watts);
+    float getPowerLimit_W() const { return m_powerLimit_W; }
+    const ProtectionEngine &getProtection() const { return m_protection; }
+    void checkAndHandleProtection();    // every sample, after readSensors()
+    // Lends the INA226 alert comparator to the closest fault (alert_scheduler.h);
+    // every sample after checkAndHandleProtection(). Bus under is armed at
+    // cutoff - hysteresis, below the debounced software cutoff.
+    void updateAlertSchedule();
+    const AlertScheduler &getAlertScheduler() const { return m_alertScheduler; }
+    float getHardwareLowVoltageFloor_V() const { return lowVoltageCutoff - hysteresis; }
     void setLoadConnected(bool connected, DisconnectReason reason = MANUAL);
     bool isLoadConnected() const;
     void configureAlert(float amps);
     void setTempOvercurrentAlert(float amps);
     void restoreOvercurrentAlert();
-    void handleAlert();
-    void processAlert();
+    void handleAlert();                 // ALERT ISR: opens the gate, defers the rest
+    void processAlert();                // loop: records the trip, clears the INA226 flags
+    // Alert latency histograms: ISR entry to the gate GPIO write in CPU cycles,
+    // and ISR entry to processAlert() in microseconds (latency_histogram.h).
+    // Both start at ISR entry: the INA226 conversion, the ALERT edge to ISR
+    // dispatch and the gate driver's turn-off are not in them.
+    const LatencyHistogram &getIsrGateOffLatency() const { return m_isrGateOffLatency; }
+    const LatencyHistogram &getAlertHandledLatency() const { return m_alertHandledLatency; }
+    void resetAlertLatency();
     bool isAlertTriggered() const;
     void clearAlerts();
     void enterSleepMode();
@@ -72,18 +200,50 @@ public:
     // ---------- Table calibration (preferred) ----------
     // Save/load a piecewise calibration table for the given shunt
     bool saveCalibrationTable(uint16_t shuntRatedA, const std::vector<CalPoint> &points);
-    bool loadCalibrationTable(uint16_t shuntRatedA);                     // loads into RAM; returns true if found
-    const std::vector<CalPoint>& getCalibrationTable() const;
+    bool loadCalibrationTable(uint16_t shuntRatedA);                     // NVS table, else factory table; returns true if found
+    const CalPoint* getCalibrationTable(size_t &countOut) const;         // active table (RAM or flash)
     bool hasCalibrationTable() const;                                    // RAM presence
     bool hasStoredCalibrationTable(uint16_t shuntRatedA, size_t &countOut) const;
 
+    // ---------- Factory calibration (compiled into flash) ----------
+    static const FactoryCalTable* getFactoryCalibration(uint16_t shuntRatedA); // nullptr if none
+    static uint16_t getFactoryDefaultShunt();   // rating of the first factory table, 50 if none
+    bool isUsingFactoryCalibration() const;                              // active table points into flash
+    float getShuntResistance_Ohms() const;
+    uint16_t getActiveShuntA() const { return m_activeShuntA; }
+#ifdef UNIT_TEST
+    static void setFactoryCalTables(const FactoryCalTable *tables);     // nullptr restores the generated list
+    String calculateRunFlatTimeFormatted(float currentA, float warningThresholdHours, bool &warningTriggered);
+#endif
+
 private:
     INA226_WE ina226;
+    uint8_t m_i2cAddress;
     float defaultOhms;      // Original default shunt resistance
     float calibratedOhms;   // Calibrated shunt resistance
-    float batteryCapacity;
-    float maxBatteryCapacity;
-    unsigned long lastUpdateTime;
+    CoulombCounter m_coulomb;   // remaining capacity and charge totals (nAs)
+    SocJournal m_socJournal;
+    BatteryModel m_model;
+    OcvResync m_ocvResync;
+    ChargeDetector m_chargeDetector;
+    LifetimeStats m_stats;
+    RainflowCounter m_rainflow;
+    CapacityEstimator m_soh;
+#ifdef USE_SOC_EKF
+    SocEkf m_ekf;
+#endif
+    ResistanceEstimator m_resistance;
+    TimeToFull m_timeToFull;
+    LoadProfile m_loadProfile;
+    bool m_rtcRestored;
+    uint8_t m_rtcOcRetries;     // protection retry state carried over by restoreFromRtc()
+    bool m_rtcOcLockedOut;
+    bool m_protectionRestored;  // begin() has loaded the settings and restored the engine
+    float m_supplyDip_V;        // bus voltage below this triggers an immediate RTC save
+    float m_sleepCurrent_mA;
+    uint64_t m_lastSleep_us;    // timed sleep that ended this boot, 0 if none
+    uint32_t m_lastSleepCurrent_uA;
+    void deepSleep();
     float shuntVoltage_mV, loadVoltage_V, busVoltage_V, current_mA, power_mW;
     float calibrationGain, calibrationOffset_mA;
 
@@ -91,24 +251,57 @@ private:
     float lowVoltageCutoff;
     float hysteresis;
     float overcurrentThreshold;
+    bool m_irCompensation;
+    float m_tripTimeAt2x_s;
+    float m_instantMultiple;
+    float m_lvdDebounce_s;
+    uint8_t m_ocMaxRetries;
+    float m_ocCooldown_s;
+    float m_overvoltageCutoff_V;
+    float m_powerLimit_W;
+    ProtectionEngine m_protection;
+    AlertScheduler m_alertScheduler;
+    bool m_alertOverride;       // a temporary alert (calibration) owns the comparator
+    void applyAlertFunction(AlertScheduler::Function f);
+    int32_t m_rawCurrent_mA;    // last sample in the engine's raw units
+    int32_t m_bus_mV;
+    void refreshProtectionThresholds();
+    float shuntAlertLimit_V(float amps) const;
+    void warnIfInstantClamped() const;
+    float rawCurrentFor_mA(float true_mA) const;
     bool loadConnected;
     volatile bool alertTriggered;
+    volatile uint32_t m_isrGateOffCycles;  // written by the ISR, read by processAlert()
+    volatile uint32_t m_alertEntryUs;
+    volatile bool m_alertGatedLoad;
+    LatencyHistogram m_isrGateOffLatency;
+    LatencyHistogram m_alertHandledLatency;
     bool m_isConfigured;
     uint16_t m_activeShuntA;
     DisconnectReason m_disconnectReason;
     bool m_hardwareAlertsDisabled;
 
-    // Table-based calibration
+    // Table-based calibration. The active table is either calibrationTable (loaded
+    // from NVS) or a factory table in flash; m_calPoints/m_calCount point at whichever.
     std::vector<CalPoint> calibrationTable;
+    const CalPoint *m_calPoints;
+    size_t m_calCount;
+    bool m_factoryCalActive;
+    void useRamCalibrationTable();
+    void useFactoryCalibrationTable(const FactoryCalTable *table);
     float getCalibratedCurrent_mA(float raw_mA) const;
 
     // run-flat time averaging
-    const static int maxSamples = 10;
-    float runFlatSamples[maxSamples];
-    int sampleIndex;
-    int sampleCount;
-    unsigned long lastSampleTime;
-    int sampleIntervalSeconds;
-    String calculateRunFlatTimeFormatted(float currentA, float warningThresholdHours, bool &warningTriggered);
+    CurrentAverage m_runFlatAverage;
+    static const uint32_t runFlatWarmupMs = 10000;   // "Gathering data..." until the average covers this
+    static const uint16_t minProfileBins = LoadProfile::binsPerHour * 6;   // profile used once 6 h are learned
+    static const size_t runFlatTextSize = 40;   // struct_message::runFlatTime
+    void calculateRunFlatTimeFormatted(float currentA, float warningThresholdHours, bool &warningTriggered,
+                                       char *out, size_t outSize);
+    void formatRunFlatTime(float effectiveCurrentA, float warningThresholdHours, bool &warningTriggered,
+                           char *out, size_t outSize) const;
+    void formatRunHours(float runHours, bool charging, float warningThresholdHours, bool &warningTriggered,
+                        char *out, size_t outSize) const;
+    void applyLearnedCapacity();
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "latency_histogram.h"
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+    : m_count(0),
+      m_max(0),
+      m_last(0)
+{
+    memset(m_bins, 0, sizeof(m_bins));
+}
+
+void LatencyHistogram::add(uint32_t value) {
+    uint8_t k = 0;
+    for (uint32_t v = value >> 1; v != 0; v >>= 1) k++;
+    m_bins[k]++;
+    m_count++;
+    if (value > m_max) m_max = value;
+    m_last = value;
+}
+
+void LatencyHistogram::reset() {
+    memset(m_bins, 0, sizeof(m_bins));
+    m_count = 0;
+    m_max = 0;
+    m_last = 0;
+}
+
+uint32_t LatencyHistogram::quantileUpper(float p) const {
+    if (m_count == 0) return 0;
+    uint32_t target = (uint32_t)(p * (float)m_count + 0.5f);
+    if (target < 1) target = 1;
+    uint32_t seen = 0;
+    for (uint8_t k = 0; k < binCount; ++k) {
+        seen += m_bins[k];
+        if (seen >= target) return binUpper(k);
+    }
+    return binUpper(binCount - 1);
+}
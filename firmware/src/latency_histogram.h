@@ -0,0 +1,60 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+#ifdef UNIT_TEST
+#include <Arduino.h>
+#else
+#include <esp_idf_version.h>
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include <esp_cpu.h>
+#else
+#include <hal/cpu_hal.h>
+#endif
+#endif
+
+// Power-of-two latency histogram.
+//
+// Bin k counts values in [2^k, 2^(k+1)) (bin 0 also takes 0), so 32 counters
+// cover the whole uint32 range at a resolution of a factor of two, which is
+// what "microseconds or milliseconds" evidence needs. The unit is the
+// caller's: CPU cycles for the alert-to-gate-off path, microseconds for the
+// deferred loop handling. add() is not meant for ISRs; the ISR stores raw
+// timestamps and the histogram is filled when the alert is processed.
+class LatencyHistogram {
+public:
+    static const uint8_t binCount = 32;
+
+    LatencyHistogram();
+
+    void add(uint32_t value);
+    void reset();
+
+    uint32_t count() const { return m_count; }
+    uint32_t bin(uint8_t k) const { return k < binCount ? m_bins[k] : 0; }
+    uint32_t max() const { return m_max; }
+    uint32_t last() const { return m_last; }
+    static uint32_t binUpper(uint8_t k) { return k >= 31 ? 0xFFFFFFFFUL : (2UL << k) - 1; }
+    // Upper edge of the bin holding the p-quantile (0..1); 0 if empty
+    uint32_t quantileUpper(float p) const;
+
+private:
+    uint32_t m_bins[binCount];
+    uint32_t m_count;
+    uint32_t m_max;
+    uint32_t m_last;
+};
+
+// CPU cycle counter (160 MHz on the ESP32-C3), safe to read from an ISR
+static inline uint32_t cpuCycleCount() {
+#ifdef UNIT_TEST
+    return (uint32_t)(micros() * 160UL);
+#elif ESP_IDF_VERSION_MAJOR >= 5
+    return (uint32_t)esp_cpu_get_cycle_count();
+#else
+    return (uint32_t)cpu_hal_get_cycle_count();
+#endif
+}
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,171 @@
+#include "lifetime_stats.h"
+#include "soc_journal.h"
+#include "shared_defs.h"
+#include <Preferences.h>
+#include <stddef.h>
+#include <string.h>
+
+static const uint32_t recordVersion = 2;
+
+// Version 1: four trip slots, no reclose counters. Migrated on load.
+struct LifetimeStatsRecordV1 {
+    double chargeIn_Ah;
+    double chargeOut_Ah;
+    double energyIn_Wh;
+    double energyOut_Wh;
+    double cycles;
+    float deepestSoc;
+    float minVoltage_V;
+    float maxVoltage_V;
+    uint32_t secondsBelowLvd;
+    uint32_t trips[4];
+    uint32_t version;
+    uint32_t crc;
+};
+
+LifetimeStats::LifetimeStats()
+    : m_primed(false),
+      m_lastIn_nAs(0),
+      m_lastOut_nAs(0),
+      m_lastMs(0),
+      m_lvdCarryMs(0),
+      m_dirty(false),
+      m_lastWriteMs(0)
+{
+    clear();
+}
+
+void LifetimeStats::clear() {
+    memset(&m_rec, 0, sizeof(m_rec));
+    m_rec.deepestSoc = 1.0f;
+    m_rec.version = recordVersion;
+}
+
+bool LifetimeStats::load() {
+    Preferences prefs;
+    prefs.begin(NVS_LIFETIME_NAMESPACE, true);
+    LifetimeStatsRecord r;
+    bool ok = false;
+    bool migrated = false;
+    if (prefs.getBytesLength(NVS_KEY_LIFETIME_STATS) == sizeof(LifetimeStatsRecordV1)) {
+        LifetimeStatsRecordV1 v1;
+        ok = prefs.getBytes(NVS_KEY_LIFETIME_STATS, &v1, sizeof(v1)) == sizeof(v1) &&
+             v1.version == 1 &&
+             SocJournal::crc32(&v1, offsetof(LifetimeStatsRecordV1, crc)) == v1.crc;
+        if (ok) {
+            memset(&r, 0, sizeof(r));
+            r.chargeIn_Ah = v1.chargeIn_Ah;
+            r.chargeOut_Ah = v1.chargeOut_Ah;
+            r.energyIn_Wh = v1.energyIn_Wh;
+            r.energyOut_Wh = v1.energyOut_Wh;
+            r.cycles = v1.cycles;
+            r.deepestSoc = v1.deepestSoc;
+            r.minVoltage_V = v1.minVoltage_V;
+            r.maxVoltage_V = v1.maxVoltage_V;
+            r.secondsBelowLvd = v1.secondsBelowLvd;
+            memcpy(r.trips, v1.trips, sizeof(v1.trips));
+            r.version = recordVersion;
+            migrated = true;
+        }
+    } else {
+        ok = prefs.getBytes(NVS_KEY_LIFETIME_STATS, &r, sizeof(r)) == sizeof(r) &&
+             r.version == recordVersion &&
+             SocJournal::crc32(&r, offsetof(LifetimeStatsRecord, crc)) == r.crc;
+    }
+    prefs.end();
+    if (ok) {
+        m_rec = r;
+        m_dirty = migrated;     // rewritten in the new layout at the next checkpoint
+    } else {
+        clear();
+    }
+    return ok;
+}
+
+void LifetimeStats::addSample(const CoulombCounter &cc, float busVoltage_V, float lvdCutoff_V, uint32_t nowMs) {
+    // USB power: no battery to account for
+    if (busVoltage_V < 5.25f) {
+        m_primed = false;
+        return;
+    }
+
+    const uint64_t in = cc.chargeIn_nAs();
+    const uint64_t out = cc.chargeOut_nAs();
+    // First sample, or the counter totals were restored/reset under us: rebase
+    if (m_primed && in >= m_lastIn_nAs && out >= m_lastOut_nAs) {
+        const double dIn_Ah = (double)(in - m_lastIn_nAs) / (double)CoulombCounter::nAsPerAh;
+        const double dOut_Ah = (double)(out - m_lastOut_nAs) / (double)CoulombCounter::nAsPerAh;
+        m_rec.chargeIn_Ah += dIn_Ah;
+        m_rec.chargeOut_Ah += dOut_Ah;
+        m_rec.energyIn_Wh += dIn_Ah * busVoltage_V;
+        m_rec.energyOut_Wh += dOut_Ah * busVoltage_V;
+        if (cc.capacity_nAs() > 0) m_rec.cycles += dOut_Ah / (double)cc.capacity_Ah();
+        if (dIn_Ah > 0.0 || dOut_Ah > 0.0) m_dirty = true;
+
+        if (busVoltage_V < lvdCutoff_V) {
+            m_lvdCarryMs += nowMs - m_lastMs;
+            if (m_lvdCarryMs >= 1000) {
+                m_rec.secondsBelowLvd += m_lvdCarryMs / 1000;
+                m_lvdCarryMs %= 1000;
+                m_dirty = true;
+            }
+        }
+    }
+    m_primed = true;
+    m_lastIn_nAs = in;
+    m_lastOut_nAs = out;
+    m_lastMs = nowMs;
+
+    const float soc = cc.stateOfCharge();
+    if (soc < m_rec.deepestSoc) {
+        m_rec.deepestSoc = soc;
+        m_dirty = true;
+    }
+    if (m_rec.minVoltage_V == 0.0f || busVoltage_V < m_rec.minVoltage_V) {
+        m_rec.minVoltage_V = busVoltage_V;
+        m_dirty = true;
+    }
+    if (busVoltage_V > m_rec.maxVoltage_V) {
+        m_rec.maxVoltage_V = busVoltage_V;
+        m_dirty = true;
+    }
+}
+
+void LifetimeStats::recordTrip(uint8_t reason) {
+    if (reason >= tripSlots) return;
+    m_rec.trips[reason]++;
+    m_dirty = true;
+}
+
+void LifetimeStats::recordRetry() {
+    m_rec.ocRetries++;
+    m_dirty = true;
+}
+
+void LifetimeStats::recordLockout() {
+    m_rec.ocLockouts++;
+    m_dirty = true;
+}
+
+bool LifetimeStats::checkpoint(uint32_t nowMs, bool force) {
+    if (!m_dirty) return false;
+    if (!force && nowMs - m_lastWriteMs < checkpointInterval) return false;
+
+    m_rec.version = recordVersion;
+    m_rec.crc = SocJournal::crc32(&m_rec, offsetof(LifetimeStatsRecord, crc));
+    Preferences prefs;
+    prefs.begin(NVS_LIFETIME_NAMESPACE, false);
+    bool ok = prefs.putBytes(NVS_KEY_LIFETIME_STATS, &m_rec, sizeof(m_rec)) == sizeof(m_rec);
+    prefs.end();
+    if (ok) {
+        m_dirty = false;
+        m_lastWriteMs = nowMs;
+    }
+    return ok;
+}
+
+void LifetimeStats::reset(uint32_t nowMs) {
+    clear();
+    m_dirty = true;
+    checkpoint(nowMs, true);
+}
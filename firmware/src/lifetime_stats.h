@@ -0,0 +1,63 @@
+#ifndef LIFETIME_STATS_H
+#define LIFETIME_STATS_H
+
+#include <stdint.h>
+#include "coulomb_counter.h"
+
+// Lifetime battery history, like the history page of a battery monitor.
+//
+// Updated in RAM every sample from the coulomb counter's charge totals (so Ah
+// in/out agree with the counter to the last nAs) and the bus voltage. The
+// record is written to NVS as one CRC-checked blob, at most once per
+// checkpointInterval and only if something changed, so a brownout loses at most
+// that much history. Samples on USB power (no battery) are ignored.
+struct LifetimeStatsRecord {
+    double chargeIn_Ah;
+    double chargeOut_Ah;
+    double energyIn_Wh;
+    double energyOut_Wh;
+    double cycles;              // equivalent full cycles: Ah out / rated capacity
+    float deepestSoc;           // lowest SOC seen, 0..1
+    float minVoltage_V;         // 0 until the first battery sample
+    float maxVoltage_V;
+    uint32_t secondsBelowLvd;
+    uint32_t trips[5];          // disconnects, indexed by DisconnectReason
+    uint32_t ocRetries;         // automatic overcurrent recloses
+    uint32_t ocLockouts;        // retries exhausted, latched off
+    uint32_t version;
+    uint32_t crc;               // CRC-32 of all fields above
+};
+
+class LifetimeStats {
+public:
+    static const uint32_t checkpointInterval = 30UL * 60UL * 1000UL;
+    static const uint8_t tripSlots = 5;
+
+    LifetimeStats();
+
+    bool load();                // NVS record, else a fresh history; true if one was found
+    // Call every sample after the counter has been updated
+    void addSample(const CoulombCounter &cc, float busVoltage_V, float lvdCutoff_V, uint32_t nowMs);
+    void recordTrip(uint8_t reason);
+    void recordRetry();
+    void recordLockout();
+    // Write if changed and the interval has passed (or force). True if written.
+    bool checkpoint(uint32_t nowMs, bool force = false);
+    void reset(uint32_t nowMs); // clear history in RAM and NVS
+
+    const LifetimeStatsRecord &record() const { return m_rec; }
+
+private:
+    void clear();
+
+    LifetimeStatsRecord m_rec;
+    bool m_primed;
+    uint64_t m_lastIn_nAs;
+    uint64_t m_lastOut_nAs;
+    uint32_t m_lastMs;
+    uint32_t m_lvdCarryMs;
+    bool m_dirty;
+    uint32_t m_lastWriteMs;
+};
+
+#endif // LIFETIME_STATS_H
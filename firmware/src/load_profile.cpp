@@ -0,0 +1,126 @@
+#include "load_profile.h"
+#include "soc_journal.h"
+#include "shared_defs.h"
+#include <Preferences.h>
+#include <string.h>
+
+LoadProfile::LoadProfile()
+    : m_visitBin(-1),
+      m_visit_As(0.0f),
+      m_visitMs(0),
+      m_lastMs(0),
+      m_dirty(false),
+      m_lastWriteMs(0)
+{
+    memset(m_mean_A, 0, sizeof(m_mean_A));
+    memset(m_seen, 0, sizeof(m_seen));
+}
+
+void LoadProfile::addSample(float currentA, uint32_t localSecondOfDay, uint32_t nowMs) {
+    const int16_t bin = (int16_t)((localSecondOfDay % 86400UL) / binSeconds);
+    if (bin != m_visitBin) {
+        closeVisit();
+        m_visitBin = bin;
+        m_lastMs = nowMs;
+        return;
+    }
+    const uint32_t dt = nowMs - m_lastMs;
+    if (dt <= maxGapMs) {
+        m_visit_As += currentA * (float)dt / 1000.0f;
+        m_visitMs += dt;
+    }
+    m_lastMs = nowMs;
+}
+
+void LoadProfile::closeVisit() {
+    if (m_visitBin >= 0 && m_visitMs >= minVisitMs) {
+        const float visitA = m_visit_As * 1000.0f / (float)m_visitMs;
+        const uint16_t bin = (uint16_t)m_visitBin;
+        if (hasBin(bin)) {
+            m_mean_A[bin] += agingAlpha * (visitA - m_mean_A[bin]);
+        } else {
+            m_mean_A[bin] = visitA;
+            m_seen[bin / 32] |= 1UL << (bin % 32);
+        }
+        m_dirty = true;
+    }
+    m_visitBin = -1;
+    m_visit_As = 0.0f;
+    m_visitMs = 0;
+}
+
+uint16_t LoadProfile::binsSeen() const {
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < binCount; ++i) n += hasBin(i) ? 1 : 0;
+    return n;
+}
+
+float LoadProfile::hoursToEmpty(float remainingAh, float capacityAh, uint32_t localSecondOfDay,
+                                float unseenA) const {
+    const uint32_t horizon_s = (uint32_t)horizonHours * 3600UL;
+    uint16_t bin = (uint16_t)((localSecondOfDay % 86400UL) / binSeconds);
+    uint32_t duration_s = binSeconds - localSecondOfDay % binSeconds;   // rest of the present bin
+    uint32_t elapsed_s = 0;
+    float level = remainingAh;
+
+    while (elapsed_s < horizon_s) {
+        const float currentA = hasBin(bin) ? m_mean_A[bin] : unseenA;
+        const float drainAh = currentA * (float)duration_s / 3600.0f;
+        if (currentA > 0.0f && drainAh >= level) {
+            return ((float)elapsed_s + level / currentA * 3600.0f) / 3600.0f;
+        }
+        level -= drainAh;
+        if (level > capacityAh) level = capacityAh;
+        elapsed_s += duration_s;
+        duration_s = binSeconds;
+        bin = (uint16_t)((bin + 1) % binCount);
+    }
+    return (float)horizonHours + 1.0f;
+}
+
+bool LoadProfile::load() {
+    Preferences prefs;
+    prefs.begin(NVS_LOAD_PROFILE_NAMESPACE, true);
+    LoadProfileRecord r;
+    bool ok = prefs.getBytes(NVS_KEY_LOAD_PROFILE, &r, sizeof(r)) == sizeof(r) &&
+              SocJournal::crc32(&r, offsetof(LoadProfileRecord, crc)) == r.crc &&
+              r.binsPerHour == binsPerHour;
+    prefs.end();
+    if (!ok) return false;
+
+    memcpy(m_mean_A, r.mean_A, sizeof(m_mean_A));
+    memcpy(m_seen, r.seen, sizeof(m_seen));
+    return true;
+}
+
+bool LoadProfile::checkpoint(uint32_t nowMs, bool force) {
+    if (!m_dirty) return false;
+    if (!force && nowMs - m_lastWriteMs < checkpointInterval) return false;
+
+    LoadProfileRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.mean_A, m_mean_A, sizeof(r.mean_A));
+    memcpy(r.seen, m_seen, sizeof(r.seen));
+    r.binsPerHour = binsPerHour;
+    r.crc = SocJournal::crc32(&r, offsetof(LoadProfileRecord, crc));
+
+    Preferences prefs;
+    prefs.begin(NVS_LOAD_PROFILE_NAMESPACE, false);
+    bool ok = prefs.putBytes(NVS_KEY_LOAD_PROFILE, &r, sizeof(r)) == sizeof(r);
+    prefs.end();
+    if (ok) {
+        m_dirty = false;
+        m_lastWriteMs = nowMs;
+    }
+    return ok;
+}
+
+void LoadProfile::reset(uint32_t nowMs) {
+    memset(m_mean_A, 0, sizeof(m_mean_A));
+    memset(m_seen, 0, sizeof(m_seen));
+    m_visitBin = -1;
+    m_visit_As = 0.0f;
+    m_visitMs = 0;
+    m_dirty = true;
+    checkpoint(nowMs, true);
+}
@@ -0,0 +1,75 @@
+#ifndef LOAD_PROFILE_H
+#define LOAD_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef LOAD_PROFILE_BINS_PER_HOUR
+#define LOAD_PROFILE_BINS_PER_HOUR 4
+#endif
+
+// Time-of-day load profile for run-flat time.
+//
+// A camper's draw follows the day: fridge duty cycle, lights in the evening,
+// solar at noon. A short moving average extrapolates whatever is happening
+// right now over the whole night. Instead the day is split into binCount bins
+// (LOAD_PROFILE_BINS_PER_HOUR per hour, 15 min by default), each holding an
+// exponentially aged mean of the model-corrected current seen in it: a visit
+// to a bin is averaged over time while it lasts (O(1) per sample) and folded
+// into the bin's mean with weight agingAlpha when the bin changes, so the
+// profile follows the season over a few days.
+//
+// Run-flat time walks the bins forward from now, draining the remaining
+// charge with each bin's mean (negative means fill, clamped at capacity) and
+// using the present average for bins never seen. The walk is bounded by the
+// 7-day horizon of the display. The means are saved to NVS as one CRC-checked
+// blob of a few hundred bytes on the lifetime-statistics schedule.
+struct LoadProfileRecord {
+    float mean_A[24 * LOAD_PROFILE_BINS_PER_HOUR];
+    uint32_t seen[(24 * LOAD_PROFILE_BINS_PER_HOUR + 31) / 32];
+    uint16_t binsPerHour;
+    uint16_t reserved;
+    uint32_t crc;           // CRC-32 of all fields above
+};
+
+class LoadProfile {
+public:
+    static const uint16_t binsPerHour = LOAD_PROFILE_BINS_PER_HOUR;
+    static const uint16_t binCount = 24 * binsPerHour;
+    static const uint32_t binSeconds = 3600UL / binsPerHour;
+    static const uint32_t minVisitMs = 60UL * 1000UL;      // shorter visits are not folded in
+    static const uint32_t maxGapMs = 10UL * 1000UL;        // longer sample gaps are not integrated
+    static const uint16_t horizonHours = 24 * 7;
+    static const uint32_t checkpointInterval = 30UL * 60UL * 1000UL;
+    static constexpr float agingAlpha = 0.3f;
+
+    LoadProfile();
+
+    // Call every sample while the wall clock is set (current positive = discharge)
+    void addSample(float currentA, uint32_t localSecondOfDay, uint32_t nowMs);
+
+    bool hasBin(uint16_t bin) const { return bin < binCount && (m_seen[bin / 32] >> (bin % 32)) & 1U; }
+    float binMean_A(uint16_t bin) const { return bin < binCount ? m_mean_A[bin] : 0.0f; }
+    uint16_t binsSeen() const;
+
+    // Hours until remainingAh is used up; horizonHours + 1 if not within the horizon
+    float hoursToEmpty(float remainingAh, float capacityAh, uint32_t localSecondOfDay, float unseenA) const;
+
+    bool load();
+    bool checkpoint(uint32_t nowMs, bool force = false);
+    void reset(uint32_t nowMs);
+
+private:
+    void closeVisit();
+
+    float m_mean_A[binCount];
+    uint32_t m_seen[(binCount + 31) / 32];
+    int16_t m_visitBin;     // -1 = no visit open
+    float m_visit_As;
+    uint32_t m_visitMs;
+    uint32_t m_lastMs;
+    bool m_dirty;
+    uint32_t m_lastWriteMs;
+};
+
+#endif // LOAD_PROFILE_H
@@ -0,0 +1,154 @@
+#include "lvd_sleep.h"
+#include "soc_journal.h"
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef UNIT_TEST
+#include <Wire.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#endif
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR    // host builds: plain static memory
+#endif
+
+static const uint32_t lvdSleepMagic = 0x4C564453; // "LVDS"
+
+RTC_NOINIT_ATTR static LvdSleepRecord lvdRecord;
+
+static bool lvdRecordValid() {
+    return lvdRecord.magic == lvdSleepMagic &&
+           SocJournal::crc32(&lvdRecord, offsetof(LvdSleepRecord, crc)) == lvdRecord.crc;
+}
+
+static void sealLvdRecord() {
+    lvdRecord.magic = lvdSleepMagic;
+    lvdRecord.crc = SocJournal::crc32(&lvdRecord, offsetof(LvdSleepRecord, crc));
+}
+
+void LvdSleep::arm(uint8_t i2cAddress, uint32_t reconnect_mV) {
+    const uint32_t fullBoot = lvdRecordValid() ? lvdRecord.fullBoot_us : 0;
+    memset(&lvdRecord, 0, sizeof(lvdRecord));
+    lvdRecord.fullBoot_us = fullBoot;
+    lvdRecord.reconnect_mV = reconnect_mV;
+    lvdRecord.i2cAddress = i2cAddress;
+    lvdRecord.armed = 1;
+    sealLvdRecord();
+}
+
+void LvdSleep::disarm() {
+    if (!lvdRecordValid()) return;
+    lvdRecord.armed = 0;        // the episode's totals stay for the status menu
+    sealLvdRecord();
+}
+
+bool LvdSleep::armed() {
+    return lvdRecordValid() && lvdRecord.armed;
+}
+
+uint32_t LvdSleep::reconnect_mV() {
+    return lvdRecordValid() ? lvdRecord.reconnect_mV : 0;
+}
+
+void LvdSleep::recordWake(uint32_t awake_us, uint32_t bus_mV) {
+    if (!lvdRecordValid()) return;
+    lvdRecord.wakes++;
+    lvdRecord.lastAwake_us = awake_us;
+    lvdRecord.lastBus_mV = bus_mV;
+    lvdRecord.awakeTotal_us += awake_us;
+    // us * uA * mV = 1e-15 J
+    lvdRecord.energyTotal_uJ += (uint64_t)awake_us * awakeCurrent_uA / 1000ULL * bus_mV / 1000000ULL;
+    sealLvdRecord();
+}
+
+void LvdSleep::recordFullBoot(uint32_t setup_us) {
+    if (!lvdRecordValid()) {
+        memset(&lvdRecord, 0, sizeof(lvdRecord));
+    }
+    lvdRecord.fullBoot_us = setup_us;
+    sealLvdRecord();
+}
+
+bool LvdSleep::stats(LvdSleepRecord &out) {
+    if (!lvdRecordValid()) return false;
+    out = lvdRecord;
+    return true;
+}
+
+#ifdef UNIT_TEST
+static uint32_t hostBus_mV = 0;
+static bool hostPresent = true;
+
+void LvdSleep::setHostBus_mV(uint32_t bus_mV, bool present) {
+    hostBus_mV = bus_mV;
+    hostPresent = present;
+}
+
+void LvdSleep::clear() {
+    memset(&lvdRecord, 0, sizeof(lvdRecord));
+}
+
+bool LvdSleep::timerWake() { return true; }
+uint64_t LvdSleep::uptime_us() { return micros(); }
+
+bool LvdSleep::readBus_mV(int sdaPin, int sclPin, uint32_t &bus_mV) {
+    (void)sdaPin;
+    (void)sclPin;
+    bus_mV = hostBus_mV;
+    return hostPresent;
+}
+#else
+// INA226 registers (datasheet section 7.6)
+static const uint8_t regConfig = 0x00;
+static const uint8_t regBus = 0x02;
+static const uint8_t regMaskEnable = 0x06;
+static const uint16_t configBusTriggered = 0x4122;  // 1 sample, 1.1 ms conversions, bus triggered
+static const uint16_t configPowerDown = 0x4120;
+static const uint16_t conversionReady = 0x0008;     // CVRF
+
+static bool writeRegister(uint8_t address, uint8_t reg, uint16_t value) {
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    Wire.write((uint8_t)(value >> 8));
+    Wire.write((uint8_t)(value & 0xFF));
+    return Wire.endTransmission() == 0;
+}
+
+static bool readRegister(uint8_t address, uint8_t reg, uint16_t &value) {
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0) return false;
+    if (Wire.requestFrom(address, (uint8_t)2) != 2) return false;
+    value = (uint16_t)(Wire.read() << 8);
+    value |= (uint16_t)Wire.read();
+    return true;
+}
+
+bool LvdSleep::timerWake() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+uint64_t LvdSleep::uptime_us() {
+    return (uint64_t)esp_timer_get_time();
+}
+
+bool LvdSleep::readBus_mV(int sdaPin, int sclPin, uint32_t &bus_mV) {
+    const uint8_t address = lvdRecord.i2cAddress;
+    Wire.begin(sdaPin, sclPin);
+    if (!writeRegister(address, regConfig, configBusTriggered)) return false;
+
+    uint16_t flags = 0;
+    bool ready = false;
+    for (uint8_t i = 0; i < 25 && !ready; ++i) {    // 1.1 ms expected, give up after 5 ms
+        delayMicroseconds(200);
+        ready = readRegister(address, regMaskEnable, flags) && (flags & conversionReady);
+    }
+    uint16_t raw = 0;
+    const bool ok = ready && readRegister(address, regBus, raw);
+    writeRegister(address, regConfig, configPowerDown);
+    bus_mV = (uint32_t)raw * 5 / 4;                 // 1.25 mV LSB
+    return ok;
+}
+#endif
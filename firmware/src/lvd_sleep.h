@@ -0,0 +1,68 @@
+#ifndef LVD_SLEEP_H
+#define LVD_SLEEP_H
+
+#include <stdint.h>
+
+// Fast wake from the low-voltage sleep.
+//
+// After a low-voltage trip the unit deep-sleeps and wakes on a timer to see
+// whether the battery has recovered. Running the whole setup() for that (serial
+// delay, INA226 init, NVS reads, radio bring-up) costs far more energy than the
+// sleep saves. Instead the reconnect voltage and the sensor address go into RTC
+// memory at the trip, and after a timer wake setup() first takes one triggered
+// bus-voltage conversion over raw I2C (about 1 ms) with the INA226 powered
+// down again afterwards. Still below the reconnect voltage: straight back to
+// sleep. Recovered, or any other kind of reset: the record is disarmed and the
+// normal boot runs.
+//
+// Each fast wake is timed from app start (esp_timer) to sleeping again. ROM and
+// bootloader time before app start is not included: the sleep clock's error
+// over the interval is larger than it, so it stays inside the measured sleep
+// length, charged at the sleep current. The energy is an estimate: that time
+// at the assumed awakeCurrent_uA and the measured bus voltage. Totals are kept
+// per low-voltage episode, beside the length of the last full setup() for
+// comparison.
+struct LvdSleepRecord {
+    uint64_t awakeTotal_us;
+    uint64_t energyTotal_uJ;    // estimate, at awakeCurrent_uA
+    uint32_t wakes;
+    uint32_t lastAwake_us;
+    uint32_t lastBus_mV;
+    uint32_t fullBoot_us;       // last full setup()
+    uint32_t reconnect_mV;
+    uint8_t armed;
+    uint8_t i2cAddress;
+    uint16_t reserved;
+    uint32_t magic;
+    uint32_t crc;               // CRC-32 of all fields above
+};
+
+class LvdSleep {
+public:
+    static const uint64_t interval_us = 10ULL * 1000000ULL;
+    static const uint32_t awakeCurrent_uA = 25000;     // assumed: ESP32-C3 at 160 MHz, radio off
+
+    // At a low-voltage trip, before sleeping: starts a new episode
+    static void arm(uint8_t i2cAddress, uint32_t reconnect_mV);
+    static void disarm();
+    static bool armed();
+    static uint32_t reconnect_mV();
+    // Woken by the sleep timer (not a reset or power-on)
+    static bool timerWake();
+
+    // One triggered bus conversion, then the INA226 is powered down. False if
+    // the chip did not answer.
+    static bool readBus_mV(int sdaPin, int sclPin, uint32_t &bus_mV);
+    static uint64_t uptime_us();        // since this boot's app start
+    static void recordWake(uint32_t awake_us, uint32_t bus_mV);
+    static void recordFullBoot(uint32_t setup_us);
+    // False if the RTC domain lost power since the record was written
+    static bool stats(LvdSleepRecord &out);
+
+#ifdef UNIT_TEST
+    static void setHostBus_mV(uint32_t bus_mV, bool present = true);
+    static void clear();
+#endif
+};
+
+#endif // LVD_SLEEP_H
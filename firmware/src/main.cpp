@@ -5,9 +5,12 @@
 #include "ina226_adc.h"
 #include "ble_handler.h"
 #include "espnow_handler.h"
+#include "cal_jig.h"
+#include "cal_math.h"
 #include "passwords.h"
 #include <esp_now.h>
 #include <esp_err.h>
+#include <esp_system.h>
 
 // WiFi and OTA
 #include <WiFi.h>
@@ -21,7 +24,7 @@
 #define USE_ADC // if defined, use ADC, else, victron BLE
 // #define USE_WIFI // if defined, conect to WIFI, else, don't
 
-float batteryCapacity = 100.0f; // Default rated battery capacity in Ah (used for SOC calc)
+float batteryCapacity = 100.0f; // Default rated battery capacity in Ah
 
 uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
@@ -33,6 +36,10 @@ unsigned long last_ota_check = 0;
 const unsigned long loop_interval = 10000;
 unsigned long last_loop_millis = 0;
 
+// Coulomb counting runs on every sample; loop_interval only paces reporting
+const unsigned long sample_interval = 250;
+unsigned long last_sample_millis = 0;
+
 // LED Heartbeat
 unsigned long last_led_blink = 0;
 const unsigned long led_blink_interval = 500; // ms
@@ -40,7 +47,7 @@ const unsigned long led_blink_interval = 500; // ms
 struct_message_ae_smart_shunt_1 ae_smart_shunt_struct;
 // Initializing with a default shunt resistor value, which will be overwritten
 // if a calibrated value is loaded from NVS.
-INA226_ADC ina226_adc(I2C_ADDRESS, 0.000944464f, 100.00f);
+INA226_ADC ina226_adc(I2C_ADDRESS, 0.000944464f, batteryCapacity);
 ESPNowHandler espNowHandler(broadcastAddress); // ESP-NOW handler for sending data
 WiFiClientSecure wifi_client;
 
@@ -62,12 +69,9 @@ bool handleOTA()
   // 2. Perform the update (if there is one)
   {
     Serial.println("Update available, saving battery capacity...");
-    Preferences preferences;
-    preferences.begin("storage", false);
-    float capacity = ina226_adc.getBatteryCapacity();
-    preferences.putFloat("bat_cap", capacity);
-    preferences.end();
-    Serial.printf("Saved battery capacity: %f\n", capacity);
+    ina226_adc.journalStateOfCharge(true);
+    ina226_adc.checkpointLifetimeStats(true);
+    Serial.printf("Saved battery capacity: %f\n", ina226_adc.getBatteryCapacity());
 
     if (OTA::performUpdate(&details) == OTA::SUCCESS)
     {
@@ -521,27 +525,23 @@ void runShuntResistanceCalibration(INA226_ADC &ina)
   }
 
   // Calculate the shunt resistance using Ohm's Law (R = V/I) for each data point
-  // Then, average the results for a more stable value.
-  float sumOhms = 0.0f;
-  size_t valid_measurements = 0;
   for (size_t i = 0; i < current_loads.size(); ++i)
   {
     if (current_loads[i] > 0)
-    { // Avoid division by zero
+    {
       // Convert mV to V for resistance calculation
       float voltage_V = measured_voltages[i] / 1000.0f;
-      float resistance_Ohms = voltage_V / current_loads[i];
-      sumOhms += resistance_Ohms;
-      valid_measurements++;
       Serial.printf("Calculation %u: %.3f V / %.2f A = %.9f Ohms\n",
-                    (unsigned)(i + 1), voltage_V, current_loads[i], resistance_Ohms);
+                    (unsigned)(i + 1), voltage_V, current_loads[i], voltage_V / current_loads[i]);
     }
   }
 
+  // Then, average the results for a more stable value.
+  size_t valid_measurements = 0;
+  float newShuntOhms = averageShuntOhms(current_loads.data(), measured_voltages.data(),
+                                        current_loads.size(), valid_measurements);
   if (valid_measurements > 0)
   {
-    float newShuntOhms = sumOhms / valid_measurements;
-
     // Save the new resistance
     ina.saveShuntResistance(newShuntOhms);
     Serial.printf("\nCalculated new average shunt resistance: %.9f Ohms.\n", newShuntOhms);
@@ -562,6 +562,23 @@ void runShuntResistanceCalibration(INA226_ADC &ina)
   }
 }
 
+// Prompt for one setting value; false if the entry is out of range
+static bool readModelValue(const char *prompt, float current, float minV, float maxV, float &out)
+{
+  Serial.printf("%s [default: %.3f]: ", prompt, current);
+  String input = SerialReadLineBlocking();
+  if (input.length() == 0) {
+    out = current;
+    return true;
+  }
+  out = input.toFloat();
+  if (out < minV || out > maxV) {
+    Serial.printf("Invalid value. Please enter a value between %.2f and %.2f.\n", minV, maxV);
+    return false;
+  }
+  return true;
+}
+
 void runProtectionConfigMenu(INA226_ADC &ina)
 {
   Serial.println(F("\n--- Protection Settings ---"));
@@ -619,11 +636,176 @@ void runProtectionConfigMenu(INA226_ADC &ina)
     new_oc_thresh = current_oc_thresh;
   }
 
+  // --- IR compensation ---
+  bool new_ir_comp = ina.isIrCompensationEnabled();
+  Serial.printf("Compensate Low Voltage Cutoff for internal resistance (y/n) [default: %s]: ",
+                new_ir_comp ? "y" : "n");
+  input = SerialReadLineBlocking();
+  if (input.equalsIgnoreCase("y")) {
+    new_ir_comp = true;
+  } else if (input.equalsIgnoreCase("n")) {
+    new_ir_comp = false;
+  } else if (input.length() > 0) {
+    Serial.println(F("Invalid value. Please enter y or n."));
+    return;
+  }
+
+  // --- Trip curve and debounce ---
+  float new_t2x, new_instant, new_debounce, new_ov, new_power, new_retries, new_cooldown, new_sleep;
+  if (!readModelValue("Enter overcurrent trip time at 2x threshold (s)", ina.getTripTimeAt2x_s(), 0.1f, 600.0f, new_t2x) ||
+      !readModelValue("Enter instant trip level (x threshold)", ina.getInstantMultiple(), 1.5f, 10.0f, new_instant) ||
+      !readModelValue("Enter low voltage debounce (s)", ina.getLowVoltageDebounce_s(), 0.0f, 60.0f, new_debounce) ||
+      !readModelValue("Enter overcurrent retries (0 = latch)", ina.getOvercurrentMaxRetries(), 0.0f, 10.0f, new_retries) ||
+      !readModelValue("Enter first retry delay (s, doubles per retry)", ina.getOvercurrentCooldown_s(), 1.0f, 3600.0f, new_cooldown) ||
+      !readModelValue("Enter overvoltage cutoff (V, 0 = off)", ina.getOvervoltageCutoff_V(), 0.0f, 20.0f, new_ov) ||
+      !readModelValue("Enter discharge power limit (W, 0 = off)", ina.getPowerLimit_W(), 0.0f, 5000.0f, new_power) ||
+      !readModelValue("Enter current drawn in low-voltage sleep (mA)", ina.getSleepCurrent_mA(), 0.0f, 100.0f, new_sleep))
+  {
+    return;
+  }
+  if (new_ov != 0.0f && new_ov <= new_lv_cutoff + new_hysteresis) {
+    Serial.println(F("Invalid value. The overvoltage cutoff must be above the reconnect voltage."));
+    return;
+  }
+
   // --- Save Settings ---
   ina.setProtectionSettings(new_lv_cutoff, new_hysteresis, new_oc_thresh);
+  ina.setIrCompensation(new_ir_comp);
+  ina.setOvercurrentCurve(new_t2x, new_instant);
+  ina.setLowVoltageDebounce_s(new_debounce);
+  ina.setOvercurrentRetries((uint8_t)lroundf(new_retries), new_cooldown);
+  ina.setOvervoltageCutoff_V(new_ov);
+  ina.setPowerLimit_W(new_power);
+  ina.setSleepCurrent_mA(new_sleep);
   Serial.println(F("Protection settings updated."));
 }
 
+void runBatteryModelMenu(INA226_ADC &ina)
+{
+  Serial.println(F("\n--- Battery Model ---"));
+  Serial.printf("Compiled chemistry preset: %s\n", DefaultChemistry::name());
+
+  BatteryModelParams p = ina.getBatteryModelParams();
+  if (!readModelValue("Enter Peukert exponent", p.peukertExponent, 1.0f, 1.6f, p.peukertExponent) ||
+      !readModelValue("Enter charge efficiency (0..1)", p.chargeEfficiency, 0.5f, 1.0f, p.chargeEfficiency) ||
+      !readModelValue("Enter rated discharge time (hours)", p.ratedHours, 1.0f, 100.0f, p.ratedHours))
+  {
+    return;
+  }
+
+  if (ina.setBatteryModelParams(p)) {
+    Serial.println(F("Battery model updated."));
+  } else {
+    Serial.println(F("Battery model rejected."));
+  }
+
+  float tau = ina.getRunFlatTimeConstant_s();
+  if (!readModelValue("Enter run-flat averaging time constant (s)", tau,
+                      CurrentAverage::minTimeConstant_s, CurrentAverage::maxTimeConstant_s, tau))
+  {
+    return;
+  }
+  ina.setRunFlatTimeConstant_s(tau);
+
+  const ChargeDetector &det = ina.getChargeDetector();
+  Serial.printf("Full charges detected: %lu\n", (unsigned long)det.fullChargeCount());
+  ChargeDetectorParams c = det.params();
+  float dwell = (float)c.dwellSeconds;
+  if (!readModelValue("Enter charged voltage (V)", c.chargedVoltage, 6.0f, 20.0f, c.chargedVoltage) ||
+      !readModelValue("Enter tail current (% of capacity)", c.tailPercent, 0.5f, 20.0f, c.tailPercent) ||
+      !readModelValue("Enter charged detection time (s)", dwell, 10.0f, 3600.0f, dwell))
+  {
+    return;
+  }
+  c.dwellSeconds = (uint32_t)lroundf(dwell);
+
+  if (ina.setChargeDetectorParams(c)) {
+    Serial.println(F("Charge detection updated."));
+  } else {
+    Serial.println(F("Charge detection rejected."));
+  }
+}
+
+void runLifetimeStatsMenu(INA226_ADC &ina)
+{
+  static const char *const reasonNames[LifetimeStats::tripSlots] = {"None", "Low voltage", "Overcurrent", "Manual", "Overvoltage"};
+  const LifetimeStatsRecord &h = ina.getLifetimeStats();
+
+  Serial.println(F("\n--- Lifetime History ---"));
+  Serial.printf("Charged              : %.2f Ah / %.1f Wh\n", h.chargeIn_Ah, h.energyIn_Wh);
+  Serial.printf("Discharged           : %.2f Ah / %.1f Wh\n", h.chargeOut_Ah, h.energyOut_Wh);
+  Serial.printf("Full cycles          : %.2f\n", h.cycles);
+  Serial.printf("Deepest discharge    : %.1f %%\n", (1.0f - h.deepestSoc) * 100.0f);
+  Serial.printf("Time below LVD       : %lu s\n", (unsigned long)h.secondsBelowLvd);
+  Serial.printf("Min / max voltage    : %.2f V / %.2f V\n", h.minVoltage_V, h.maxVoltage_V);
+  for (uint8_t i = LOW_VOLTAGE; i < LifetimeStats::tripSlots; ++i) {
+    if (i == MANUAL) continue; // manual switch-offs are not trips
+    Serial.printf("%-12s trips    : %lu\n", reasonNames[i], (unsigned long)h.trips[i]);
+  }
+  Serial.printf("OC retries / lockouts: %lu / %lu\n", (unsigned long)h.ocRetries, (unsigned long)h.ocLockouts);
+  Serial.printf("Full charges         : %lu\n", (unsigned long)ina.getChargeDetector().fullChargeCount());
+  const CapacityEstimator &soh = ina.getCapacityEstimator();
+  Serial.printf("Capacity             : %.1f Ah of %.1f Ah rated (SOH %.1f %%, %lu measurements)\n",
+                soh.capacity_Ah(), soh.rated_Ah(), soh.stateOfHealth() * 100.0f,
+                (unsigned long)soh.estimateCount());
+  const RainflowCounter &rf = ina.getRainflow();
+  Serial.println(F("Cycle depth histogram (rainflow):"));
+  for (uint8_t i = 0; i < RainflowCounter::binCount; ++i) {
+    if (rf.cycles(i) > 0.0f) {
+      Serial.printf("  %3u-%3u %% DoD      : %.1f\n", (unsigned)(i * 100 / RainflowCounter::binCount),
+                    (unsigned)((i + 1) * 100 / RainflowCounter::binCount), rf.cycles(i));
+    }
+  }
+  Serial.printf("Rainflow full cycles : %.2f\n", rf.equivalentFullCycles());
+  Serial.printf("Cycle life used      : %.2f %% (%s)\n",
+                rf.damage(DefaultChemistry::cyclesAt100Dod, DefaultChemistry::wohlerExponent) * 100.0f,
+                DefaultChemistry::name());
+  Serial.println(F("------------------------"));
+
+  Serial.println(F("Type RESET to clear the history, or Enter to leave."));
+  String confirm = SerialReadLineBlocking();
+  if (confirm == "RESET") {
+    ina.resetLifetimeStats();
+    Serial.println(F("Lifetime history cleared."));
+  }
+}
+
+void runClockMenu(INA226_ADC &ina)
+{
+  Serial.println(F("\n--- Clock & Load Profile ---"));
+  if (WallClock::isSet()) {
+    const uint32_t sod = WallClock::localSecondOfDay();
+    Serial.printf("Local time           : %02lu:%02lu (UTC%+ld min)\n", (unsigned long)(sod / 3600),
+                  (unsigned long)(sod / 60 % 60), (long)WallClock::utcOffsetMinutes());
+  } else {
+    Serial.println(F("Local time           : not set"));
+  }
+  Serial.printf("Load profile         : %u of %u bins learned\n",
+                ina.getLoadProfile().binsSeen(), LoadProfile::binCount);
+
+  Serial.println(F("Enter Unix time (date +%s on the host), Enter to keep, or RESET to clear the profile:"));
+  String line = SerialReadLineBlocking();
+  line.trim();
+  if (line == "RESET") {
+    ina.resetLoadProfile();
+    Serial.println(F("Load profile cleared."));
+    return;
+  }
+  if (line.length() == 0) return;
+  const uint32_t epoch = strtoul(line.c_str(), nullptr, 10);
+
+  Serial.printf("Enter UTC offset in minutes [%ld]:\n", (long)WallClock::utcOffsetMinutes());
+  String offsetLine = SerialReadLineBlocking();
+  offsetLine.trim();
+  const int32_t offset = offsetLine.length() ? (int32_t)offsetLine.toInt() : WallClock::utcOffsetMinutes();
+
+  if (WallClock::set(epoch, offset)) {
+    Serial.println(F("Clock set."));
+  } else {
+    Serial.println(F("Invalid time or offset. Clock unchanged."));
+  }
+}
+
 void runExportCalibrationMenu(INA226_ADC &ina) {
     Serial.println(F("\n--- Export Calibration Data ---"));
     Serial.println(F("Choose shunt rating to export (50-500 A):"));
@@ -646,32 +828,142 @@ void runExportCalibrationMenu(INA226_ADC &ina) {
         return;
     }
 
-    const std::vector<CalPoint>& table = ina.getCalibrationTable();
-    if (table.empty()) {
+    size_t count = 0;
+    const CalPoint *table = ina.getCalibrationTable(count);
+    if (count == 0) {
         Serial.printf("Calibration table for %dA shunt is empty. Nothing to export.\n", shuntA);
         return;
     }
 
+    // Save this block under firmware/factory_cal/ to compile it in as a factory table
     Serial.println(F("\n--- Copy the following C++ code ---"));
+    Serial.printf("// shunt_ohms = %.9f\n", ina.getShuntResistance_Ohms());
     Serial.printf("std::vector<CalPoint> preCalibratedPoints_%d = {\n", shuntA);
-    for (const auto& point : table) {
-        Serial.printf("    {%.6f, %.6f},\n", point.raw_mA, point.true_mA);
+    for (size_t i = 0; i < count; ++i) {
+        Serial.printf("    {%.6f, %.6f},\n", table[i].raw_mA, table[i].true_mA);
     }
     Serial.println("};");
     Serial.println(F("--- End of C++ code ---"));
 }
 
 
+// Connects the jig automation protocol (cal_jig.h) to the real hardware
+class InaCalJigTarget : public CalJigTarget
+{
+public:
+  explicit InaCalJigTarget(INA226_ADC &ina) : ina(ina) {}
+
+  void readSample(float &raw_mA, float &cal_mA, float &shunt_mV, float &bus_V) override
+  {
+    ina.readSensors();
+    raw_mA = ina.getRawCurrent_mA();
+    cal_mA = ina.getCurrent_mA();
+    shunt_mV = ina.getShuntVoltage_mV();
+    bus_V = ina.getBusVoltage_V();
+  }
+  unsigned long nowMs() override { return millis(); }
+  void delayMs(unsigned long ms) override { delay(ms); }
+  bool selectShunt(uint16_t shuntRatedA) override
+  {
+    Preferences prefs;
+    prefs.begin(NVS_CAL_NAMESPACE, false);
+    prefs.putUShort(NVS_KEY_ACTIVE_SHUNT, shuntRatedA);
+    prefs.end();
+    return true;
+  }
+  bool commitTable(uint16_t shuntRatedA, const std::vector<CalPoint> &points) override
+  {
+    ina.clearCalibrationTable(shuntRatedA);
+    return ina.saveCalibrationTable(shuntRatedA, points);
+  }
+  bool commitShuntOhms(float ohms) override { return ina.saveShuntResistance(ohms); }
+  void setLoadConnected(bool connected) override { ina.setLoadConnected(connected, connected ? NONE : MANUAL); }
+  void armAlert(float amps) override { ina.setTempOvercurrentAlert(amps); }
+  bool pollAlertFired() override
+  {
+    if (!ina.isAlertTriggered())
+      return false;
+    ina.processAlert();
+    return true;
+  }
+  void restoreAlert() override { ina.restoreOvercurrentAlert(); }
+  void writeLine(const char *line) override { Serial.println(line); }
+
+private:
+  INA226_ADC &ina;
+};
+
+InaCalJigTarget calJigTarget(ina226_adc);
+CalJig calJig(calJigTarget);
+
 void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
   Serial.print("Last Packet Send Status: ");
   Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Success" : "Fail");
 }
 
+// Print the calibration stored in NVS for every shunt rating (20 NVS lookups)
+static void printStoredCalibrationSummary()
+{
+  Serial.println("Calibration summary:");
+  for (int sh = 50; sh <= 500; sh += 50)
+  {
+    float g, o;
+    size_t cnt = 0;
+    bool hasTbl = ina226_adc.hasStoredCalibrationTable(sh, cnt);
+    bool hasLin = ina226_adc.getStoredCalibrationForShunt(sh, g, o);
+    if (hasTbl)
+    {
+      Serial.printf("  %dA: TABLE present (%u pts)", sh, (unsigned)cnt);
+      if (hasLin)
+        Serial.printf(", linear fallback gain=%.6f offset_mA=%.3f", g, o);
+      Serial.println();
+    }
+    else if (hasLin)
+    {
+      Serial.printf("  %dA: LINEAR gain=%.6f offset_mA=%.3f\n", sh, g, o);
+    }
+    else
+    {
+      Serial.printf("  %dA: No saved calibration (using defaults)\n", sh);
+    }
+  }
+}
+
+// Runs on esp_restart() (OTA, panics excluded): keep the last seconds of accounting
+static void saveStateOnShutdown()
+{
+  ina226_adc.saveRtcSnapshot();
+}
+
 void setup()
 {
   Serial.begin(115200);
+
+  // Charge accounting first, before anything touches NVS (the OTA check below
+  // saves the journal): RTC memory survives brownouts and soft resets, the NVS
+  // journal is the fallback after a cold power-on.
+  const bool rtcRestored = ina226_adc.restoreFromRtc();
+  // Still in a low-voltage sleep: one bus reading, and back to sleep before the
+  // serial delay, NVS or the radio cost anything
+  ina226_adc.lowVoltageFastWake(INA_SDA_PIN, INA_SCL_PIN);
+
   delay(100); // let Serial start
+  if (esp_reset_reason() == ESP_RST_BROWNOUT)
+  {
+    Serial.println("Reset cause: brownout");
+  }
+  if (!rtcRestored)
+  {
+    ina226_adc.restoreStateOfCharge();
+  }
+  LvdSleepRecord lvd;
+  if (LvdSleep::stats(lvd) && lvd.wakes > 0 && !lvd.armed)
+  {
+    Serial.printf("Low-voltage sleep ended: %lu fast wakes, %.1f ms each, about %.1f mJ in total (estimated)\n",
+                  (unsigned long)lvd.wakes, lvd.awakeTotal_us / 1000.0f / lvd.wakes, lvd.energyTotal_uJ / 1000.0f);
+  }
+  esp_register_shutdown_handler(saveStateOnShutdown);
 
   pinMode(LED_PIN, OUTPUT);
 
@@ -693,7 +985,7 @@ void setup()
 #endif
 
   // The begin method now handles loading the calibrated resistance
-  ina226_adc.begin(6, 10);
+  ina226_adc.begin(INA_SDA_PIN, INA_SCL_PIN);
 
   // Clear any startup alerts before attaching the interrupt
   ina226_adc.clearAlerts();
@@ -707,7 +999,8 @@ void setup()
     ina226_adc.setLoadConnected(false, MANUAL);
   }
 
-  // Check for and restore battery capacity from NVS
+  // Firmware older than the SOC journal saved capacity here before an OTA update.
+  // The journal was restored above; a leftover key is newer, so migrate it.
   Preferences preferences;
   preferences.begin("storage", true); // read-only
   if (preferences.isKey("bat_cap"))
@@ -716,6 +1009,7 @@ void setup()
     preferences.end(); // close read-only
 
     ina226_adc.setBatteryCapacity(restored_capacity);
+    ina226_adc.journalStateOfCharge(true);
     Serial.printf("Restored battery capacity: %f\n", restored_capacity);
 
     // Now clear the key
@@ -729,29 +1023,18 @@ void setup()
     preferences.end();
   }
 
-  // Print calibration summary on boot
-  Serial.println("Calibration summary:");
-  for (int sh = 50; sh <= 500; sh += 50)
+  // Print calibration summary on boot. Units running from a factory table have
+  // nothing in NVS yet, so skip probing every shunt rating.
+  if (ina226_adc.isUsingFactoryCalibration())
   {
-    float g, o;
     size_t cnt = 0;
-    bool hasTbl = ina226_adc.hasStoredCalibrationTable(sh, cnt);
-    bool hasLin = ina226_adc.getStoredCalibrationForShunt(sh, g, o);
-    if (hasTbl)
-    {
-      Serial.printf("  %dA: TABLE present (%u pts)", sh, (unsigned)cnt);
-      if (hasLin)
-        Serial.printf(", linear fallback gain=%.6f offset_mA=%.3f", g, o);
-      Serial.println();
-    }
-    else if (hasLin)
-    {
-      Serial.printf("  %dA: LINEAR gain=%.6f offset_mA=%.3f\n", sh, g, o);
-    }
-    else
-    {
-      Serial.printf("  %dA: No saved calibration (using defaults)\n", sh);
-    }
+    ina226_adc.getCalibrationTable(cnt);
+    Serial.printf("Calibration summary: using FACTORY table (%u pts), shunt %.9f Ohms\n",
+                  (unsigned)cnt, ina226_adc.getShuntResistance_Ohms());
+  }
+  else
+  {
+    printStoredCalibrationSummary();
   }
   // Also print currently applied linear calibration (table is runtime-based)
   float curG, curO;
@@ -782,6 +1065,7 @@ void setup()
   bleHandler.startScan(scanTime);
 #endif
 
+  LvdSleep::recordFullBoot((uint32_t)LvdSleep::uptime_us());
   Serial.println("Setup done");
 }
 
@@ -804,7 +1088,18 @@ void loop()
   {
     String s = Serial.readStringUntil('\n');
     s.trim();
-    if (s.equalsIgnoreCase("c"))
+    if (calJig.isActive())
+    {
+      // Jig mode: every line is a machine command with a framed reply
+      calJig.handleLine(s.c_str());
+    }
+    else if (s.equalsIgnoreCase("j"))
+    {
+      // enter unattended calibration jig mode (leave with JIG:EXIT)
+      calJig.begin();
+      Serial.println("JIG MODE");
+    }
+    else if (s.equalsIgnoreCase("c"))
     {
       // run the current calibration menu
       runCurrentCalibrationMenu(ina226_adc);
@@ -819,6 +1114,11 @@ void loop()
       // run the protection configuration menu
       runProtectionConfigMenu(ina226_adc);
     }
+    else if (s.equalsIgnoreCase("b"))
+    {
+      // run the battery model (Peukert / charge efficiency) menu
+      runBatteryModelMenu(ina226_adc);
+    }
     else if (s.equalsIgnoreCase("l"))
     {
       // toggle load connection
@@ -858,17 +1158,96 @@ void loop()
       Serial.print(F("Configured Threshold : "));
       Serial.print(ina226_adc.getOvercurrentThreshold());
       Serial.println(F(" A"));
-      Serial.print(F("Actual HW Threshold  : "));
-      Serial.print(ina226_adc.getHardwareAlertThreshold_A());
-      Serial.println(F(" A"));
+      const AlertScheduler &sched = ina226_adc.getAlertScheduler();
+      Serial.printf("Alert Function       : %s (%lu switches)\n",
+                    AlertScheduler::functionName(sched.function()), (unsigned long)sched.switchCount());
+      if (sched.function() == AlertScheduler::ALERT_SHUNT_OVER) {
+        Serial.print(F("Actual HW Threshold  : "));
+        Serial.print(ina226_adc.getHardwareAlertThreshold_A());
+        Serial.println(F(" A"));
+      }
+      uint32_t armedTotal = 0;
+      for (uint8_t f = 0; f < AlertScheduler::FUNCTION_COUNT; ++f) {
+        armedTotal += sched.armedTime_ms((AlertScheduler::Function)f);
+      }
+      if (armedTotal > 0) {
+        Serial.print(F("Alert Coverage       :"));
+        for (uint8_t f = 0; f < AlertScheduler::FUNCTION_COUNT; ++f) {
+          const AlertScheduler::Function fn = (AlertScheduler::Function)f;
+          Serial.printf(" %s %.1f%%", AlertScheduler::functionName(fn), sched.armedTime_ms(fn) * 100.0f / armedTotal);
+        }
+        Serial.println();
+      }
       Serial.print(F("Low Voltage Cutoff   : "));
       Serial.print(ina226_adc.getLowVoltageCutoff());
       Serial.println(F(" V"));
       Serial.print(F("Hysteresis           : "));
       Serial.print(ina226_adc.getHysteresis());
       Serial.println(F(" V"));
+      const ProtectionEngine &prot = ina226_adc.getProtection();
+      Serial.printf("Trip Curve           : I2t %.1f s at 2x, instant at %.1fx (%.1f A)\n",
+                    ina226_adc.getTripTimeAt2x_s(), ina226_adc.getInstantMultiple(),
+                    ina226_adc.getInstantTripCurrent_A());
+      Serial.printf("LV Debounce          : %.1f s (hardware floor %.2f V)\n",
+                    ina226_adc.getLowVoltageDebounce_s(), ina226_adc.getHardwareLowVoltageFloor_V());
+      Serial.printf("OV Cutoff / Power    : %.2f V / %.0f W (0 = off)\n",
+                    ina226_adc.getOvervoltageCutoff_V(), ina226_adc.getPowerLimit_W());
+      Serial.printf("Sleep Current        : %.2f mA\n", ina226_adc.getSleepCurrent_mA());
+      Serial.printf("Protection State     : %s (I2t %.0f %%, %u of %u retries)\n",
+                    ProtectionEngine::stateName(prot.state()), prot.heat() * 100.0f, prot.retries(),
+                    ina226_adc.getOvercurrentMaxRetries());
+      Serial.printf("OC Reclose           : first after %.0f s, doubling\n", ina226_adc.getOvercurrentCooldown_s());
+      Serial.printf("Retry Count Clears   : after %lu s on\n", (unsigned long)(prot.retryWindowMs() / 1000UL));
+      const uint32_t reclose_ms = prot.recloseRemainingMs((uint32_t)millis());
+      if (reclose_ms > 0) {
+        Serial.printf("Next Reclose In      : %lu s\n", (unsigned long)((reclose_ms + 999UL) / 1000UL));
+      }
+      LvdSleepRecord lvd;
+      if (LvdSleep::stats(lvd) && lvd.wakes > 0) {
+        Serial.printf("LVD Fast Wakes       : %lu, last %.1f ms at %.2f V, ~%.1f mJ total est. (full boot %.0f ms)\n",
+                      (unsigned long)lvd.wakes, lvd.lastAwake_us / 1000.0f, lvd.lastBus_mV / 1000.0f,
+                      lvd.energyTotal_uJ / 1000.0f, lvd.fullBoot_us / 1000.0f);
+      }
+      const LatencyHistogram &gateOff = ina226_adc.getIsrGateOffLatency();
+      if (gateOff.count() > 0) {
+        const float cyclesPerUs = (float)getCpuFrequencyMhz();
+        const LatencyHistogram &handled = ina226_adc.getAlertHandledLatency();
+        // Software part only, from ISR entry; a scope on ALERT and the gate gives end to end
+        Serial.printf("ISR -> Gate Write    : %lu alerts, last %.2f us, p99 <= %.2f us, max %.2f us\n",
+                      (unsigned long)gateOff.count(), gateOff.last() / cyclesPerUs,
+                      gateOff.quantileUpper(0.99f) / cyclesPerUs, gateOff.max() / cyclesPerUs);
+        Serial.printf("ISR -> Handled       : last %lu us, p99 <= %lu us, max %lu us\n",
+                      (unsigned long)handled.last(), (unsigned long)handled.quantileUpper(0.99f),
+                      (unsigned long)handled.max());
+      }
+      const ResistanceEstimator &ir = ina226_adc.getResistanceEstimator();
+      if (ir.hasEstimate()) {
+        Serial.printf("Internal Resistance  : %.1f mOhm (%lu steps, last %lu s ago)\n",
+                      ir.resistance_Ohm() * 1000.0f, (unsigned long)ir.stepCount(),
+                      (unsigned long)((millis() - ir.lastUpdateMs()) / 1000UL));
+      } else {
+        Serial.println(F("Internal Resistance  : no load step seen yet"));
+      }
+      Serial.print(F("IR-Compensated LVD   : "));
+      Serial.println(ina226_adc.isIrCompensationEnabled() ? "ON" : "OFF");
+      const TimeToFull &ttf = ina226_adc.getTimeToFull();
+      if (ttf.hasPrediction()) {
+        Serial.printf("Time To Full         : %.2f h (%s", ttf.hours(), ttf.inAbsorption() ? "absorption" : "bulk");
+        if (ttf.hasTau()) Serial.printf(", taper tau %.0f min", ttf.tau_s() / 60.0f);
+        Serial.println(")");
+      }
       Serial.println(F("-------------------------"));
     }
+    else if (s.equalsIgnoreCase("h"))
+    {
+      // lifetime history
+      runLifetimeStatsMenu(ina226_adc);
+    }
+    else if (s.equalsIgnoreCase("t"))
+    {
+      // wall clock for the load profile
+      runClockMenu(ina226_adc);
+    }
     else if (s.equalsIgnoreCase("d"))
     {
       // dump INA226 registers
@@ -877,13 +1256,26 @@ void loop()
     // else ignore — keep running
   }
 
-  if (millis() - last_loop_millis > loop_interval)
-  {
 #ifdef USE_ADC
+  if (millis() - last_sample_millis >= sample_interval)
+  {
+    ina226_adc.readSensors();
     if (ina226_adc.isConfigured()) {
       ina226_adc.checkAndHandleProtection();
+      ina226_adc.updateAlertSchedule();
     }
+    // Update remaining capacity in the INA226 helper (expects current in A)
+    ina226_adc.updateBatteryCapacity(ina226_adc.getCurrent_mA() / 1000.0f);
+    ina226_adc.saveRtcSnapshot(); // a brownout now loses at most one sample
+    ina226_adc.journalStateOfCharge();
+    ina226_adc.checkpointLifetimeStats();
+    last_sample_millis = millis();
+  }
+#endif
 
+  if (millis() - last_loop_millis > loop_interval)
+  {
+#ifdef USE_ADC
     ina226_adc.readSensors();
 
     // Populate struct fields
@@ -896,21 +1288,9 @@ void loop()
 
     ae_smart_shunt_struct.batteryState = 0; // 0 = Normal, 1 = Warning, 2 = Critical
 
-    // Update remaining capacity in the INA226 helper (expects current in A)
-    ina226_adc.updateBatteryCapacity(ina226_adc.getCurrent_mA() / 1000.0f);
-
-    // Get remaining Ah from INA helper
-    float remainingAh = ina226_adc.getBatteryCapacity();
-    ae_smart_shunt_struct.batteryCapacity = remainingAh; // remaining capacity in Ah
-    // batteryCapacity global holds the rated capacity in Ah for SOC calculation
-    if (batteryCapacity > 0.0f)
-    {
-      ae_smart_shunt_struct.batterySOC = remainingAh / batteryCapacity; // fraction 0..1
-    }
-    else
-    {
-      ae_smart_shunt_struct.batterySOC = 0.0f;
-    }
+    // Remaining Ah and SOC come from the coulomb counter fed above
+    ae_smart_shunt_struct.batteryCapacity = ina226_adc.getBatteryCapacity(); // remaining capacity in Ah
+    ae_smart_shunt_struct.batterySOC = ina226_adc.getStateOfCharge();        // fraction 0..1
 
     if (ina226_adc.isOverflow())
     {
@@ -920,13 +1300,11 @@ void loop()
 
     // Calculate and print run-flat time with warning threshold
     bool warning = false;
-    float currentA = ina226_adc.getCurrent_mA() / 1000.0f; // convert mA to A
     float warningThresholdHours = 10.0f;
 
-    String avgRunFlatTimeStr = ina226_adc.getAveragedRunFlatTime(currentA, warningThresholdHours, warning);
-
-    strncpy(ae_smart_shunt_struct.runFlatTime, avgRunFlatTimeStr.c_str(), sizeof(ae_smart_shunt_struct.runFlatTime));
-    ae_smart_shunt_struct.runFlatTime[sizeof(ae_smart_shunt_struct.runFlatTime) - 1] = '\0'; // ensure null termination
+    // Formatted straight into the telemetry struct: no String, no heap churn
+    ina226_adc.getAveragedRunFlatTime(warningThresholdHours, warning,
+                                      ae_smart_shunt_struct.runFlatTime, sizeof(ae_smart_shunt_struct.runFlatTime));
 
 #else
     // Code to use victron BLE
@@ -952,6 +1330,12 @@ void loop()
 
 #ifdef USE_ADC
     printShunt(&ae_smart_shunt_struct);
+    Serial.printf("Charge In/Out  : %.3f / %.3f Ah\n", ina226_adc.getChargeIn_Ah(), ina226_adc.getChargeOut_Ah());
+#ifdef USE_SOC_EKF
+    const SocEkf &ekf = ina226_adc.getSocEkf();
+    Serial.printf("EKF            : SOC %.1f +/- %.1f %%, R0 %.1f mOhm, Vp %.3f V\n", ekf.soc() * 100.0f,
+                  ekf.socSigma() * 100.0f, ekf.r0_Ohm() * 1000.0f, ekf.polarisation_V());
+#endif
     if (ina226_adc.isOverflow())
     {
       Serial.println("Warning: Overflow condition!");
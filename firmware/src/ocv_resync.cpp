@@ -0,0 +1,95 @@
+#include "ocv_resync.h"
+#include <math.h>
+
+const float OcvResync::plateauSlopeRatio = 0.5f;
+
+OcvResync::OcvResync()
+    : m_curve(nullptr),
+      m_count(0),
+      m_restCurrentA(0.2f),
+      m_restMs(DefaultChemistry::restMinutes * 60UL * 1000UL),
+      m_voltageSigma_V(0.01f),
+      m_driftPerDay(0.01f),
+      m_resting(false),
+      m_syncedThisRest(false),
+      m_restStartMs(0),
+      m_lastMs(0),
+      m_lastSyncMs(0),
+      m_hasSynced(false),
+      m_lastWeight(0.0f),
+      m_lastOcvSoc(0.0f),
+      m_lastOcvSigma(1.0f),
+      m_lastOnPlateau(false)
+{
+    m_curve = DefaultChemistry::ocvCurve(m_count);
+}
+
+void OcvResync::setCurve(const OcvPoint *points, size_t count) {
+    m_curve = points;
+    m_count = count;
+}
+
+void OcvResync::setRest(float restCurrentA, uint32_t restMs) {
+    m_restCurrentA = restCurrentA;
+    m_restMs = restMs;
+}
+
+void OcvResync::setUncertainty(float voltageSigma_V, float counterDriftPerDay) {
+    m_voltageSigma_V = voltageSigma_V;
+    m_driftPerDay = counterDriftPerDay;
+}
+
+float OcvResync::socFromVoltage(float volts, float &slopePerVolt) const {
+    slopePerVolt = 0.0f;
+    if (m_count == 0) return 0.0f;
+    if (volts <= m_curve[0].volts) return m_curve[0].soc;
+    if (volts >= m_curve[m_count - 1].volts) return m_curve[m_count - 1].soc;
+    for (size_t i = 1; i < m_count; ++i) {
+        if (volts < m_curve[i].volts) {
+            const OcvPoint &a = m_curve[i - 1];
+            const OcvPoint &b = m_curve[i];
+            slopePerVolt = (b.soc - a.soc) / (b.volts - a.volts);
+            return a.soc + (volts - a.volts) * slopePerVolt;
+        }
+    }
+    return m_curve[m_count - 1].soc;
+}
+
+bool OcvResync::update(float currentA, float busVoltage_V, uint32_t nowMs, float &socInOut) {
+    m_lastMs = nowMs;
+    // Below 5.25V we are on USB power with no battery (see checkAndHandleProtection)
+    if (fabsf(currentA) >= m_restCurrentA || busVoltage_V < 5.25f || m_count == 0) {
+        m_resting = false;
+        return false;
+    }
+    if (!m_resting) {
+        m_resting = true;
+        m_syncedThisRest = false;
+        m_restStartMs = nowMs;
+        return false;
+    }
+    if (m_syncedThisRest || nowMs - m_restStartMs < m_restMs) return false;
+
+    // Outside the curve there is no information, only a clamp
+    float slope;
+    const float ocvSoc = socFromVoltage(busVoltage_V, slope);
+    m_syncedThisRest = true;
+    if (slope <= 0.0f) return false;
+
+    // Variances in SOC units; 1 % floor for temperature and hysteresis
+    const float days = m_hasSynced ? (float)(nowMs - m_lastSyncMs) / 86400000.0f : 30.0f;
+    const float sigmaCounter = 0.02f + m_driftPerDay * days;
+    const float sigmaOcv = 0.01f + m_voltageSigma_V * slope;
+    const float w = (sigmaCounter * sigmaCounter) / (sigmaCounter * sigmaCounter + sigmaOcv * sigmaOcv);
+
+    socInOut = socInOut + w * (ocvSoc - socInOut);
+    m_lastWeight = w;
+    m_lastOcvSoc = ocvSoc;
+    m_lastOcvSigma = sigmaOcv;
+    const float meanVoltsPerSoc = (m_curve[m_count - 1].volts - m_curve[0].volts) /
+                                  (m_curve[m_count - 1].soc - m_curve[0].soc);
+    m_lastOnPlateau = 1.0f / slope < plateauSlopeRatio * meanVoltsPerSoc;
+    m_lastSyncMs = nowMs;
+    m_hasSynced = true;
+    return true;
+}
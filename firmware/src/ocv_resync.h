@@ -0,0 +1,64 @@
+#ifndef OCV_RESYNC_H
+#define OCV_RESYNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "battery_model.h"
+
+// Open-circuit-voltage SOC resynchronisation.
+//
+// Coulomb counting drifts without bound; a rested battery's terminal voltage
+// does not. Once |current| has stayed below the rest threshold for the
+// chemistry's relaxation time, the bus voltage is looked up on the OCV curve and
+// blended into the counted SOC once per rest period. The weight is a variance
+// ratio: the counter's uncertainty grows with time since the last resync, the
+// OCV estimate's uncertainty is the voltage error times the curve's local slope
+// (large on LiFePO4's flat middle, small near the knees).
+class OcvResync {
+public:
+    OcvResync();
+
+    void setCurve(const OcvPoint *points, size_t count);
+    void setRest(float restCurrentA, uint32_t restMs);
+    void setUncertainty(float voltageSigma_V, float counterDriftPerDay);
+
+    // Piecewise-linear lookup (clamped), plus dSOC/dV of the segment used
+    float socFromVoltage(float volts, float &slopePerVolt) const;
+
+    // Call every sample. When a resync happens, socInOut is replaced by the
+    // blended value and true is returned.
+    bool update(float currentA, float busVoltage_V, uint32_t nowMs, float &socInOut);
+
+    bool atRest() const { return m_resting && (m_lastMs - m_restStartMs) >= m_restMs; }
+    float lastWeight() const { return m_lastWeight; }
+    // Raw OCV reading of the last resync and its 1-sigma uncertainty (SOC units)
+    float lastOcvSoc() const { return m_lastOcvSoc; }
+    float lastOcvSigma() const { return m_lastOcvSigma; }
+    // The last reading came from a segment flatter than plateauSlopeRatio of the
+    // curve's mean dV/dSOC (LiFePO4's middle). A few mV of hysteresis or
+    // temperature there move SOC by more than the sigma admits, so it still
+    // nudges the counter but is no anchor for capacity learning.
+    bool lastOnPlateau() const { return m_lastOnPlateau; }
+
+    static const float plateauSlopeRatio;
+
+private:
+    const OcvPoint *m_curve;
+    size_t m_count;
+    float m_restCurrentA;
+    uint32_t m_restMs;
+    float m_voltageSigma_V;
+    float m_driftPerDay;
+    bool m_resting;
+    bool m_syncedThisRest;
+    uint32_t m_restStartMs;
+    uint32_t m_lastMs;
+    uint32_t m_lastSyncMs;
+    bool m_hasSynced;
+    float m_lastWeight;
+    float m_lastOcvSoc;
+    float m_lastOcvSigma;
+    bool m_lastOnPlateau;
+};
+
+#endif // OCV_RESYNC_H
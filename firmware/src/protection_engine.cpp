@@ -0,0 +1,177 @@
+#include "protection_engine.h"
+
+ProtectionEngine::ProtectionEngine()
+    : m_t{50000, 150000, 0, 9000, 9600, 0, 0, 0, 0, 0},
+      m_timing{2000, 2000, 30000, 60000, 0},
+      m_state(ARMING),
+      m_fault(FAULT_OVERCURRENT),
+      m_retries(0),
+      m_reclosing(false),
+      m_lowPending(false),
+      m_hasPrev(false),
+      m_heat(0),
+      m_prevMs(0),
+      m_stateMs(0),
+      m_lowSinceMs(0)
+{
+    m_t.budget_mA2ms = i2tBudget(m_t.pickup_mA, 5.0f);
+}
+
+int64_t ProtectionEngine::i2tBudget(int32_t pickup_mA, float tripTimeAt2x_s) {
+    // (2I)^2 - I^2 = 3 I^2 accumulated for t2x
+    const int64_t p = pickup_mA;
+    return 3 * p * p * (int64_t)(tripTimeAt2x_s * 1000.0f);
+}
+
+const char *ProtectionEngine::stateName(State s) {
+    switch (s) {
+    case ARMING:   return "ARMING";
+    case ARMED:    return "ARMED";
+    case TRIPPED:  return "TRIPPED";
+    case COOLDOWN: return "COOLDOWN";
+    case RETRY:    return "RETRY";
+    }
+    return "?";
+}
+
+ProtectionEngine::Action ProtectionEngine::evaluate(int32_t raw_mA, int32_t bus_mV, uint32_t nowMs) {
+    uint32_t dt = m_hasPrev ? nowMs - m_prevMs : 0;
+    m_hasPrev = true;
+    m_prevMs = nowMs;
+
+    // I^2t heat: fills above pickup, cools below it, never negative. A sample
+    // after a gap heats for at most maxStepMs but cools for the whole gap.
+    const int64_t i = raw_mA > 0 ? raw_mA : 0;
+    const int64_t p = m_t.pickup_mA;
+    const int64_t rate = i * i - p * p;
+    if (dt > (rate > 0 ? maxStepMs : maxCoolMs)) dt = rate > 0 ? maxStepMs : maxCoolMs;
+    m_heat += rate * (int64_t)dt;
+    if (m_heat < 0) m_heat = 0;
+
+    if (bus_mV < usbPower_mV) return ACTION_NONE;
+
+    switch (m_state) {
+    case ARMING:
+    case ARMED:
+    case RETRY: {
+        if (raw_mA >= m_t.instant_mA || m_heat >= m_t.budget_mA2ms) return ACTION_TRIP_OVERCURRENT;
+        if (m_t.overPower_mAmV > 0 && i * bus_mV >= m_t.overPower_mAmV) return ACTION_TRIP_OVERCURRENT;
+        if (m_t.overVoltage_mV > 0 && bus_mV >= m_t.overVoltage_mV) return ACTION_TRIP_OVER_VOLTAGE;
+
+        const uint32_t inState = nowMs - m_stateMs;
+        if (m_state == ARMING && inState >= m_timing.armingMs) {
+            m_state = ARMED;
+            m_stateMs = nowMs;
+        } else if (m_state == RETRY && inState >= retryWindowMs()) {
+            m_state = ARMED;            // held long enough: the fault has cleared
+            m_stateMs = nowMs;
+            m_retries = 0;
+        }
+
+        // Low voltage is blanked while the load settles after closing
+        if (m_state != ARMED && inState < m_timing.armingMs) {
+            m_lowPending = false;
+            return ACTION_NONE;
+        }
+        int32_t drop_mV = (int32_t)((i * m_t.irCompQ16) >> 16);
+        if (drop_mV > m_t.irCompMax_mV) drop_mV = m_t.irCompMax_mV;
+        const int32_t compensated = bus_mV + drop_mV;
+        if (compensated >= m_t.lowVoltage_mV) {
+            m_lowPending = false;
+            return ACTION_NONE;
+        }
+        if (!m_lowPending) {
+            m_lowPending = true;
+            m_lowSinceMs = nowMs;
+        }
+        return nowMs - m_lowSinceMs >= m_timing.lvdDebounceMs ? ACTION_TRIP_LOW_VOLTAGE : ACTION_NONE;
+    }
+
+    case COOLDOWN:
+        if (m_fault == FAULT_LOW_VOLTAGE) {
+            if (bus_mV <= m_t.reconnect_mV) return ACTION_NONE;
+        } else if (m_fault == FAULT_OVER_VOLTAGE) {
+            if (bus_mV >= m_t.ovReconnect_mV) return ACTION_NONE;
+        } else if (nowMs - m_stateMs < recloseDelayMs() || m_heat > 0 || bus_mV <= m_t.reconnect_mV) {
+            return ACTION_NONE;
+        }
+        m_reclosing = true;
+        return ACTION_RECONNECT;
+
+    case TRIPPED:
+        break;
+    }
+    return ACTION_NONE;
+}
+
+// baseMs doubled for every retry used, at most maxBackoffMs
+uint32_t ProtectionEngine::backoff(uint32_t baseMs) const {
+    uint32_t delay = baseMs;
+    for (uint8_t i = 0; i < m_retries && delay < maxBackoffMs; ++i) {
+        delay = delay > maxBackoffMs / 2 ? maxBackoffMs : delay * 2;
+    }
+    return delay < maxBackoffMs ? delay : maxBackoffMs;
+}
+
+uint32_t ProtectionEngine::recloseDelayMs() const {
+    return backoff(m_timing.cooldownMs);
+}
+
+uint32_t ProtectionEngine::retryWindowMs() const {
+    return backoff(m_timing.retryWindowMs);
+}
+
+uint32_t ProtectionEngine::recloseRemainingMs(uint32_t nowMs) const {
+    if (m_state != COOLDOWN || m_fault != FAULT_OVERCURRENT) return 0;
+    const uint32_t elapsed = nowMs - m_stateMs;
+    const uint32_t delay = recloseDelayMs();
+    return elapsed < delay ? delay - elapsed : 0;
+}
+
+void ProtectionEngine::onConnected(uint32_t nowMs) {
+    if (m_reclosing) {
+        m_state = RETRY;
+        if (m_fault == FAULT_OVERCURRENT) m_retries++;
+    } else {
+        m_state = ARMING;           // manual: a fresh start
+        m_retries = 0;
+    }
+    m_reclosing = false;
+    m_lowPending = false;
+    m_stateMs = nowMs;
+}
+
+void ProtectionEngine::onTripped(Fault fault, uint32_t nowMs) {
+    m_fault = fault;
+    m_reclosing = false;
+    m_lowPending = false;
+    m_stateMs = nowMs;
+    if (fault == FAULT_OVERCURRENT && m_retries >= m_timing.maxRetries) {
+        m_state = TRIPPED;
+    } else {
+        m_state = COOLDOWN;
+    }
+}
+
+void ProtectionEngine::restore(uint8_t retries, bool lockedOut, uint32_t nowMs) {
+    m_retries = retries;
+    m_reclosing = false;
+    m_stateMs = nowMs;
+    if (lockedOut) {
+        m_fault = FAULT_OVERCURRENT;
+        m_state = TRIPPED;
+    } else if (m_state == ARMING && retries > 0) {
+        m_state = RETRY;            // reset inside a retry window: it still has to hold
+    } else if (m_fault == FAULT_OVERCURRENT && (m_state == COOLDOWN || m_state == TRIPPED)) {
+        // Not locked out: the cooldown starts over toward the next reclose,
+        // unless the retry limit has since been lowered below the count
+        m_state = retries < m_timing.maxRetries ? COOLDOWN : TRIPPED;
+    }
+}
+
+void ProtectionEngine::onManualOff(uint32_t nowMs) {
+    m_state = TRIPPED;
+    m_reclosing = false;
+    m_lowPending = false;
+    m_stateMs = nowMs;
+}
@@ -0,0 +1,122 @@
+#ifndef PROTECTION_ENGINE_H
+#define PROTECTION_ENGINE_H
+
+#include <stdint.h>
+
+// Per-sample load protection.
+//
+// Evaluated on every sample rather than on the 10 s reporting loop. Overcurrent
+// follows an inverse-time (I^2t) curve: above the pickup current a heat budget
+// fills with (I^2 - Ipickup^2) * dt and drains the same way below it, so a
+// motor or inverter inrush rides through while a sustained fault trips in
+// t = 3 * t2x / (M^2 - 1) at M times pickup (t2x at twice pickup). A current
+// above the instantaneous level trips on one sample, and so does discharge
+// power above the power limit or a bus above the overvoltage cutoff (both
+// optional). Low voltage must persist for the debounce time, and is ignored
+// while the load is arming (just closed), so a cranking or switching dip does
+// not cut the load.
+//
+//   ARMING --armingMs--> ARMED --fault--> COOLDOWN --recovered--> RETRY --retryWindowMs--> ARMED
+//                          \--fault, no retries left / manual off--> TRIPPED (latched)
+//
+// Low voltage recovers once the bus is above the reconnect voltage, overvoltage
+// once it is below its own reconnect voltage. Overcurrent (and overpower)
+// recloses with exponential backoff: cooldownMs doubled for every retry already
+// used (at most maxBackoffMs), with the I^2t budget drained, and only if the
+// bus is above the low-voltage reconnect voltage so it does not close onto a
+// flat battery. The retry count clears once the load has held for the retry
+// window, which doubles with every retry used just like the delay, so a fault
+// that recurs a little after a fixed window still runs out of retries. After
+// maxRetries recloses it locks out in TRIPPED until a manual reconnect. The
+// owner keeps the retry count and the lockout in RTC memory and hands them
+// back through restore(), so a reset does not grant a fresh set of retries.
+//
+// All thresholds are precomputed by the owner in raw sensor units (uncalibrated
+// INA226 current in mA, bus voltage in mV), so evaluate() is integer compares
+// and one multiply-accumulate per sample.
+struct ProtectionThresholds {
+    int32_t pickup_mA;          // I^2t accumulates above this
+    int32_t instant_mA;         // trips on one sample
+    int64_t budget_mA2ms;       // I^2t trip budget above pickup
+    int32_t lowVoltage_mV;
+    int32_t reconnect_mV;
+    int32_t irCompQ16;          // ohmic drop added back, mV per raw mA in Q16 (0 = off)
+    int32_t irCompMax_mV;       // at most this much of it
+    int32_t overVoltage_mV;     // 0 = off
+    int32_t ovReconnect_mV;
+    int64_t overPower_mAmV;     // raw mA * bus mV; 0 = off
+};
+
+struct ProtectionTiming {
+    uint32_t lvdDebounceMs;
+    uint32_t armingMs;
+    uint32_t cooldownMs;        // first overcurrent reclose delay, doubled per retry
+    uint32_t retryWindowMs;     // clean time that clears the retry count, doubled per retry
+    uint8_t maxRetries;         // overcurrent reclose attempts; 0 = latch on the first trip
+};
+
+class ProtectionEngine {
+public:
+    enum State : uint8_t { ARMING, ARMED, TRIPPED, COOLDOWN, RETRY };
+    enum Fault : uint8_t { FAULT_LOW_VOLTAGE, FAULT_OVERCURRENT, FAULT_OVER_VOLTAGE };
+    enum Action : uint8_t { ACTION_NONE, ACTION_TRIP_LOW_VOLTAGE, ACTION_TRIP_OVERCURRENT, ACTION_RECONNECT,
+                            ACTION_TRIP_OVER_VOLTAGE };
+
+    static const uint32_t maxStepMs = 1000;     // longest sample gap integrated as heating
+    static const uint32_t maxCoolMs = 3600000;  // and as cooling (keeps the product in int64)
+    static const int32_t usbPower_mV = 5250;    // below this there is no battery: no protection
+    static const uint32_t maxBackoffMs = 3600000;
+
+    ProtectionEngine();
+
+    void setThresholds(const ProtectionThresholds &t) { m_t = t; }
+    const ProtectionThresholds &thresholds() const { return m_t; }
+    void setTiming(const ProtectionTiming &t) { m_timing = t; }
+    const ProtectionTiming &timing() const { return m_timing; }
+    // Budget for a curve that trips in tripTimeAt2x_s at twice the pickup current
+    static int64_t i2tBudget(int32_t pickup_mA, float tripTimeAt2x_s);
+
+    // Hot path: one call per sample. The owner carries out the action and
+    // reports the resulting switch change below.
+    Action evaluate(int32_t raw_mA, int32_t bus_mV, uint32_t nowMs);
+
+    // Load switch changes, whoever made them
+    void onConnected(uint32_t nowMs);
+    void onTripped(Fault fault, uint32_t nowMs);
+    void onManualOff(uint32_t nowMs);
+    // After a reset that kept RTC memory, once the switch state is restored:
+    // carry the retry count over, keep a lockout latched and put any other
+    // overcurrent trip back into COOLDOWN
+    void restore(uint8_t retries, bool lockedOut, uint32_t nowMs);
+
+    State state() const { return m_state; }
+    static const char *stateName(State s);
+    Fault fault() const { return m_fault; }     // last trip
+    uint8_t retries() const { return m_retries; }
+    // Overcurrent reclose delay for the present retry count
+    uint32_t recloseDelayMs() const;
+    // Clean time after a reclose that clears the retry count
+    uint32_t retryWindowMs() const;
+    // Until the cooldown of an overcurrent trip ends (0 if not cooling down)
+    uint32_t recloseRemainingMs(uint32_t nowMs) const;
+    // I^2t budget used, 0..1
+    float heat() const { return m_t.budget_mA2ms > 0 ? (float)m_heat / (float)m_t.budget_mA2ms : 0.0f; }
+
+private:
+    uint32_t backoff(uint32_t baseMs) const;
+
+    ProtectionThresholds m_t;
+    ProtectionTiming m_timing;
+    State m_state;
+    Fault m_fault;
+    uint8_t m_retries;
+    bool m_reclosing;
+    bool m_lowPending;
+    bool m_hasPrev;
+    int64_t m_heat;             // mA^2 * ms above pickup
+    uint32_t m_prevMs;
+    uint32_t m_stateMs;         // entry time of the present state
+    uint32_t m_lowSinceMs;
+};
+
+#endif // PROTECTION_ENGINE_H
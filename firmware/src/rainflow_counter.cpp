@@ -0,0 +1,190 @@
+#include "rainflow_counter.h"
+#include "soc_journal.h"
+#include "shared_defs.h"
+#include <Preferences.h>
+#include <math.h>
+#include <string.h>
+
+static_assert(sizeof(((RainflowRecord *)0)->halfCycles) / sizeof(uint32_t) == RainflowCounter::binCount,
+              "record histogram size");
+static_assert(sizeof(((RainflowRecord *)0)->residue) == RainflowCounter::stackSize, "record residue size");
+
+static const float depthSteps = 1000.0f;   // depthSum units per 100 % DoD
+
+// Before depth sums: counts only. Migrated on load with each bin's midpoint.
+struct RainflowRecordV1 {
+    uint32_t halfCycles[10];
+    uint8_t residue[32];
+    uint8_t residueCount;
+    uint8_t reserved[3];
+    uint32_t crc;
+};
+
+RainflowCounter::RainflowCounter(float deadband)
+    : m_deadband(deadband),
+      m_count(0),
+      m_dir(0),
+      m_extreme(0.0f),
+      m_dirty(false),
+      m_lastWriteMs(0)
+{
+    memset(m_halfCycles, 0, sizeof(m_halfCycles));
+    memset(m_depthSum, 0, sizeof(m_depthSum));
+}
+
+void RainflowCounter::addSoc(float soc) {
+    if (m_count == 0) {
+        pushTurningPoint(soc);
+        return;
+    }
+    if (m_dir == 0) {
+        const float ref = m_stack[m_count - 1];
+        if (fabsf(soc - ref) >= m_deadband) {
+            m_dir = soc > ref ? 1 : -1;
+            m_extreme = soc;
+        }
+        return;
+    }
+    if ((m_dir > 0 && soc > m_extreme) || (m_dir < 0 && soc < m_extreme)) {
+        m_extreme = soc;
+    } else if (fabsf(m_extreme - soc) >= m_deadband) {
+        // Reversed by more than the deadband: the extreme was a turning point
+        pushTurningPoint(m_extreme);
+        m_dir = (int8_t)-m_dir;
+        m_extreme = soc;
+    }
+}
+
+void RainflowCounter::pushTurningPoint(float soc) {
+    // Same direction as the last segment (e.g. after a restore): extend it
+    if (m_count >= 2 && (soc - m_stack[m_count - 1]) * (m_stack[m_count - 1] - m_stack[m_count - 2]) > 0.0f) {
+        m_count--;
+    }
+    if (m_count == stackSize) {
+        countRange(m_stack[0], m_stack[1], false);
+        memmove(m_stack, m_stack + 1, (stackSize - 1) * sizeof(m_stack[0]));
+        m_count--;
+    }
+    m_stack[m_count++] = soc;
+    m_dirty = true;
+
+    while (m_count >= 3) {
+        const float x = fabsf(m_stack[m_count - 1] - m_stack[m_count - 2]);
+        const float y = fabsf(m_stack[m_count - 2] - m_stack[m_count - 3]);
+        if (x < y) break;
+        if (m_count == 3) {
+            // Y contains the starting point: half cycle, drop the start
+            countRange(m_stack[0], m_stack[1], false);
+            m_stack[0] = m_stack[1];
+            m_stack[1] = m_stack[2];
+            m_count = 2;
+        } else {
+            countRange(m_stack[m_count - 3], m_stack[m_count - 2], true);
+            m_stack[m_count - 3] = m_stack[m_count - 1];
+            m_count -= 2;
+        }
+    }
+}
+
+void RainflowCounter::countRange(float a, float b, bool full) {
+    const float depth = fabsf(a - b);
+    int bin = (int)(depth * binCount);
+    if (bin >= binCount) bin = binCount - 1;
+    const uint32_t halves = full ? 2 : 1;
+    m_halfCycles[bin] += halves;
+    m_depthSum[bin] += halves * (uint32_t)lroundf(depth * depthSteps);
+    m_dirty = true;
+}
+
+float RainflowCounter::meanDepth(uint8_t bin) const {
+    if (bin >= binCount || m_halfCycles[bin] == 0) return 0.0f;
+    return (float)m_depthSum[bin] / depthSteps / (float)m_halfCycles[bin];
+}
+
+float RainflowCounter::equivalentFullCycles() const {
+    uint64_t halfDepths = 0;
+    for (uint8_t i = 0; i < binCount; ++i) halfDepths += m_depthSum[i];
+    return (float)halfDepths / depthSteps * 0.5f;
+}
+
+float RainflowCounter::damage(float cyclesAt100Dod, float exponent) const {
+    // Miner's rule: sum of n / N(DoD) with N(DoD) = N100 * DoD^-k
+    float d = 0.0f;
+    for (uint8_t i = 0; i < binCount; ++i) {
+        if (m_halfCycles[i] == 0) continue;
+        d += cycles(i) * powf(meanDepth(i), exponent) / cyclesAt100Dod;
+    }
+    return d;
+}
+
+bool RainflowCounter::load() {
+    Preferences prefs;
+    prefs.begin(NVS_RAINFLOW_NAMESPACE, true);
+    RainflowRecord r;
+    bool ok = false;
+    bool migrated = false;
+    if (prefs.getBytesLength(NVS_KEY_RAINFLOW) == sizeof(RainflowRecordV1)) {
+        RainflowRecordV1 v1;
+        ok = prefs.getBytes(NVS_KEY_RAINFLOW, &v1, sizeof(v1)) == sizeof(v1) &&
+             SocJournal::crc32(&v1, offsetof(RainflowRecordV1, crc)) == v1.crc &&
+             v1.residueCount <= stackSize;
+        if (ok) {
+            memcpy(r.halfCycles, v1.halfCycles, sizeof(v1.halfCycles));
+            for (uint8_t i = 0; i < binCount; ++i) {
+                r.depthSum[i] = v1.halfCycles[i] * (uint32_t)lroundf((i + 0.5f) / binCount * depthSteps);
+            }
+            memcpy(r.residue, v1.residue, sizeof(v1.residue));
+            r.residueCount = v1.residueCount;
+            migrated = true;
+        }
+    } else {
+        ok = prefs.getBytes(NVS_KEY_RAINFLOW, &r, sizeof(r)) == sizeof(r) &&
+             SocJournal::crc32(&r, offsetof(RainflowRecord, crc)) == r.crc &&
+             r.residueCount <= stackSize;
+    }
+    prefs.end();
+    if (!ok) return false;
+
+    memcpy(m_halfCycles, r.halfCycles, sizeof(m_halfCycles));
+    memcpy(m_depthSum, r.depthSum, sizeof(m_depthSum));
+    m_count = r.residueCount;
+    for (size_t i = 0; i < m_count; ++i) m_stack[i] = r.residue[i] / 200.0f;
+    m_dir = 0;
+    m_dirty = migrated;     // rewritten in the new layout at the next checkpoint
+    return true;
+}
+
+bool RainflowCounter::checkpoint(uint32_t nowMs, bool force) {
+    if (!m_dirty) return false;
+    if (!force && nowMs - m_lastWriteMs < checkpointInterval) return false;
+
+    RainflowRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.halfCycles, m_halfCycles, sizeof(r.halfCycles));
+    memcpy(r.depthSum, m_depthSum, sizeof(r.depthSum));
+    r.residueCount = (uint8_t)m_count;
+    for (size_t i = 0; i < m_count; ++i) {
+        float q = m_stack[i] * 200.0f + 0.5f;
+        r.residue[i] = q <= 0.0f ? 0 : (q >= 200.0f ? 200 : (uint8_t)q);
+    }
+    r.crc = SocJournal::crc32(&r, offsetof(RainflowRecord, crc));
+
+    Preferences prefs;
+    prefs.begin(NVS_RAINFLOW_NAMESPACE, false);
+    bool ok = prefs.putBytes(NVS_KEY_RAINFLOW, &r, sizeof(r)) == sizeof(r);
+    prefs.end();
+    if (ok) {
+        m_dirty = false;
+        m_lastWriteMs = nowMs;
+    }
+    return ok;
+}
+
+void RainflowCounter::reset(uint32_t nowMs) {
+    memset(m_halfCycles, 0, sizeof(m_halfCycles));
+    memset(m_depthSum, 0, sizeof(m_depthSum));
+    m_count = 0;
+    m_dir = 0;
+    m_dirty = true;
+    checkpoint(nowMs, true);
+}
@@ -0,0 +1,70 @@
+#ifndef RAINFLOW_COUNTER_H
+#define RAINFLOW_COUNTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Incremental rainflow cycle counting over the SOC trajectory.
+//
+// SOC samples are reduced to turning points with a deadband (wiggles smaller
+// than that are not cycles, just noise and float charging). Each turning point
+// goes through the ASTM E1049 four-point rule on a small stack: a range that is
+// enclosed by a larger one is a full cycle and its two points are removed; the
+// oldest range that cannot be enclosed any more is a half cycle. What stays on
+// the stack is the residue, which never grows past a few points per decade of
+// depth, so stackSize bounds it; overflow counts the oldest range as a half
+// cycle. Every update is O(1) amortised.
+//
+// Cycles go into a depth histogram (binCount bins of 1/binCount DoD each) kept
+// in half cycles, and each bin also sums the actual depths counted into it, so
+// a bin full of shallow cycles is not weighted as if they sat at its midpoint.
+// From it come equivalent full cycles (sum of depth x count) and a Miner's-rule
+// damage fraction against a Woehler curve N(DoD) = cyclesAt100Dod * DoD^-exponent,
+// taken at each bin's mean depth. The histogram and the residue are
+// written to NVS as one small CRC-checked blob on the same bounded schedule as
+// the lifetime statistics.
+struct RainflowRecord {
+    uint32_t halfCycles[10];
+    uint32_t depthSum[10];  // depths of those half cycles, in 0.1 % DoD steps
+    uint8_t residue[32];    // SOC in 0.5 % steps
+    uint8_t residueCount;
+    uint8_t reserved[3];
+    uint32_t crc;           // CRC-32 of all fields above
+};
+
+class RainflowCounter {
+public:
+    static const uint8_t binCount = 10;
+    static const uint8_t stackSize = 32;
+    static const uint32_t checkpointInterval = 30UL * 60UL * 1000UL;
+
+    explicit RainflowCounter(float deadband = 0.005f);
+
+    void addSoc(float soc);
+
+    float cycles(uint8_t bin) const { return bin < binCount ? m_halfCycles[bin] * 0.5f : 0.0f; }
+    float meanDepth(uint8_t bin) const;         // of the cycles in a bin, 0 if none
+    float equivalentFullCycles() const;
+    float damage(float cyclesAt100Dod, float exponent) const;   // 0 = new, 1 = end of life
+    size_t residueCount() const { return m_count; }
+
+    bool load();
+    bool checkpoint(uint32_t nowMs, bool force = false);
+    void reset(uint32_t nowMs);
+
+private:
+    void pushTurningPoint(float soc);
+    void countRange(float a, float b, bool full);
+
+    float m_deadband;
+    float m_stack[stackSize];
+    size_t m_count;
+    int8_t m_dir;           // direction since the last turning point, 0 = not yet known
+    float m_extreme;        // furthest SOC reached in m_dir
+    uint32_t m_halfCycles[binCount];
+    uint32_t m_depthSum[binCount];
+    bool m_dirty;
+    uint32_t m_lastWriteMs;
+};
+
+#endif // RAINFLOW_COUNTER_H
@@ -0,0 +1,53 @@
+#include "resistance_estimator.h"
+#include <math.h>
+
+ResistanceEstimator::ResistanceEstimator()
+    : m_minStepA(5.0f),
+      m_maxStepMs(1000),
+      m_maxOhms(0.1f),        // a 12V pack plus wiring is well under 100 mOhm
+      m_alpha(0.2f),
+      m_hasPrev(false),
+      m_prevA(0.0f),
+      m_prevV(0.0f),
+      m_prevMs(0),
+      m_ohms(0.0f),
+      m_lastStepOhms(0.0f),
+      m_lastUpdateMs(0),
+      m_count(0)
+{
+}
+
+void ResistanceEstimator::setPolicy(float minStepA, uint32_t maxStepMs, float maxOhms, float alpha) {
+    m_minStepA = minStepA;
+    m_maxStepMs = maxStepMs;
+    m_maxOhms = maxOhms;
+    m_alpha = alpha;
+}
+
+bool ResistanceEstimator::addSample(float currentA, float busVoltage_V, uint32_t nowMs) {
+    // USB power: no battery, nothing to measure
+    if (busVoltage_V < 5.25f) {
+        m_hasPrev = false;
+        return false;
+    }
+
+    bool updated = false;
+    if (m_hasPrev && nowMs - m_prevMs <= m_maxStepMs) {
+        const float dI = currentA - m_prevA;
+        if (fabsf(dI) >= m_minStepA) {
+            const float r = -(busVoltage_V - m_prevV) / dI;
+            if (r > 0.0f && r < m_maxOhms) {
+                m_ohms = m_count == 0 ? r : m_ohms + m_alpha * (r - m_ohms);
+                m_lastStepOhms = r;
+                m_lastUpdateMs = nowMs;
+                m_count++;
+                updated = true;
+            }
+        }
+    }
+    m_hasPrev = true;
+    m_prevA = currentA;
+    m_prevV = busVoltage_V;
+    m_prevMs = nowMs;
+    return updated;
+}
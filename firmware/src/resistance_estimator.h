@@ -0,0 +1,45 @@
+#ifndef RESISTANCE_ESTIMATOR_H
+#define RESISTANCE_ESTIMATOR_H
+
+#include <stdint.h>
+
+// Online internal-resistance estimation from load steps.
+//
+// Two consecutive samples taken within maxStepMs of each other, across which
+// the current changed by at least minStep, see the same open-circuit voltage
+// and almost the same polarisation: the voltage change is the ohmic drop,
+// R = -dV / dI. Every load switch, compressor start or inverter surge is a
+// free measurement. Estimates outside 0..maxOhms are discarded and the rest
+// are smoothed with an exponential filter; the first one is taken as is.
+class ResistanceEstimator {
+public:
+    ResistanceEstimator();
+
+    void setPolicy(float minStepA, uint32_t maxStepMs, float maxOhms, float alpha);
+
+    // Call every sample (current positive = discharge). True if the sample
+    // completed a step and the estimate was updated.
+    bool addSample(float currentA, float busVoltage_V, uint32_t nowMs);
+
+    bool hasEstimate() const { return m_count > 0; }
+    float resistance_Ohm() const { return m_ohms; }
+    float lastStep_Ohm() const { return m_lastStepOhms; }
+    uint32_t lastUpdateMs() const { return m_lastUpdateMs; }
+    uint32_t stepCount() const { return m_count; }
+
+private:
+    float m_minStepA;
+    uint32_t m_maxStepMs;
+    float m_maxOhms;
+    float m_alpha;
+    bool m_hasPrev;
+    float m_prevA;
+    float m_prevV;
+    uint32_t m_prevMs;
+    float m_ohms;
+    float m_lastStepOhms;
+    uint32_t m_lastUpdateMs;
+    uint32_t m_count;
+};
+
+#endif // RESISTANCE_ESTIMATOR_H
@@ -0,0 +1,34 @@
+#include "rtc_state.h"
+#include "soc_journal.h"
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR    // host builds: plain static memory
+#endif
+
+static const uint32_t rtcStateMagic = 0x52544353; // "RTCS"
+
+// Not cleared by the startup code, so it still holds the last save after a reset
+RTC_NOINIT_ATTR static RtcStateSnapshot rtcSnapshot;
+
+void RtcState::save(const RtcStateSnapshot &snapshot) {
+    RtcStateSnapshot s = snapshot;
+    s.seq = (rtcSnapshot.magic == rtcStateMagic) ? rtcSnapshot.seq + 1 : 1;
+    s.magic = rtcStateMagic;
+    s.crc = SocJournal::crc32(&s, offsetof(RtcStateSnapshot, crc));
+    rtcSnapshot = s;
+}
+
+bool RtcState::load(RtcStateSnapshot &out) {
+    RtcStateSnapshot s = rtcSnapshot;
+    if (s.magic != rtcStateMagic) return false;
+    if (SocJournal::crc32(&s, offsetof(RtcStateSnapshot, crc)) != s.crc) return false;
+    out = s;
+    return true;
+}
+
+void RtcState::invalidate() {
+    memset(&rtcSnapshot, 0, sizeof(rtcSnapshot));
+}
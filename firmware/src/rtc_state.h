@@ -0,0 +1,34 @@
+#ifndef RTC_STATE_H
+#define RTC_STATE_H
+
+#include <stdint.h>
+
+// Emergency copy of the charge accounting and protection state in RTC slow
+// memory. RTC memory survives brownout, watchdog and software resets and deep
+// sleep (not a cold power-on), and writing it is a plain memory copy, so it can
+// be refreshed every sample and again on a supply dip without any flash wear.
+// setup() restores it before anything reads NVS; the NVS SOC journal is only
+// the fallback for a cold start.
+struct RtcStateSnapshot {
+    int64_t remaining_nAs;
+    uint64_t chargeIn_nAs;
+    uint64_t chargeOut_nAs;
+    uint32_t seq;
+    uint8_t disconnectReason;   // DisconnectReason
+    uint8_t loadConnected;
+    uint8_t ocRetries;          // overcurrent recloses used in the present retry window
+    uint8_t ocLockedOut;        // retries exhausted: stays off until reconnected by hand
+    uint32_t magic;
+    uint32_t crc;               // CRC-32 of all fields above
+};
+
+class RtcState {
+public:
+    // A few microseconds: copy + CRC of 40 bytes. Safe from a shutdown handler.
+    static void save(const RtcStateSnapshot &snapshot);
+    // False after a cold power-on or if the last save was torn
+    static bool load(RtcStateSnapshot &out);
+    static void invalidate();
+};
+
+#endif // RTC_STATE_H
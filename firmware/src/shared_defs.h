@@ -7,6 +7,8 @@
 #define LOAD_SWITCH_PIN 5
 #define INA_ALERT_PIN 7
 #define LED_PIN 4
+#define INA_SDA_PIN 6
+#define INA_SCL_PIN 10
 
 // NVS keys
 #define NVS_CAL_NAMESPACE "ina_cal"
@@ -15,10 +17,55 @@
 #define NVS_KEY_LOW_VOLTAGE_CUTOFF "lv_cutoff"
 #define NVS_KEY_HYSTERESIS "hysteresis"
 #define NVS_KEY_OVERCURRENT "oc_thresh"
+#define NVS_KEY_LV_IR_COMPENSATION "lv_ir_comp"
+#define NVS_KEY_SLEEP_CURRENT "sleep_ma"
+#define NVS_KEY_OC_TRIP_TIME_2X "oc_t2x"
+#define NVS_KEY_OC_INSTANT_MULTIPLE "oc_inst"
+#define NVS_KEY_LV_DEBOUNCE "lv_debounce"
+#define NVS_KEY_OVERVOLTAGE "ov_cutoff"
+#define NVS_KEY_POWER_LIMIT "power_lim"
+#define NVS_KEY_OC_RETRIES "oc_retries"
+#define NVS_KEY_OC_COOLDOWN "oc_cooldown"
+#define NVS_SOC_JOURNAL_NAMESPACE "soc_jrnl"
+#define NVS_BATTERY_MODEL_NAMESPACE "bat_model"
+#define NVS_KEY_PEUKERT "peukert"
+#define NVS_KEY_CHARGE_EFFICIENCY "ch_eff"
+#define NVS_KEY_RATED_HOURS "rated_h"
+#define NVS_KEY_RUN_FLAT_TAU "rf_tau_s"
+#define NVS_CHARGE_DETECT_NAMESPACE "charge_det"
+#define NVS_KEY_CHARGED_VOLTAGE "chg_v"
+#define NVS_KEY_TAIL_PERCENT "tail_pct"
+#define NVS_KEY_CHARGED_DWELL "dwell_s"
+#define NVS_KEY_FULL_CHARGE_COUNT "full_cnt"
+#define NVS_KEY_FULL_CHARGE_ARMED "full_arm"
+#define NVS_LIFETIME_NAMESPACE "lifetime"
+#define NVS_KEY_LIFETIME_STATS "stats"
+#define NVS_SOH_NAMESPACE "soh"
+#define NVS_KEY_LEARNED_CAPACITY "cap_ah"
+#define NVS_KEY_CAPACITY_ESTIMATES "cap_n"
+#define NVS_RAINFLOW_NAMESPACE "rainflow"
+#define NVS_KEY_RAINFLOW "hist"
+#define NVS_LOAD_PROFILE_NAMESPACE "load_prof"
+#define NVS_KEY_LOAD_PROFILE "bins"
+#define NVS_CLOCK_NAMESPACE "clock"
+#define NVS_KEY_UTC_OFFSET "utc_off"
 
 #define I2C_ADDRESS 0x40
 const int scanTime = 5;
 
+struct CalPoint {
+    float raw_mA;   // raw measured current from INA226 (mA)
+    float true_mA;  // ground-truth current (mA)
+};
+
+// Factory calibration compiled into flash (see factory_cal_tables.h)
+struct FactoryCalTable {
+    uint16_t shuntRatedA;    // shunt rating this table belongs to (0 terminates the list)
+    float shuntOhms;         // calibrated shunt resistance, 0 if not supplied
+    const CalPoint *points;  // sorted by raw_mA
+    uint16_t count;
+};
+
 extern uint8_t broadcastAddress[6];
 
 typedef struct {
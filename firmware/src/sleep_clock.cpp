@@ -0,0 +1,106 @@
+#include "sleep_clock.h"
+#include "soc_journal.h"
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef UNIT_TEST
+#include <soc/rtc.h>
+#endif
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR    // host builds: plain static memory
+#endif
+
+struct SleepRecord {
+    uint64_t ticksAtSleep;
+    uint64_t totalSlept_us;
+    uint64_t ticksAtCalibration; // last period measurement, reused if recent
+    uint32_t periodAtCalibration;
+    uint32_t periodAtSleep;     // Q19 us
+    uint32_t sleepCurrent_uA;
+    uint8_t asleep;
+    uint8_t reserved[3];
+    uint32_t magic;
+    uint32_t crc;               // CRC-32 of all fields above
+};
+
+static const uint32_t sleepRecordMagic = 0x534C5043; // "SLPC"
+
+RTC_NOINIT_ATTR static SleepRecord sleepRecord;
+
+static bool recordValid() {
+    return sleepRecord.magic == sleepRecordMagic &&
+           SocJournal::crc32(&sleepRecord, offsetof(SleepRecord, crc)) == sleepRecord.crc;
+}
+
+static void sealRecord() {
+    sleepRecord.magic = sleepRecordMagic;
+    sleepRecord.crc = SocJournal::crc32(&sleepRecord, offsetof(SleepRecord, crc));
+}
+
+#ifdef UNIT_TEST
+static uint64_t hostTicks = 0;
+static uint32_t hostPeriod = 0;
+
+void SleepClock::setHostClock(uint64_t ticks, uint32_t periodQ19) {
+    hostTicks = ticks;
+    hostPeriod = periodQ19;
+}
+
+uint32_t SleepClock::calibrate() { return hostPeriod; }
+uint64_t SleepClock::readTicks() { return hostTicks; }
+#else
+uint32_t SleepClock::calibrate() { return rtc_clk_cal(RTC_CAL_RTC_MUX, 1024); }
+uint64_t SleepClock::readTicks() { return rtc_time_get(); }
+#endif
+
+uint64_t SleepClock::ticksToMicros(uint64_t ticks, uint32_t periodQ19) {
+    // Split so ticks * period cannot overflow for any realistic sleep
+    return (ticks >> 19) * periodQ19 + (((ticks & 0x7FFFFu) * periodQ19) >> 19);
+}
+
+void SleepClock::beginSleep(uint32_t sleepCurrent_uA) {
+    const bool valid = recordValid();
+    const uint64_t total = valid ? sleepRecord.totalSlept_us : 0;
+    uint64_t ticks = readTicks();
+    uint32_t period = 0;
+    if (valid && sleepRecord.periodAtCalibration != 0 && ticks >= sleepRecord.ticksAtCalibration &&
+        ticksToMicros(ticks - sleepRecord.ticksAtCalibration, sleepRecord.periodAtCalibration) < calibrationReuse_us) {
+        period = sleepRecord.periodAtCalibration;
+    } else {
+        period = calibrate();
+        ticks = readTicks();
+    }
+    memset(&sleepRecord, 0, sizeof(sleepRecord));
+    sleepRecord.periodAtSleep = period;
+    sleepRecord.ticksAtSleep = ticks;
+    sleepRecord.totalSlept_us = total;
+    sleepRecord.sleepCurrent_uA = sleepCurrent_uA;
+    sleepRecord.asleep = 1;
+    sealRecord();
+}
+
+bool SleepClock::endSleep(uint64_t &slept_us, uint32_t &sleepCurrent_uA) {
+    if (!recordValid() || !sleepRecord.asleep) return false;
+    sleepRecord.asleep = 0;
+
+    const uint64_t now = readTicks();
+    const uint32_t period = calibrate();
+    bool ok = now >= sleepRecord.ticksAtSleep && period != 0 && sleepRecord.periodAtSleep != 0;
+    if (ok) {
+        // The clock drifted somewhere between the two measurements: use the mean
+        const uint32_t mean = (uint32_t)(((uint64_t)period + sleepRecord.periodAtSleep) / 2);
+        slept_us = ticksToMicros(now - sleepRecord.ticksAtSleep, mean);
+        sleepCurrent_uA = sleepRecord.sleepCurrent_uA;
+        sleepRecord.totalSlept_us += slept_us;
+        sleepRecord.ticksAtCalibration = now;
+        sleepRecord.periodAtCalibration = period;
+    }
+    sealRecord();
+    return ok;
+}
+
+uint64_t SleepClock::totalSlept_us() {
+    return recordValid() ? sleepRecord.totalSlept_us : 0;
+}
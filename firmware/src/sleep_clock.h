@@ -0,0 +1,43 @@
+#ifndef SLEEP_CLOCK_H
+#define SLEEP_CLOCK_H
+
+#include <stdint.h>
+
+// Sleep-aware timebase.
+//
+// millis() restarts at every wake and the deep-sleep timer runs from the RC
+// slow clock, whose frequency drifts several percent with temperature. Before
+// sleeping, the slow-clock tick count and its period (measured against the
+// main crystal, ESP-IDF's Q19 microsecond format) go into RTC memory. On wake
+// the period is measured again and the ticks in between are converted with the
+// average of both, so a long LVD sleep is timed to the crystal's accuracy. The
+// caller credits the estimated sleep current for that time to the counter,
+// and SOC declines smoothly instead of jumping at the next OCV resync.
+//
+// A period measured less than calibrationReuse_us before the next sleep (the
+// LVD fast wake goes straight back to sleep) is reused instead of measured
+// again, which halves the time that wake spends calibrating.
+class SleepClock {
+public:
+    static const uint32_t calibrationReuse_us = 1000000;
+
+    // Slow-clock period in microseconds, Q19 fixed point (blocks ~8 ms)
+    static uint32_t calibrate();
+    static uint64_t readTicks();
+
+    // Call right before esp_deep_sleep_start()
+    static void beginSleep(uint32_t sleepCurrent_uA);
+    // Call once after a reset. True if it followed a timed sleep: slept_us and
+    // the current recorded at sleep time are filled in.
+    static bool endSleep(uint64_t &slept_us, uint32_t &sleepCurrent_uA);
+    // All sleep since the RTC domain last lost power
+    static uint64_t totalSlept_us();
+
+    static uint64_t ticksToMicros(uint64_t ticks, uint32_t periodQ19);
+
+#ifdef UNIT_TEST
+    static void setHostClock(uint64_t ticks, uint32_t periodQ19);
+#endif
+};
+
+#endif // SLEEP_CLOCK_H
@@ -0,0 +1,124 @@
+#include "soc_ekf.h"
+#include <math.h>
+
+SocEkf::SocEkf()
+    : m_params{0.005f, 60.0f, 0.01f, 1e-10f, 1e-6f, 0.02f},
+      m_curve(nullptr),
+      m_count(0),
+      m_started(false),
+      m_lastMs(0),
+      m_lastDt_s(-1.0f),
+      m_a(0.0f),
+      m_lastInnovation_V(0.0f),
+      m_lastCorrection(0.0f)
+{
+    m_curve = DefaultChemistry::ocvCurve(m_count);
+    reset(1.0f, 0.3f, 0.01f);
+}
+
+void SocEkf::setCurve(const OcvPoint *points, size_t count) {
+    m_curve = points;
+    m_count = count;
+}
+
+void SocEkf::reset(float soc, float socSigma, float r0_Ohm) {
+    m_x[0] = soc;
+    m_x[1] = r0_Ohm;
+    m_x[2] = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) m_P[i][j] = 0.0f;
+    }
+    m_P[0][0] = socSigma * socSigma;
+    m_P[1][1] = (0.5f * r0_Ohm) * (0.5f * r0_Ohm);
+    m_P[2][2] = 0.05f * 0.05f;
+    m_started = false;
+}
+
+void SocEkf::setSoc(float soc, float socSigma) {
+    m_x[0] = soc;
+    m_P[0][0] = socSigma * socSigma;
+    m_P[0][1] = m_P[1][0] = 0.0f;
+    m_P[0][2] = m_P[2][0] = 0.0f;
+}
+
+float SocEkf::socSigma() const { return sqrtf(m_P[0][0]); }
+
+float SocEkf::ocvFromSoc(float soc, float &dVdSoc) const {
+    dVdSoc = 0.0f;
+    if (m_count == 0) return 0.0f;
+    if (soc <= m_curve[0].soc) return m_curve[0].volts;
+    if (soc >= m_curve[m_count - 1].soc) return m_curve[m_count - 1].volts;
+    for (size_t i = 1; i < m_count; ++i) {
+        if (soc < m_curve[i].soc) {
+            const OcvPoint &a = m_curve[i - 1];
+            const OcvPoint &b = m_curve[i];
+            dVdSoc = (b.volts - a.volts) / (b.soc - a.soc);
+            return a.volts + (soc - a.soc) * dVdSoc;
+        }
+    }
+    return m_curve[m_count - 1].volts;
+}
+
+void SocEkf::update(float deltaSoc, float currentA, float busVoltage_V, uint32_t nowMs) {
+    m_lastCorrection = 0.0f;
+    if (!m_started) {
+        m_started = true;
+        m_lastMs = nowMs;
+        return;
+    }
+    const float dt = (float)(nowMs - m_lastMs) / 1000.0f;
+    m_lastMs = nowMs;
+    if (dt <= 0.0f) return;
+    if (dt != m_lastDt_s) {
+        m_a = expf(-dt / m_params.tau_s);
+        m_lastDt_s = dt;
+    }
+    const float a = m_a;
+
+    // --- Predict. F = diag(1, 1, a), so F P F' only scales row/column 2 ---
+    m_x[0] += deltaSoc;
+    m_x[2] = a * m_x[2] + (1.0f - a) * m_params.r1_Ohm * currentA;
+    const float qSoc = m_params.socProcessRel * deltaSoc;
+    m_P[0][0] += qSoc * qSoc + 1e-9f * dt;
+    m_P[1][1] += m_params.r0ProcessPerS * dt;
+    m_P[0][2] *= a;
+    m_P[1][2] *= a;
+    m_P[2][2] = a * a * m_P[2][2] + m_params.vpProcessPerS * dt;
+    m_P[2][0] = m_P[0][2];
+    m_P[2][1] = m_P[1][2];
+    const float prior = m_x[0];
+
+    if (busVoltage_V >= 5.25f && m_count > 0) {
+        // --- Update. H = [dOCV/dSOC, -I, -1] ---
+        float h0;
+        const float predicted = ocvFromSoc(m_x[0], h0) - m_x[1] * currentA - m_x[2];
+        const float h1 = -currentA;
+        const float y = busVoltage_V - predicted;
+
+        // PH' (column) and S = H P H' + R
+        float ph[3];
+        for (int i = 0; i < 3; ++i) ph[i] = m_P[i][0] * h0 + m_P[i][1] * h1 - m_P[i][2];
+        const float s = h0 * ph[0] + h1 * ph[1] - ph[2] + m_params.voltageNoise_V * m_params.voltageNoise_V;
+        if (s > 0.0f) {
+            const float invS = 1.0f / s;
+            float k[3];
+            for (int i = 0; i < 3; ++i) k[i] = ph[i] * invS;
+            for (int i = 0; i < 3; ++i) m_x[i] += k[i] * y;
+            // P -= K (PH')'; symmetric by construction
+            for (int i = 0; i < 3; ++i) {
+                for (int j = i; j < 3; ++j) {
+                    m_P[i][j] -= k[i] * ph[j];
+                    m_P[j][i] = m_P[i][j];
+                }
+            }
+            m_lastInnovation_V = y;
+        }
+    }
+
+    // Keep the state physical
+    if (m_x[0] < 0.0f) m_x[0] = 0.0f;
+    if (m_x[0] > 1.0f) m_x[0] = 1.0f;
+    if (m_x[1] < 0.0001f) m_x[1] = 0.0001f;
+    if (m_x[1] > 0.5f) m_x[1] = 0.5f;
+    m_lastCorrection = m_x[0] - prior;
+}
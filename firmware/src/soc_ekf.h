@@ -0,0 +1,74 @@
+#ifndef SOC_EKF_H
+#define SOC_EKF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "battery_model.h"
+
+// Extended Kalman filter SOC estimator (optional, build with -DUSE_SOC_EKF).
+//
+// State x = [SOC, R0, Vp]: state of charge, ohmic resistance and the voltage
+// across a single RC polarisation branch (R1, tau). The process model is the
+// coulomb counter: SOC moves by exactly what the counter integrated, R0 is a
+// slow random walk and Vp relaxes towards R1 * I. The measurement is the
+// terminal voltage, V = OCV(SOC) - R0 * I - Vp, with OCV from the chemistry
+// curve (battery_model.h). Under load this keeps correcting SOC a little every
+// sample, where the OCV resync has to wait hours for a rest.
+//
+// The ESP32-C3 is single core with soft float, so everything is a fixed 3x3
+// float matrix written out by hand: F is diagonal, H is a row, the gain is a
+// column, and one update costs a few dozen multiplies plus one OCV lookup.
+// exp(-dt/tau) is only recomputed when the sample interval changes.
+struct SocEkfParams {
+    float r1_Ohm;           // polarisation resistance
+    float tau_s;            // polarisation time constant
+    float socProcessRel;    // counter error per unit of SOC moved (1-sigma)
+    float r0ProcessPerS;    // R0 random-walk variance per second (Ohm^2/s)
+    float vpProcessPerS;    // Vp model error variance per second (V^2/s)
+    float voltageNoise_V;   // measurement 1-sigma
+};
+
+class SocEkf {
+public:
+    SocEkf();
+
+    void setParams(const SocEkfParams &params) { m_params = params; m_lastDt_s = -1.0f; }
+    const SocEkfParams &params() const { return m_params; }
+    void setCurve(const OcvPoint *points, size_t count);
+
+    // Start (or restart) from a known SOC with 1-sigma uncertainty socSigma
+    void reset(float soc, float socSigma, float r0_Ohm);
+    // Another source (full charge, OCV resync) has fixed SOC: take it, keep R0 and Vp
+    void setSoc(float soc, float socSigma);
+
+    // One sample. deltaSoc is what the coulomb counter moved since the last
+    // call; currentA is measured (positive = discharge). busVoltage_V below
+    // 5.25V (USB power, no battery) only runs the prediction.
+    void update(float deltaSoc, float currentA, float busVoltage_V, uint32_t nowMs);
+
+    float soc() const { return m_x[0]; }
+    float r0_Ohm() const { return m_x[1]; }
+    float polarisation_V() const { return m_x[2]; }
+    float socSigma() const;
+    float lastInnovation_V() const { return m_lastInnovation_V; }
+    // SOC moved by the last measurement update (posterior - prior), 0 if none
+    float lastCorrection() const { return m_lastCorrection; }
+
+    // Piecewise-linear OCV(SOC) and dOCV/dSOC of the segment used
+    float ocvFromSoc(float soc, float &dVdSoc) const;
+
+private:
+    SocEkfParams m_params;
+    const OcvPoint *m_curve;
+    size_t m_count;
+    float m_x[3];
+    float m_P[3][3];
+    bool m_started;
+    uint32_t m_lastMs;
+    float m_lastDt_s;
+    float m_a;              // exp(-dt / tau) for m_lastDt_s
+    float m_lastInnovation_V;
+    float m_lastCorrection;
+};
+
+#endif // SOC_EKF_H
@@ -0,0 +1,115 @@
+#include "soc_journal.h"
+#include "shared_defs.h"
+#include <Preferences.h>
+#include <stdio.h>
+
+static void slotKey(uint8_t slot, char *key, size_t len) {
+    snprintf(key, len, "s%u", (unsigned)slot);
+}
+
+static bool recordValid(const SocJournalRecord &r) {
+    return SocJournal::crc32(&r, offsetof(SocJournalRecord, crc)) == r.crc;
+}
+
+SocJournal::SocJournal()
+    : m_minDeltaFraction(0.005f),
+      m_minIntervalMs(60UL * 1000UL),
+      m_heartbeatMs(6UL * 60UL * 60UL * 1000UL),
+      m_nextSlot(0),
+      m_nextSeq(1),
+      m_lastSaved_nAs(-1),
+      m_lastWriteMs(0),
+      m_scanned(false)
+{
+}
+
+uint32_t SocJournal::crc32(const void *data, size_t len) {
+    // Bitwise CRC-32 (IEEE, reflected); records are tiny so no table needed
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+void SocJournal::setPolicy(float minDeltaFraction, uint32_t minIntervalMs, uint32_t heartbeatMs) {
+    m_minDeltaFraction = minDeltaFraction;
+    m_minIntervalMs = minIntervalMs;
+    m_heartbeatMs = heartbeatMs;
+}
+
+bool SocJournal::restore(SocJournalRecord &out) {
+    Preferences prefs;
+    prefs.begin(NVS_SOC_JOURNAL_NAMESPACE, true);
+    bool found = false;
+    uint8_t bestSlot = 0;
+    for (uint8_t slot = 0; slot < slotCount; ++slot) {
+        char key[8];
+        slotKey(slot, key, sizeof(key));
+        SocJournalRecord r;
+        if (prefs.getBytes(key, &r, sizeof(r)) != sizeof(r) || !recordValid(r)) continue;
+        // Wrap-safe "newer than"
+        if (!found || (int32_t)(r.seq - out.seq) > 0) {
+            out = r;
+            bestSlot = slot;
+            found = true;
+        }
+    }
+    prefs.end();
+
+    m_scanned = true;
+    if (found) {
+        m_nextSlot = (uint8_t)((bestSlot + 1) % slotCount);
+        m_nextSeq = out.seq + 1;
+        m_lastSaved_nAs = out.remaining_nAs;
+    }
+    return found;
+}
+
+bool SocJournal::update(const CoulombCounter &cc, uint32_t nowMs) {
+    if (m_lastSaved_nAs < 0) return save(cc, nowMs);   // nothing journalled yet
+
+    const uint32_t sinceWrite = nowMs - m_lastWriteMs;
+    if (sinceWrite < m_minIntervalMs) return false;
+
+    int64_t moved = cc.remaining_nAs() - m_lastSaved_nAs;
+    if (moved < 0) moved = -moved;
+    const int64_t minDelta = (int64_t)((double)cc.capacity_nAs() * m_minDeltaFraction);
+    if (moved >= minDelta || (moved > 0 && sinceWrite >= m_heartbeatMs)) {
+        return save(cc, nowMs);
+    }
+    return false;
+}
+
+bool SocJournal::save(const CoulombCounter &cc, uint32_t nowMs) {
+    if (!m_scanned) {
+        // Never overwrite the newest record before knowing which slot holds it
+        SocJournalRecord ignored;
+        restore(ignored);
+    }
+
+    SocJournalRecord r;
+    r.remaining_nAs = cc.remaining_nAs();
+    r.chargeIn_nAs = cc.chargeIn_nAs();
+    r.chargeOut_nAs = cc.chargeOut_nAs();
+    r.seq = m_nextSeq;
+    r.crc = crc32(&r, offsetof(SocJournalRecord, crc));
+
+    char key[8];
+    slotKey(m_nextSlot, key, sizeof(key));
+    Preferences prefs;
+    prefs.begin(NVS_SOC_JOURNAL_NAMESPACE, false);
+    size_t written = prefs.putBytes(key, &r, sizeof(r));
+    prefs.end();
+    if (written != sizeof(r)) return false;
+
+    m_nextSlot = (uint8_t)((m_nextSlot + 1) % slotCount);
+    m_nextSeq++;
+    m_lastSaved_nAs = r.remaining_nAs;
+    m_lastWriteMs = nowMs;
+    return true;
+}
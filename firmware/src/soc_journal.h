@@ -0,0 +1,58 @@
+#ifndef SOC_JOURNAL_H
+#define SOC_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "coulomb_counter.h"
+
+// Wear-levelled state-of-charge journal in NVS.
+//
+// Records go round-robin into slotCount blob keys (s0..sN) of their own
+// namespace, each carrying a sequence number and CRC-32. A record is written
+// only when remaining charge moved by at least minDelta since the last one, and
+// never more often than minInterval (plus a slow heartbeat so small drifts are
+// eventually saved). Boot reads every slot once and restores the valid record
+// with the highest sequence number; a torn or corrupt write just falls back to
+// the previous slot.
+struct SocJournalRecord {
+    int64_t remaining_nAs;
+    uint64_t chargeIn_nAs;
+    uint64_t chargeOut_nAs;
+    uint32_t seq;
+    uint32_t crc;           // CRC-32 of all fields above
+};
+
+class SocJournal {
+public:
+    static const uint8_t slotCount = 8;
+
+    SocJournal();
+
+    // Scan all slots; true and out filled if any valid record exists. Also sets
+    // up where the next record goes.
+    bool restore(SocJournalRecord &out);
+
+    // minDeltaFraction of rated capacity, e.g. 0.005 = 0.5 %
+    void setPolicy(float minDeltaFraction, uint32_t minIntervalMs, uint32_t heartbeatMs);
+
+    // Call every sample. Returns true if a record was written.
+    bool update(const CoulombCounter &cc, uint32_t nowMs);
+    // Write now regardless of policy (before OTA, on shutdown)
+    bool save(const CoulombCounter &cc, uint32_t nowMs);
+
+    uint32_t lastSeq() const { return m_nextSeq - 1; }
+
+    static uint32_t crc32(const void *data, size_t len);
+
+private:
+    float m_minDeltaFraction;
+    uint32_t m_minIntervalMs;
+    uint32_t m_heartbeatMs;
+    uint8_t m_nextSlot;
+    uint32_t m_nextSeq;
+    int64_t m_lastSaved_nAs;
+    uint32_t m_lastWriteMs;
+    bool m_scanned;
+};
+
+#endif // SOC_JOURNAL_H
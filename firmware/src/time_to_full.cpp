@@ -0,0 +1,87 @@
+#include "time_to_full.h"
+#include "charge_detector.h"
+#include <math.h>
+
+TimeToFull::TimeToFull()
+    : m_phase(IDLE),
+      m_tau_s(0.0f),
+      m_hours(-1.0f),
+      m_cvStartMs(0),
+      m_n(0.0), m_sumT(0.0), m_sumY(0.0), m_sumTT(0.0), m_sumTY(0.0),
+      m_lastT(0.0f)
+{
+}
+
+void TimeToFull::resetFit() {
+    m_n = m_sumT = m_sumY = m_sumTT = m_sumTY = 0.0;
+    m_lastT = 0.0f;
+}
+
+bool TimeToFull::fit(float &tau_s, float &fittedA) const {
+    if (m_n < 3.0 || m_lastT < minFitSeconds) return false;
+    const double denom = m_n * m_sumTT - m_sumT * m_sumT;
+    if (denom <= 0.0) return false;
+    const double slope = (m_n * m_sumTY - m_sumT * m_sumY) / denom;
+    if (!(slope < 0.0)) return false;       // not tapering (yet)
+    const double tau = -1.0 / slope;
+    if (tau < minTau_s || tau > maxTau_s) return false;
+    const double intercept = (m_sumY - slope * m_sumT) / m_n;
+    tau_s = (float)tau;
+    fittedA = (float)exp(intercept + slope * m_lastT);
+    return true;
+}
+
+void TimeToFull::update(float currentA, float busVoltage_V, float ahToFull, uint32_t nowMs,
+                        const ChargeDetector &target) {
+    const float chargeA = -currentA;
+    const float tailA = target.tailCurrent_A();
+
+    // Charge ends (or never started): a CV fit stays as the learned tau
+    if (chargeA < tailA || busVoltage_V < 5.25f) {
+        m_phase = IDLE;
+        m_hours = -1.0f;
+        resetFit();
+        return;
+    }
+
+    if (m_phase != CV && busVoltage_V >= target.params().chargedVoltage) {
+        m_phase = CV;
+        m_cvStartMs = nowMs;
+        resetFit();
+    } else if (m_phase == IDLE) {
+        m_phase = CC;
+    }
+
+    const float dwell_s = (float)target.params().dwellSeconds;
+    float seconds = -1.0f;
+    if (m_phase == CV) {
+        const float t = (float)(nowMs - m_cvStartMs) / 1000.0f;
+        const double y = log((double)chargeA);
+        m_n += 1.0;
+        m_sumT += t;
+        m_sumY += y;
+        m_sumTT += (double)t * t;
+        m_sumTY += (double)t * y;
+        m_lastT = t;
+
+        float tau, fittedA;
+        if (fit(tau, fittedA)) {
+            m_tau_s = tau;
+            seconds = fittedA > tailA ? tau * logf(fittedA / tailA) : 0.0f;
+        } else if (hasTau()) {
+            seconds = m_tau_s * logf(chargeA / tailA);
+        }
+    } else if (hasTau()) {
+        // Charge the taper will put in from the present current, the rest at CC
+        const float taperAh = m_tau_s * (chargeA - tailA) / 3600.0f;
+        const float ccAh = ahToFull > taperAh ? ahToFull - taperAh : 0.0f;
+        seconds = ccAh / chargeA * 3600.0f + m_tau_s * logf(chargeA / tailA);
+    }
+
+    if (seconds < 0.0f) {
+        // Nothing learned yet: constant current to full
+        m_hours = ahToFull > 0.0f ? ahToFull / chargeA : 0.0f;
+    } else {
+        m_hours = (seconds + dwell_s) / 3600.0f;
+    }
+}
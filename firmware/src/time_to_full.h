@@ -0,0 +1,60 @@
+#ifndef TIME_TO_FULL_H
+#define TIME_TO_FULL_H
+
+#include <stdint.h>
+
+class ChargeDetector;
+
+// Charging time-to-full with a constant-voltage taper model.
+//
+// A charger holds constant current (CC) until the battery reaches its
+// absorption voltage, then holds the voltage (CV) while the current decays
+// roughly as I(t) = I0 * exp(-t / tau) down to the tail current that ends the
+// charge (charge_detector.h). Dividing the missing Ah by the present current
+// ignores that taper and reads far too short once absorption starts.
+//
+// The CC/CV transition is taken as the bus voltage reaching the detector's
+// charged voltage while charging. From then on ln(I) is fitted against time
+// by least squares, with running sums updated in O(1) per sample; the slope
+// gives tau. The prediction is re-evaluated every sample:
+//   CV: tau * ln(I_fit / I_tail) + dwell
+//   CC: missing Ah not covered by the taper at the present current, then the
+//       taper, using tau from the last absorption
+// Without any tau yet it falls back to missing Ah / current. tau is kept in
+// RAM only and re-learned on every absorption.
+class TimeToFull {
+public:
+    static constexpr float minFitSeconds = 120.0f;  // CV time before the fit is trusted
+    static constexpr float minTau_s = 60.0f;
+    static constexpr float maxTau_s = 48.0f * 3600.0f;
+
+    TimeToFull();
+
+    // Call every sample (current positive = discharge). ahToFull is the
+    // charge still missing; target supplies charged voltage, tail and dwell.
+    void update(float currentA, float busVoltage_V, float ahToFull, uint32_t nowMs,
+                const ChargeDetector &target);
+
+    bool isCharging() const { return m_phase != IDLE; }
+    bool inAbsorption() const { return m_phase == CV; }
+    bool hasPrediction() const { return m_hours >= 0.0f; }
+    float hours() const { return m_hours; }             // < 0 when not charging
+    bool hasTau() const { return m_tau_s > 0.0f; }
+    float tau_s() const { return m_tau_s; }
+
+private:
+    enum Phase : uint8_t { IDLE, CC, CV };
+
+    void resetFit();
+    bool fit(float &tau_s, float &fittedA) const;
+
+    Phase m_phase;
+    float m_tau_s;          // 0 until learned
+    float m_hours;
+    uint32_t m_cvStartMs;
+    // Least-squares sums of y = ln(I) over t = seconds since CV start
+    double m_n, m_sumT, m_sumY, m_sumTT, m_sumTY;
+    float m_lastT;
+};
+
+#endif // TIME_TO_FULL_H
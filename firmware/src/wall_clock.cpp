@@ -0,0 +1,76 @@
+#include "wall_clock.h"
+#include "shared_defs.h"
+#include <Arduino.h>
+#include <Preferences.h>
+
+#ifndef UNIT_TEST
+#include <sys/time.h>
+#endif
+
+static int32_t s_utcOffsetMinutes = 0;
+
+#ifdef UNIT_TEST
+// Host builds: the epoch advances with the mocked millis()
+static uint32_t s_hostEpoch = 0;
+static uint32_t s_hostSetMs = 0;
+
+void WallClock::clearHostClock() {
+    s_hostEpoch = 0;
+    s_utcOffsetMinutes = 0;
+}
+
+static void writeClock(uint32_t epoch) {
+    s_hostEpoch = epoch;
+    s_hostSetMs = (uint32_t)millis();
+}
+
+static uint32_t readClock() {
+    if (s_hostEpoch == 0) return 0;
+    return s_hostEpoch + ((uint32_t)millis() - s_hostSetMs) / 1000UL;
+}
+#else
+static void writeClock(uint32_t epoch) {
+    struct timeval tv = {(time_t)epoch, 0};
+    settimeofday(&tv, nullptr);
+}
+
+static uint32_t readClock() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint32_t)tv.tv_sec;
+}
+#endif
+
+bool WallClock::set(uint32_t epochSeconds, int32_t utcOffsetMinutes) {
+    if (epochSeconds < minValidEpoch) return false;
+    if (utcOffsetMinutes < -14 * 60 || utcOffsetMinutes > 14 * 60) return false;
+    writeClock(epochSeconds);
+    s_utcOffsetMinutes = utcOffsetMinutes;
+    Preferences prefs;
+    prefs.begin(NVS_CLOCK_NAMESPACE, false);
+    prefs.putInt(NVS_KEY_UTC_OFFSET, utcOffsetMinutes);
+    prefs.end();
+    return true;
+}
+
+void WallClock::loadOffset() {
+    Preferences prefs;
+    prefs.begin(NVS_CLOCK_NAMESPACE, true);
+    s_utcOffsetMinutes = prefs.getInt(NVS_KEY_UTC_OFFSET, 0);
+    prefs.end();
+}
+
+bool WallClock::isSet() { return readClock() >= minValidEpoch; }
+
+uint32_t WallClock::now() {
+    const uint32_t epoch = readClock();
+    return epoch >= minValidEpoch ? epoch : 0;
+}
+
+int32_t WallClock::utcOffsetMinutes() { return s_utcOffsetMinutes; }
+
+uint32_t WallClock::localSecondOfDay() {
+    const int64_t local = (int64_t)readClock() + (int64_t)s_utcOffsetMinutes * 60;
+    const int64_t sod = local % 86400;
+    return (uint32_t)(sod < 0 ? sod + 86400 : sod);
+}
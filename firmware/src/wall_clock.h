@@ -0,0 +1,29 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <stdint.h>
+
+// Local time of day for the load profile.
+//
+// The shunt has no network time; the host (serial menu 't') supplies the Unix
+// epoch and the local UTC offset. The epoch goes into the ESP32 system clock,
+// which the RTC keeps running through deep sleep and soft resets; only a power
+// loss clears it, after which isSet() is false until the host sets it again.
+// The UTC offset is saved in NVS.
+class WallClock {
+public:
+    static const uint32_t minValidEpoch = 1704067200UL;    // 2024-01-01: earlier means never set
+
+    static bool set(uint32_t epochSeconds, int32_t utcOffsetMinutes);   // saves the offset
+    static void loadOffset();
+    static bool isSet();
+    static uint32_t now();                  // Unix seconds, 0 if not set
+    static int32_t utcOffsetMinutes();
+    static uint32_t localSecondOfDay();     // 0..86399
+
+#ifdef UNIT_TEST
+    static void clearHostClock();
+#endif
+};
+
+#endif // WALL_CLOCK_H
@@ -1,11 +1,18 @@
 #include "Arduino.h"
 
 static unsigned long mock_millis_value = 0;
+static std::map<int, int> mock_pin_values;
+static bool mock_deep_sleep_called = false;
+static uint64_t mock_sleep_timer_us = 0;
 
 unsigned long millis() {
     return mock_millis_value;
 }
 
+unsigned long micros() {
+    return mock_millis_value * 1000UL;
+}
+
 void set_mock_millis(unsigned long value) {
     mock_millis_value = value;
 }
@@ -14,4 +21,47 @@ void delay(unsigned long ms) {
     mock_millis_value += ms;
 }
 
+void delayMicroseconds(unsigned int us) {}
+
+void pinMode(int pin, int mode) {}
+
+void digitalWrite(int pin, int value) {
+    mock_pin_values[pin] = value;
+}
+
+int digitalRead(int pin) {
+    std::map<int, int>::const_iterator it = mock_pin_values.find(pin);
+    return it == mock_pin_values.end() ? HIGH : it->second;
+}
+
+void mock_digital_write_clear() {
+    mock_pin_values.clear();
+}
+
+int mock_digital_write_get_last_value(int pin) {
+    std::map<int, int>::const_iterator it = mock_pin_values.find(pin);
+    return it == mock_pin_values.end() ? -1 : it->second;
+}
+
+void esp_sleep_enable_timer_wakeup(uint64_t time_us) {
+    mock_sleep_timer_us = time_us;
+}
+
+void esp_deep_sleep_start() {
+    mock_deep_sleep_called = true;
+}
+
+void mock_esp_deep_sleep_clear() {
+    mock_deep_sleep_called = false;
+    mock_sleep_timer_us = 0;
+}
+
+bool mock_esp_deep_sleep_called() {
+    return mock_deep_sleep_called;
+}
+
+uint64_t mock_esp_sleep_timer_us() {
+    return mock_sleep_timer_us;
+}
+
 MockSerial Serial;
@@ -5,39 +5,92 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <map>
 #include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
-// Mock millis() function
+using std::isnan;
+
+// Attributes and macros from the ESP32 core that have no meaning on the host
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define F(x) x
+
+#define DEC 10
+#define HEX 16
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define FALLING 2
+
+// Mock millis() function; micros() follows it
 unsigned long millis();
+unsigned long micros();
 void set_mock_millis(unsigned long value);
 
 void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// GPIO: writes are recorded per pin, reads return the last write (HIGH if none)
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int pin, void (*isr)(), int mode) {}
+
+// Test helpers
+void mock_digital_write_clear();
+int mock_digital_write_get_last_value(int pin);   // -1 if never written
+
+// Deep sleep: records the timer and the call instead of sleeping
+void esp_sleep_enable_timer_wakeup(uint64_t time_us);
+void esp_deep_sleep_start();
+
+// Test helpers
+void mock_esp_deep_sleep_clear();
+bool mock_esp_deep_sleep_called();
+uint64_t mock_esp_sleep_timer_us();
+
+class String;
 
 class MockSerial {
 public:
     void begin(int speed) {}
-    void print(const char* msg) { std::cout << msg; }
-    void print(const std::string& msg) { std::cout << msg; }
-    void print(int val) { std::cout << val; }
-    void print(size_t val) { std::cout << val; }
-    void print(float val) { std::cout << val; }
-    void println(const char* msg) { std::cout << msg << std::endl; }
-    void println(const std::string& msg) { std::cout << msg << std::endl; }
-    void println(int val) { std::cout << val << std::endl; }
-    void println(float val) { std::cout << val << std::endl; }
-    void println() { std::cout << std::endl; }
+    int available() { return 0; }
+    int read() { return -1; }
+    String readStringUntil(char terminator);
+    template<typename T>
+    void print(const T& value) { std::cout << value; }
+    void print(int value, int base) { printBase(value, base); }
+    void print(uint16_t value, int base) { printBase(value, base); }
     template<typename T>
-    void printf(const char* format, T value) {
-        // A very basic printf mock
-        char buffer[256];
-        snprintf(buffer, sizeof(buffer), format, value);
-        std::cout << buffer;
+    void println(const T& value) { std::cout << value << std::endl; }
+    void println(int value, int base) { printBase(value, base); std::cout << std::endl; }
+    void println(uint16_t value, int base) { printBase(value, base); std::cout << std::endl; }
+    void println() { std::cout << std::endl; }
+    void printf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
     }
-     template<typename T1, typename T2>
-    void printf(const char* format, T1 val1, T2 val2) {
-        char buffer[256];
-        snprintf(buffer, sizeof(buffer), format, val1, val2);
-        std::cout << buffer;
+    void write(const char* data, size_t len) { std::cout.write(data, len); }
+    void flush() { std::cout.flush(); }
+
+private:
+    void printBase(long value, int base) {
+        if (base == HEX) {
+            std::cout << std::hex << value << std::dec;
+        } else {
+            std::cout << value;
+        }
     }
 };
 
@@ -58,12 +111,12 @@ public:
 
     void trim() {
         // basic trim mock
-        size_t first = this->find_first_not_of(' ');
+        size_t first = this->find_first_not_of(" \t\r\n");
         if (std::string::npos == first) {
             this->clear();
             return;
         }
-        size_t last = this->find_last_not_of(' ');
+        size_t last = this->find_last_not_of(" \t\r\n");
         *this = this->substr(first, (last - first + 1));
     }
 
@@ -74,6 +127,11 @@ public:
         std::transform(s2.begin(), s2.end(), s2.begin(), ::tolower);
         return s1 == s2;
     }
+
+    int toInt() const { return atoi(c_str()); }
+    float toFloat() const { return (float)atof(c_str()); }
 };
 
+inline String MockSerial::readStringUntil(char terminator) { return String(); }
+
 #endif // ARDUINO_H
@@ -5,3 +5,5 @@ float INA226_WE::mockBusVoltage_V = 0.0;
 float INA226_WE::mockCurrent_mA = 0.0;
 float INA226_WE::mockBusPower = 0.0;
 bool INA226_WE::overflow = false;
+INA226_ALERT_TYPE INA226_WE::lastAlertType = SHUNT_OVER;
+float INA226_WE::lastAlertLimit = 0.0;
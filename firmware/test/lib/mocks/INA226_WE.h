@@ -26,19 +26,49 @@ enum ina226_conversion_times{
     CONV_TIME_8244
 };
 
+typedef enum INA226_ALERT_TYPE{
+    SHUNT_OVER = 0x8000,
+    SHUNT_UNDER = 0x4000,
+    BUS_OVER = 0x2000,
+    BUS_UNDER = 0x1000,
+    POWER_OVER = 0x0800,
+    CURRENT_OVER = 0xFFFE,
+    CURRENT_UNDER = 0xFFFF
+} alertType;
 
 class INA226_WE {
 public:
+    static const uint8_t INA226_CONF_REG = 0x00;
+    static const uint8_t INA226_SHUNT_REG = 0x01;
+    static const uint8_t INA226_BUS_REG = 0x02;
+    static const uint8_t INA226_CAL_REG = 0x05;
+    static const uint8_t INA226_MASK_EN_REG = 0x06;
+    static const uint8_t INA226_ALERT_LIMIT_REG = 0x07;
+
     INA226_WE(uint8_t addr) {
         // Mock constructor
     }
 
-    void init() {}
+    bool init() { return true; }
     void waitUntilConversionCompleted() {}
     void setAverage(ina226_averages averages) {}
     void setConversionTime(ina226_conversion_times convTime) {}
     void setResistorRange(float resistor, float current) {}
     void readAndClearFlags() {}
+    void powerDown() {}
+    void enableAlertLatch() {}
+
+    // The last alert programmed, for tests to check
+    void setAlertType(INA226_ALERT_TYPE type, float limit) {
+        lastAlertType = type;
+        lastAlertLimit = limit;
+    }
+
+    // Registers are plain storage; nothing is derived from them
+    void writeRegister(uint8_t reg, uint16_t value) {
+        if (reg < registerCount) registers[reg] = value;
+    }
+    uint16_t readRegister(uint8_t reg) const { return reg < registerCount ? registers[reg] : 0; }
 
     // Mock data members - public to allow easy manipulation in tests
     static float mockShuntVoltage_mV;
@@ -46,12 +76,18 @@ public:
     static float mockCurrent_mA;
     static float mockBusPower;
     static bool overflow;
+    static INA226_ALERT_TYPE lastAlertType;
+    static float lastAlertLimit;
 
     // Mock methods to return the mock data
     float getShuntVoltage_mV() { return mockShuntVoltage_mV; }
     float getBusVoltage_V() { return mockBusVoltage_V; }
     float getCurrent_mA() { return mockCurrent_mA; }
     float getBusPower() { return mockBusPower; }
+
+private:
+    static const uint8_t registerCount = 8;
+    uint16_t registers[registerCount] = {0};
 };
 
 #endif // INA226_WE_H
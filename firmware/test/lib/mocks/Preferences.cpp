@@ -1,3 +1,3 @@
 #include "Preferences.h"
 
-std::map<std::string, float> Preferences::preferences;
+std::map<std::string, std::vector<uint8_t> > Preferences::preferences;
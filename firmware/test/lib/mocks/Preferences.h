@@ -1,32 +1,63 @@
 #ifndef PREFERENCES_H
 #define PREFERENCES_H
 
+#include <stdint.h>
+#include <string.h>
 #include <string>
 #include <map>
+#include <vector>
 
+// In-memory NVS. Values are stored as raw bytes per namespace/key, so a key
+// written with one type and read with another behaves like the real thing.
 class Preferences {
 public:
-    void begin(const char* name, bool readOnly) {
-        // In-memory mock doesn't need to do anything here
+    bool begin(const char* name, bool readOnly) {
+        m_namespace = name;
+        return true;
     }
 
     void end() {
         // In-memory mock doesn't need to do anything here
     }
 
-    void putFloat(const char* key, float value) {
-        preferences[key] = value;
+    size_t putFloat(const char* key, float value) { return put(key, &value, sizeof(value)); }
+    float getFloat(const char* key, float defaultValue) { return get(key, defaultValue); }
+    size_t putBool(const char* key, bool value) { return put(key, &value, sizeof(value)); }
+    bool getBool(const char* key, bool defaultValue) { return get(key, defaultValue); }
+    size_t putUChar(const char* key, uint8_t value) { return put(key, &value, sizeof(value)); }
+    uint8_t getUChar(const char* key, uint8_t defaultValue) { return get(key, defaultValue); }
+    size_t putUShort(const char* key, uint16_t value) { return put(key, &value, sizeof(value)); }
+    uint16_t getUShort(const char* key, uint16_t defaultValue) { return get(key, defaultValue); }
+    size_t putInt(const char* key, int32_t value) { return put(key, &value, sizeof(value)); }
+    int32_t getInt(const char* key, int32_t defaultValue) { return get(key, defaultValue); }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue) { return get(key, defaultValue); }
+    size_t putLong64(const char* key, int64_t value) { return put(key, &value, sizeof(value)); }
+    int64_t getLong64(const char* key, int64_t defaultValue) { return get(key, defaultValue); }
+    size_t putULong64(const char* key, uint64_t value) { return put(key, &value, sizeof(value)); }
+    uint64_t getULong64(const char* key, uint64_t defaultValue) { return get(key, defaultValue); }
+
+    size_t putBytes(const char* key, const void* value, size_t len) { return put(key, value, len); }
+
+    size_t getBytesLength(const char* key) {
+        std::map<std::string, std::vector<uint8_t> >::const_iterator it = preferences.find(path(key));
+        return it == preferences.end() ? 0 : it->second.size();
     }
 
-    float getFloat(const char* key, float defaultValue) {
-        if (preferences.find(key) != preferences.end()) {
-            return preferences[key];
-        }
-        return defaultValue;
+    size_t getBytes(const char* key, void* buf, size_t maxLen) {
+        std::map<std::string, std::vector<uint8_t> >::const_iterator it = preferences.find(path(key));
+        if (it == preferences.end()) return 0;
+        const size_t len = it->second.size() < maxLen ? it->second.size() : maxLen;
+        memcpy(buf, it->second.data(), len);
+        return len;
     }
 
-    void clear() {
+    bool isKey(const char* key) { return preferences.count(path(key)) > 0; }
+    bool remove(const char* key) { return preferences.erase(path(key)) > 0; }
+
+    bool clear() {
         preferences.clear();
+        return true;
     }
 
     static void clear_static() {
@@ -34,7 +65,25 @@ public:
     }
 
 private:
-    static std::map<std::string, float> preferences;
+    std::string path(const char* key) const { return m_namespace + "/" + key; }
+
+    size_t put(const char* key, const void* value, size_t len) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        preferences[path(key)] = std::vector<uint8_t>(bytes, bytes + len);
+        return len;
+    }
+
+    template<typename T>
+    T get(const char* key, T defaultValue) {
+        std::map<std::string, std::vector<uint8_t> >::const_iterator it = preferences.find(path(key));
+        if (it == preferences.end() || it->second.size() != sizeof(T)) return defaultValue;
+        T value;
+        memcpy(&value, it->second.data(), sizeof(T));
+        return value;
+    }
+
+    std::string m_namespace;
+    static std::map<std::string, std::vector<uint8_t> > preferences;
 };
 
 #endif // PREFERENCES_H
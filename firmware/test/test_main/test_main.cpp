@@ -4,11 +4,35 @@
 // Include the headers of the classes to be tested
 #include "ina226_adc.h"
 #include "espnow_handler.h"
+#include "cal_jig.h"
 #include "shared_defs.h"
 
 // HACK: Include the source file directly to get around linker issues
 #include "../../../src/ina226_adc.cpp"
 #include "../../../src/espnow_handler.cpp"
+#include "../../../src/cal_jig.cpp"
+#include "../../../src/cal_sweep.cpp"
+#include "../../../src/cal_math.cpp"
+#include "../../../src/coulomb_counter.cpp"
+#include "../../../src/soc_journal.cpp"
+#include "../../../src/rtc_state.cpp"
+#include "../../../src/battery_model.cpp"
+#include "../../../src/ocv_resync.cpp"
+#include "../../../src/charge_detector.cpp"
+#include "../../../src/lifetime_stats.cpp"
+#include "../../../src/capacity_estimator.cpp"
+#include "../../../src/soc_ekf.cpp"
+#include "../../../src/resistance_estimator.cpp"
+#include "../../../src/rainflow_counter.cpp"
+#include "../../../src/sleep_clock.cpp"
+#include "../../../src/current_average.cpp"
+#include "../../../src/time_to_full.cpp"
+#include "../../../src/wall_clock.cpp"
+#include "../../../src/load_profile.cpp"
+#include "../../../src/protection_engine.cpp"
+#include "../../../src/latency_histogram.cpp"
+#include "../../../src/alert_scheduler.cpp"
+#include "../../../src/lvd_sleep.cpp"
 #include "../lib/mocks/Arduino.cpp"
 #include "../lib/mocks/Wire.cpp"
 #include "../lib/mocks/Preferences.cpp"
@@ -64,9 +88,10 @@ void test_battery_capacity(void) {
     float initialCapacity = 100.0;
     INA226_ADC adc(0x40, 0.001, initialCapacity);
 
-    // Initialize lastUpdateTime
+    // Samples are integrated with the trapezoid rule, so a current step is
+    // modelled as two samples at the same instant.
     set_mock_millis(1000);
-    adc.updateBatteryCapacity(0.0);
+    adc.updateBatteryCapacity(10.0);    // first sample only seeds the counter
 
     // --- Test discharging ---
     set_mock_millis(1000 + 3600 * 1000); // Advance time by 1 hour
@@ -77,6 +102,7 @@ void test_battery_capacity(void) {
     TEST_ASSERT_EQUAL_FLOAT(expectedCapacity, adc.getBatteryCapacity());
 
     // --- Test charging ---
+    adc.updateBatteryCapacity(-5.0);         // step to 5A charge
     set_mock_millis(1000 + 2 * 3600 * 1000); // Advance time by another 1 hour
     adc.updateBatteryCapacity(-5.0);        // 5A charge over the last hour
 
@@ -86,6 +112,7 @@ void test_battery_capacity(void) {
 
     // --- Test capacity limits ---
     // Test not exceeding max capacity
+    adc.updateBatteryCapacity(-100.0);
     set_mock_millis(1000 + 3 * 3600 * 1000); // Advance time by another 1 hour
     adc.updateBatteryCapacity(-100.0);      // charge with 100A for 1h
     expectedCapacity += 100.0;
@@ -95,6 +122,7 @@ void test_battery_capacity(void) {
     TEST_ASSERT_EQUAL_FLOAT(expectedCapacity, adc.getBatteryCapacity());
 
     // Test not going below zero
+    adc.updateBatteryCapacity(200.0);
     set_mock_millis(1000 + 4 * 3600 * 1000); // Advance time by another 1 hour
     adc.updateBatteryCapacity(200.0);       // discharge with 200A for 1h
     expectedCapacity -= 200.0;
@@ -102,6 +130,840 @@ void test_battery_capacity(void) {
         expectedCapacity = 0;
     }
     TEST_ASSERT_EQUAL_FLOAT(expectedCapacity, adc.getBatteryCapacity());
+
+    // Totals are not clamped: 10 + 200 Ah out, 5 + 100 Ah in
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 210.0f, adc.getChargeOut_Ah());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 105.0f, adc.getChargeIn_Ah());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, adc.getStateOfCharge());
+}
+
+void test_coulomb_counter_precision(void) {
+    // 50mA for 10s against a full 100Ah battery, repeated for a week. A float
+    // Ah accumulator drops most of each 0.000139Ah step; the counter must not.
+    CoulombCounter cc(100.0f);
+    uint32_t t = 0;
+    cc.addSample(50000, t);
+    const int steps = 7 * 24 * 360;
+    for (int i = 0; i < steps; ++i) {
+        t += 10000;
+        cc.addSample(50000, t);
+    }
+    TEST_ASSERT_TRUE(cc.chargeOut_nAs() == (uint64_t)steps * 50000ULL * 10000ULL);
+    TEST_ASSERT_TRUE(cc.remaining_nAs() == cc.capacity_nAs() - (int64_t)steps * 500000000LL);
+
+    // Ramp 0 -> 1A over 1s: trapezoid gives 0.5As, not 0 or 1As
+    CoulombCounter ramp(1.0f);
+    ramp.addSample(0, 0);
+    ramp.addSample(1000000, 1000);
+    TEST_ASSERT_TRUE(ramp.chargeOut_nAs() == 500000000ULL);
+
+    // Discharge 1A -> charge 1A over 2s: net zero, 0.5As each way
+    CoulombCounter cross(1.0f);
+    cross.setRemaining_Ah(0.5f);
+    int64_t before = cross.remaining_nAs();
+    cross.addSample(1000000, 0);
+    cross.addSample(-1000000, 2000);
+    TEST_ASSERT_TRUE(cross.remaining_nAs() == before);
+    TEST_ASSERT_TRUE(cross.chargeOut_nAs() == 500000000ULL);
+    TEST_ASSERT_TRUE(cross.chargeIn_nAs() == 500000000ULL);
+
+    // Odd half-nAs are carried, not dropped: 1uA over 1ms twice = 2nAs
+    CoulombCounter odd(1.0f);
+    odd.addSample(0, 0);
+    odd.addSample(1, 1);     // 0.5 nAs
+    odd.addSample(0, 2);     // 0.5 nAs
+    TEST_ASSERT_TRUE(odd.capacity_nAs() - odd.remaining_nAs() == 1);
+}
+
+void test_soc_journal(void) {
+    Preferences::clear_static();
+    CoulombCounter cc(100.0f);
+    SocJournalRecord rec;
+    {
+        SocJournal journal;
+        TEST_ASSERT_FALSE(journal.restore(rec));
+
+        TEST_ASSERT_TRUE(journal.update(cc, 0));            // first record seeds the journal
+        cc.setRemaining_Ah(99.0f);
+        TEST_ASSERT_FALSE(journal.update(cc, 1000));        // rate limited
+        TEST_ASSERT_TRUE(journal.update(cc, 61000));        // 1 % moved, interval passed
+        cc.setRemaining_Ah(98.9f);
+        TEST_ASSERT_FALSE(journal.update(cc, 130000));      // below 0.5 %
+        TEST_ASSERT_TRUE(journal.update(cc, 61000 + 6UL * 3600UL * 1000UL)); // heartbeat
+        TEST_ASSERT_FALSE(journal.update(cc, 62000 + 12UL * 3600UL * 1000UL)); // unchanged
+
+        // Wrap the ring more than once
+        for (int i = 0; i < 2 * SocJournal::slotCount; ++i) {
+            cc.setRemaining_Ah(90.0f - i);
+            TEST_ASSERT_TRUE(journal.save(cc, 0));
+        }
+        TEST_ASSERT_EQUAL(3 + 2 * SocJournal::slotCount, journal.lastSeq());
+    }
+
+    // Reboot: one scan finds the newest record
+    SocJournal rebooted;
+    TEST_ASSERT_TRUE(rebooted.restore(rec));
+    TEST_ASSERT_EQUAL(3 + 2 * SocJournal::slotCount, rec.seq);
+    TEST_ASSERT_TRUE(rec.remaining_nAs == cc.remaining_nAs());
+
+    // A torn write in the newest slot falls back to the one before it
+    char key[8];
+    snprintf(key, sizeof(key), "s%u", (unsigned)((rec.seq - 1) % SocJournal::slotCount));
+    SocJournalRecord torn = rec;
+    torn.remaining_nAs = 0;
+    Preferences prefs;
+    prefs.begin(NVS_SOC_JOURNAL_NAMESPACE, false);
+    prefs.putBytes(key, &torn, sizeof(torn));
+    prefs.end();
+    SocJournal afterCorruption;
+    TEST_ASSERT_TRUE(afterCorruption.restore(rec));
+    TEST_ASSERT_EQUAL(2 + 2 * SocJournal::slotCount, rec.seq);
+
+    // The ADC restores it at boot
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(adc.restoreStateOfCharge());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 90.0f - (2 * SocJournal::slotCount - 2), adc.getBatteryCapacity());
+}
+
+void test_rtc_state_survives_reset(void) {
+    RtcState::invalidate();
+    {
+        INA226_ADC fresh(0x40, 0.001, 100.0);
+        TEST_ASSERT_FALSE(fresh.restoreFromRtc());      // cold power-on: nothing there
+    }
+
+    // Running unit: 30Ah used, then an overcurrent trip, then a cranking dip
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setBatteryCapacity(70.0f);
+    adc.setLoadConnected(false, OVERCURRENT);
+    INA226_WE::mockBusVoltage_V = 7.5;
+    INA226_WE::mockCurrent_mA = 0.0;
+    adc.readSensors();                                   // dip -> snapshot saved
+
+    // Brownout reset: a new instance restores before begin() touches NVS
+    INA226_ADC rebooted(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(rebooted.restoreFromRtc());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 70.0f, rebooted.getBatteryCapacity());
+    TEST_ASSERT_FALSE(rebooted.isLoadConnected());
+
+    // A torn write is rejected
+    RtcStateSnapshot snap;
+    TEST_ASSERT_TRUE(RtcState::load(snap));
+    snap.remaining_nAs += 1;                             // CRC no longer matches
+    rtcSnapshot = snap;
+    TEST_ASSERT_FALSE(RtcState::load(snap));
+    RtcState::invalidate();
+}
+
+void test_sleep_drain_credited(void) {
+    // Slow clock measured at 150kHz before sleep and 147kHz (warmer) after
+    const uint32_t before = (uint32_t)(524288.0 * 1e6 / 150000.0);
+    const uint32_t after = (uint32_t)(524288.0 * 1e6 / 147000.0);
+    const uint64_t ticks = 150000ULL * 36ULL * 3600ULL;                 // ~36h of ticks
+    const double expectedUs = (double)ticks * ((before + after) / 2) / 524288.0;
+    TEST_ASSERT_FLOAT_WITHIN(1.0, expectedUs, (double)SleepClock::ticksToMicros(ticks, (before + after) / 2));
+
+    RtcState::invalidate();
+    Preferences::clear_static();
+    SleepClock::setHostClock(5000, before);
+    {
+        INA226_ADC adc(0x40, 0.001, 100.0);
+        adc.setBatteryCapacity(50.0f);
+        adc.setSleepCurrent_mA(2.0f);
+        adc.setLoadConnected(false, LOW_VOLTAGE);
+        adc.enterSleepMode();
+    }
+    SleepClock::setHostClock(5000 + ticks, after);
+
+    INA226_ADC woke(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(woke.restoreFromRtc());
+    const double drainedAh = expectedUs / 3.6e9 * 0.002;                  // 2mA over the crystal-timed sleep
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)(50.0 - drainedAh), woke.getBatteryCapacity());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)drainedAh, woke.getChargeOut_Ah());
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, (float)(expectedUs / 1e6), (float)(SleepClock::totalSlept_us() / 1e6));
+    // The sleep current is a saved protection setting
+    woke.loadProtectionSettings();
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, woke.getSleepCurrent_mA());
+
+    // A plain reset afterwards does not credit the same sleep again
+    INA226_ADC reset(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(reset.restoreFromRtc());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, woke.getBatteryCapacity(), reset.getBatteryCapacity());
+
+    // Straight back to sleep (the LVD fast wake): the period measured at wake
+    // is reused, so a different reading now is not taken
+    const uint64_t woke_ticks = 5000 + ticks;
+    uint64_t slept_us;
+    uint32_t sleep_uA;
+    SleepClock::setHostClock(woke_ticks + 300, before);                  // 2ms later
+    SleepClock::beginSleep(1000);
+    SleepClock::setHostClock(woke_ticks + 300 + 1500000, after);
+    TEST_ASSERT_TRUE(SleepClock::endSleep(slept_us, sleep_uA));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)SleepClock::ticksToMicros(1500000, after), (uint32_t)slept_us);
+    // More than calibrationReuse_us later it is measured again
+    SleepClock::setHostClock(woke_ticks + 300 + 1500000 + 300000, before); // 2s later
+    SleepClock::beginSleep(1000);
+    SleepClock::setHostClock(woke_ticks + 300 + 1500000 + 300000 + 1500000, after);
+    TEST_ASSERT_TRUE(SleepClock::endSleep(slept_us, sleep_uA));
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)SleepClock::ticksToMicros(1500000, (before + after) / 2), (uint32_t)slept_us);
+    RtcState::invalidate();
+}
+
+void test_lvd_fast_wake(void) {
+    const uint32_t usPerTick = 1UL << 19;                               // Q19: one tick per microsecond
+    RtcState::invalidate();
+    LvdSleep::clear();
+    Preferences::clear_static();
+    set_mock_millis(0);
+    SleepClock::setHostClock(0, usPerTick);
+    int64_t remaining;
+    {
+        INA226_ADC adc(0x40, 0.001, 100.0);
+        adc.setProtectionSettings(9.0f, 0.5f, 50.0f);
+        adc.setSleepCurrent_mA(2.0f);
+        adc.setLoadConnected(false, LOW_VOLTAGE);
+        mock_esp_deep_sleep_clear();
+        adc.enterSleepMode();
+        TEST_ASSERT_TRUE(mock_esp_deep_sleep_called());
+        remaining = adc.getCoulombCounter().remaining_nAs();
+    }
+    TEST_ASSERT_TRUE(LvdSleep::armed());
+    TEST_ASSERT_EQUAL_UINT32(9500, LvdSleep::reconnect_mV());
+    // An overcurrent retry used before the low-voltage trip
+    RtcStateSnapshot snap;
+    TEST_ASSERT_TRUE(RtcState::load(snap));
+    snap.ocRetries = 1;
+    RtcState::save(snap);
+
+    // Timer wake 50 ms after the 10 s interval (boot plus sleep-clock error),
+    // battery still low: back to sleep 2 ms after app start
+    SleepClock::setHostClock(10050000ULL, usPerTick);
+    set_mock_millis(2);
+    LvdSleep::setHostBus_mV(9200);
+    {
+        INA226_ADC adc(0x40, 0.001, 100.0);
+        TEST_ASSERT_TRUE(adc.restoreFromRtc());
+        mock_esp_deep_sleep_clear();
+        TEST_ASSERT_TRUE(adc.lowVoltageFastWake(6, 10));
+        TEST_ASSERT_TRUE(mock_esp_deep_sleep_called());
+        TEST_ASSERT_EQUAL_UINT32(10000000UL, (uint32_t)mock_esp_sleep_timer_us());
+        // 10.05 s at the 2 mA sleep current, plus 2 ms at 23 mA more
+        remaining -= 20100000LL + 46000LL;
+        TEST_ASSERT_TRUE(remaining == adc.getCoulombCounter().remaining_nAs());
+    }
+    // The fast wake ran before begin(): the retry state passes through untouched
+    TEST_ASSERT_TRUE(RtcState::load(snap));
+    TEST_ASSERT_EQUAL(1, snap.ocRetries);
+    TEST_ASSERT_EQUAL(0, snap.ocLockedOut);
+    LvdSleepRecord rec;
+    TEST_ASSERT_TRUE(LvdSleep::stats(rec));
+    TEST_ASSERT_EQUAL_UINT32(1, rec.wakes);
+    TEST_ASSERT_EQUAL_UINT32(2000, rec.lastAwake_us);
+    TEST_ASSERT_EQUAL_UINT32(9200, rec.lastBus_mV);
+    TEST_ASSERT_EQUAL_UINT32(460, (uint32_t)rec.energyTotal_uJ);       // 2 ms * 25 mA * 9.2 V
+
+    // Recovered: full boot, the episode's totals are kept
+    SleepClock::setHostClock(20100000ULL, usPerTick);
+    LvdSleep::setHostBus_mV(9600);
+    {
+        INA226_ADC adc(0x40, 0.001, 100.0);
+        TEST_ASSERT_TRUE(adc.restoreFromRtc());
+        mock_esp_deep_sleep_clear();
+        TEST_ASSERT_FALSE(adc.lowVoltageFastWake(6, 10));
+        TEST_ASSERT_FALSE(mock_esp_deep_sleep_called());
+        // The second sleep was still charged at the configured 2 mA, not the default
+        TEST_ASSERT_TRUE(remaining - 20100000LL == adc.getCoulombCounter().remaining_nAs());
+    }
+    TEST_ASSERT_FALSE(LvdSleep::armed());
+    TEST_ASSERT_TRUE(LvdSleep::stats(rec));
+    TEST_ASSERT_EQUAL_UINT32(1, rec.wakes);
+
+    // No sensor answering also falls back to a full boot
+    LvdSleep::arm(0x40, 9500);
+    LvdSleep::setHostBus_mV(0, false);
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.restoreFromRtc();
+    TEST_ASSERT_FALSE(adc.lowVoltageFastWake(6, 10));
+    TEST_ASSERT_FALSE(LvdSleep::armed());
+    LvdSleep::setHostBus_mV(0, true);
+    LvdSleep::clear();
+    RtcState::invalidate();
+}
+
+void test_battery_model(void) {
+    // Presets are compile-time constants
+    static_assert(AgmChemistry::peukertExponent > LiFePO4Chemistry::peukertExponent, "AGM is more rate sensitive");
+    BatteryModel model;
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, model.effectiveCurrent_A(10.0f));   // ideal until configured
+
+    TEST_ASSERT_TRUE(model.setParams(BatteryModel::preset<LiFePO4Chemistry>(), 100.0f)); // rated 5A
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, model.effectiveCurrent_A(2.0f));      // below rated: no bonus
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 10.0f * powf(2.0f, 0.05f), model.effectiveCurrent_A(10.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, -9.9f, model.effectiveCurrent_A(-10.0f)); // 99 % efficient
+    TEST_ASSERT_FALSE(model.setParams(BatteryModelParams{0.9f, 0.99f, 20.0f}, 100.0f));
+
+    // Runtime parameters persist in NVS and override the preset
+    Preferences::clear_static();
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(adc.setBatteryModelParams(BatteryModel::preset<FloodedChemistry>()));
+    BatteryModel loaded;
+    loaded.load(100.0f);
+    TEST_ASSERT_EQUAL_FLOAT(FloodedChemistry::peukertExponent, loaded.params().peukertExponent);
+    TEST_ASSERT_EQUAL_FLOAT(FloodedChemistry::chargeEfficiency, loaded.params().chargeEfficiency);
+
+    // SOC follows usable capacity, the totals follow measured charge
+    set_mock_millis(1000);
+    adc.updateBatteryCapacity(10.0);
+    set_mock_millis(1000 + 3600 * 1000);
+    adc.updateBatteryCapacity(10.0);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 100.0f - 10.0f * powf(2.0f, 0.25f), adc.getBatteryCapacity());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 10.0f, adc.getChargeOut_Ah());
+    Preferences::clear_static();
+}
+
+void test_ocv_resync_at_rest(void) {
+    OcvResync ocv;
+    size_t n;
+    const OcvPoint *curve = AgmChemistry::ocvCurve(n);
+    ocv.setCurve(curve, n);
+    ocv.setRest(0.2f, 30UL * 60UL * 1000UL);
+
+    float slope;
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.5f, ocv.socFromVoltage(12.30f, slope));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.25f / 0.30f, slope);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, ocv.socFromVoltage(14.4f, slope));   // clamped while charging
+
+    // Counter says 90 %, the battery has rested at 12.30V (50 %)
+    float soc = 0.9f;
+    uint32_t t = 0;
+    TEST_ASSERT_FALSE(ocv.update(5.0f, 12.30f, t, soc));                // under load
+    for (t = 1000; t < 29UL * 60UL * 1000UL; t += 60000) {
+        TEST_ASSERT_FALSE(ocv.update(0.05f, 12.30f, t, soc));           // not rested long enough
+    }
+    TEST_ASSERT_FALSE(ocv.update(0.05f, 5.0f, t, soc));                 // USB power, resets rest
+    TEST_ASSERT_FALSE(ocv.update(0.05f, 12.30f, t, soc));
+    t += 30UL * 60UL * 1000UL;
+    TEST_ASSERT_TRUE(ocv.update(0.05f, 12.30f, t, soc));
+    TEST_ASSERT_TRUE(ocv.lastWeight() > 0.9f);                         // never synced: trust OCV
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 0.5f, soc);
+    TEST_ASSERT_FALSE(ocv.update(0.05f, 12.30f, t + 60000, soc));       // once per rest period
+
+    // Next rest an hour later: the counter is fresh, so OCV gets less weight
+    ocv.update(3.0f, 12.0f, t + 3600000UL, soc);
+    float before = soc;
+    ocv.update(0.0f, 12.60f, t + 3600001UL, soc);
+    TEST_ASSERT_TRUE(ocv.update(0.0f, 12.60f, t + 3600001UL + 30UL * 60UL * 1000UL, soc));
+    TEST_ASSERT_TRUE(ocv.lastWeight() < 0.9f);
+    TEST_ASSERT_TRUE(soc > before && soc < 0.75f);
+}
+
+void test_full_charge_detection(void) {
+    ChargeDetector det;
+    ChargeDetectorParams p = {14.0f, 4.0f, 180};
+    TEST_ASSERT_TRUE(det.setParams(p, 100.0f));                        // tail 4A
+    ChargeDetectorParams bad = {14.0f, 0.0f, 180};
+    TEST_ASSERT_FALSE(det.setParams(bad, 100.0f));
+
+    uint32_t t = 0;
+    TEST_ASSERT_FALSE(det.update(-10.0f, 14.2f, 0.9f, t));             // still in bulk
+    for (t = 1000; t < 179000; t += 1000) {
+        TEST_ASSERT_FALSE(det.update(-3.0f, 14.2f, 0.9f, t));          // tapering, not dwelled yet
+    }
+    TEST_ASSERT_FALSE(det.update(-3.0f, 13.9f, 0.9f, t));              // dip restarts the dwell
+    TEST_ASSERT_FALSE(det.update(-3.0f, 14.2f, 0.9f, t + 1000));
+    TEST_ASSERT_TRUE(det.update(-3.0f, 14.2f, 0.9f, t + 181000));
+    TEST_ASSERT_EQUAL_UINT32(1, det.fullChargeCount());
+    TEST_ASSERT_EQUAL_UINT32(t + 181000, det.lastFullChargeMs());
+
+    // Hours of absorption count as one charge; re-armed after a 2 % discharge
+    TEST_ASSERT_FALSE(det.update(-1.0f, 14.2f, 1.0f, t + 900000));
+    det.update(5.0f, 12.8f, 0.97f, t + 1000000);
+    det.update(-2.0f, 14.2f, 0.99f, t + 2000000);
+    TEST_ASSERT_TRUE(det.update(-2.0f, 14.2f, 0.99f, t + 2200000));
+    TEST_ASSERT_EQUAL_UINT32(2, det.fullChargeCount());
+
+    // Rest or a small discharge at the charged voltage (surface charge, a
+    // charger feeding loads) is not a tapered charge
+    ChargeDetector idle;
+    TEST_ASSERT_TRUE(idle.setParams(p, 100.0f));
+    for (t = 0; t <= 400000; t += 1000) {
+        TEST_ASSERT_FALSE(idle.update((t / 1000) & 1 ? 0.0f : 1.0f, 14.2f, 0.9f, t));
+    }
+
+    // The armed state is saved with the count: a reboot in float is not a new charge
+    Preferences::clear_static();
+    det.save();
+    ChargeDetector rebooted;
+    rebooted.load(100.0f);
+    TEST_ASSERT_FALSE(rebooted.armed());
+    TEST_ASSERT_EQUAL_UINT32(2, rebooted.fullChargeCount());
+    for (t = 0; t <= 400000; t += 1000) {
+        TEST_ASSERT_FALSE(rebooted.update(-1.0f, 14.2f, 1.0f, t));
+    }
+
+    // Integrated: counter thinks 80 %, charger says full
+    Preferences::clear_static();
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setChargeDetectorParams(p);
+    set_mock_millis(1);
+    adc.updateBatteryCapacity(20.0f);
+    set_mock_millis(1 + 3600 * 1000);
+    adc.updateBatteryCapacity(20.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.8f, adc.getStateOfCharge());
+    INA226_WE::mockBusVoltage_V = 14.1f;
+    INA226_WE::mockCurrent_mA = -2000.0f;
+    for (uint32_t ms = 3601000; ms <= 3601000 + 200000; ms += 10000) {
+        set_mock_millis(ms);
+        adc.readSensors();
+        adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, adc.getStateOfCharge());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getChargeDetector().fullChargeCount());
+    // Re-arming after a discharge is saved straight away
+    INA226_WE::mockBusVoltage_V = 12.8f;
+    INA226_WE::mockCurrent_mA = 20000.0f;
+    set_mock_millis(3801000);
+    adc.readSensors();
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    set_mock_millis(3801000 + 1800 * 1000);
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    TEST_ASSERT_TRUE(adc.getChargeDetector().armed());
+    ChargeDetector stored;
+    stored.load(100.0f);
+    TEST_ASSERT_TRUE(stored.armed());
+    Preferences::clear_static();
+    INA226_WE::mockBusVoltage_V = 0.0f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+}
+
+void test_time_to_full_taper(void) {
+    ChargeDetector det;
+    ChargeDetectorParams p = {14.0f, 4.0f, 180};
+    TEST_ASSERT_TRUE(det.setParams(p, 100.0f));                        // tail 4A
+    TimeToFull ttf;
+
+    // Bulk, nothing learned: missing Ah at the present current
+    ttf.update(-40.0f, 13.5f, 30.0f, 0, det);
+    TEST_ASSERT_TRUE(ttf.isCharging());
+    TEST_ASSERT_FALSE(ttf.inAbsorption());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.75f, ttf.hours());
+
+    // Absorption: 40A decaying with tau = 30 min
+    const float tau = 1800.0f;
+    for (uint32_t ms = 10000; ms <= 610000; ms += 10000) {
+        const float t = (ms - 10000) / 1000.0f;
+        ttf.update(-40.0f * expf(-t / tau), 14.2f, 10.0f, ms, det);
+    }
+    TEST_ASSERT_TRUE(ttf.inAbsorption());
+    TEST_ASSERT_FLOAT_WITHIN(5.0f, tau, ttf.tau_s());
+    const float expected = (tau * logf(40.0f * expf(-600.0f / tau) / 4.0f) + 180.0f) / 3600.0f;
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, expected, ttf.hours());            // ~1.03 h
+    TEST_ASSERT_TRUE(ttf.hours() > 10.0f / 28.7f * 2.5f);              // far beyond Ah / current
+
+    // Charger stops: no prediction, tau kept for the next charge
+    ttf.update(0.0f, 13.3f, 0.0f, 620000, det);
+    TEST_ASSERT_FALSE(ttf.hasPrediction());
+    TEST_ASSERT_TRUE(ttf.hasTau());
+
+    // Next bulk: 18Ah of the 30 come in during the taper
+    ttf.update(-40.0f, 13.5f, 30.0f, 700000, det);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.3f + (tau * logf(10.0f) + 180.0f) / 3600.0f, ttf.hours());
+
+    // Integrated: "until full" follows the taper prediction
+    Preferences::clear_static();
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setChargeDetectorParams(p);
+    set_mock_millis(1);
+    adc.updateBatteryCapacity(20.0f);
+    set_mock_millis(1 + 900 * 1000);
+    adc.updateBatteryCapacity(20.0f);                                  // 5Ah out
+    TEST_ASSERT_FALSE(adc.getTimeToFull().hasPrediction());
+    INA226_WE::mockBusVoltage_V = 14.2f;
+    for (uint32_t ms = 901000; ms <= 901000 + 600000; ms += 10000) {
+        const float t = (ms - 901000) / 1000.0f;
+        INA226_WE::mockCurrent_mA = -10000.0f * expf(-t / 7200.0f);
+        set_mock_millis(ms);
+        adc.readSensors();
+        adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_TRUE(adc.getTimeToFull().inAbsorption());
+    TEST_ASSERT_FLOAT_WITHIN(50.0f, 7200.0f, adc.getTimeToFull().tau_s());
+    // 7200 * ln(9.2 / 4) + 180 s = 1.7 h; the missing 3.4Ah / 9.2A would say 0.4 h
+    bool warning;
+    TEST_ASSERT_EQUAL_STRING("1 hour until full", adc.calculateRunFlatTimeFormatted(-9.2f, 12.0f, warning).c_str());
+    INA226_WE::mockBusVoltage_V = 0.0f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+}
+
+void test_load_profile_run_flat(void) {
+    Preferences::clear_static();
+    LoadProfile lp;
+    TEST_ASSERT_TRUE(sizeof(LoadProfileRecord) < 512);
+
+    // Day 1: 2A until 18:00, 10A in the evening, sampled every 10s
+    uint32_t ms = 0;
+    for (uint32_t sod = 0; sod < 86400; sod += 10, ms += 10000) {
+        lp.addSample(sod < 18 * 3600 ? 2.0f : 10.0f, sod, ms);
+    }
+    lp.addSample(2.0f, 0, ms);                                         // midnight closes the last bin
+    TEST_ASSERT_EQUAL_UINT32(LoadProfile::binCount, lp.binsSeen());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 2.0f, lp.binMean_A(0));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 10.0f, lp.binMean_A(LoadProfile::binCount - 1));
+
+    // From noon with 50Ah: 6h x 2A, then 38Ah at 10A = 9.8h (a 2A average says 25h)
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 9.8f, lp.hoursToEmpty(50.0f, 100.0f, 12 * 3600, 2.0f));
+    // Mid-bin start counts only the rest of the bin: 5.875h x 2A, then 38.25Ah at 10A
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 9.7f, lp.hoursToEmpty(50.0f, 100.0f, 12 * 3600 + 450, 2.0f));
+    // Full at midnight: 96Ah used the first day, the last 4Ah by 02:00
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 26.0f, lp.hoursToEmpty(100.0f, 100.0f, 0, 2.0f));
+
+    // Day 2 at 4A ages the daytime bins towards it
+    for (uint32_t sod = 0; sod < 3600; sod += 10, ms += 10000) lp.addSample(4.0f, sod, ms);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 2.6f, lp.binMean_A(0));
+
+    // Short visits and sample gaps are not learned
+    LoadProfile sparse;
+    sparse.addSample(5.0f, 0, 0);
+    sparse.addSample(5.0f, 30, 30000);
+    sparse.addSample(5.0f, 900, 900000);                               // next bin after a gap
+    TEST_ASSERT_EQUAL_UINT32(0, sparse.binsSeen());
+    // Charging bins refill up to capacity; nothing drains within the horizon
+    TEST_ASSERT_EQUAL_FLOAT((float)LoadProfile::horizonHours + 1.0f, sparse.hoursToEmpty(50.0f, 100.0f, 0, -1.0f));
+
+    // Persisted as one blob
+    TEST_ASSERT_TRUE(lp.checkpoint(ms, true));
+    LoadProfile restored;
+    TEST_ASSERT_TRUE(restored.load());
+    TEST_ASSERT_EQUAL_UINT32(LoadProfile::binCount, restored.binsSeen());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 10.0f, restored.binMean_A(LoadProfile::binCount - 1));
+    restored.reset(ms);
+    TEST_ASSERT_EQUAL_UINT32(0, restored.binsSeen());
+
+    // Wall clock from a host epoch
+    WallClock::clearHostClock();
+    set_mock_millis(0);
+    TEST_ASSERT_FALSE(WallClock::isSet());
+    TEST_ASSERT_FALSE(WallClock::set(1000, 0));
+    const uint32_t midnightUtc = 1749945600UL;                         // 2025-06-15 00:00 UTC
+    TEST_ASSERT_TRUE(WallClock::set(midnightUtc - 120 * 60, 120));      // 00:00 at UTC+2
+    TEST_ASSERT_EQUAL_UINT32(0, WallClock::localSecondOfDay());
+    set_mock_millis(3600 * 1000);
+    TEST_ASSERT_EQUAL_UINT32(3600, WallClock::localSecondOfDay());
+    WallClock::set(midnightUtc, 0);
+    TEST_ASSERT_EQUAL(0, WallClock::utcOffsetMinutes());
+
+    // Integrated: the profile takes over the run-flat text once learned
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    bool warning;
+    for (uint32_t t = 3600 * 1000; t <= 3600 * 1000 + 8 * 3600 * 1000; t += 10000) {
+        set_mock_millis(t);
+        adc.updateBatteryCapacity(WallClock::localSecondOfDay() < 6 * 3600 ? 1.0f : 3.0f);
+    }
+    TEST_ASSERT_TRUE(adc.getLoadProfile().binsSeen() >= LoadProfile::binsPerHour * 6);
+    String text = adc.getAveragedRunFlatTime(12.0f, warning);
+    const float hours = adc.getLoadProfile().hoursToEmpty(adc.getBatteryCapacity(), 100.0f,
+                                                          WallClock::localSecondOfDay(), 3.0f);
+    TEST_ASSERT_TRUE(hours > 24.0f && hours < 48.0f);
+    char expected[40];
+    snprintf(expected, sizeof(expected), "1 day %u hours until flat", (unsigned)((uint32_t)(hours * 60.0f) / 60 - 24));
+    TEST_ASSERT_EQUAL_STRING(expected, text.c_str());
+    WallClock::clearHostClock();
+}
+
+void test_lifetime_stats(void) {
+    Preferences::clear_static();
+    CoulombCounter cc(100.0f);
+    LifetimeStats stats;
+    TEST_ASSERT_FALSE(stats.load());
+
+    // 10A for 1h at 12.5V, then 5A charge for 1h at 13.5V
+    cc.addSample(10000000, 0);
+    stats.addSample(cc, 12.5f, 11.0f, 0);
+    cc.addSample(10000000, 3600000);
+    stats.addSample(cc, 12.5f, 11.0f, 3600000);
+    cc.addSample(-5000000, 3600000);
+    cc.addSample(-5000000, 7200000);
+    stats.addSample(cc, 13.5f, 11.0f, 7200000);
+    stats.addSample(cc, 4.9f, 11.0f, 7300000);                          // USB power: ignored
+
+    // Resting below the cutoff for 90.5 s
+    stats.addSample(cc, 10.8f, 11.0f, 7400000);
+    stats.addSample(cc, 10.8f, 11.0f, 7490500);
+    stats.recordTrip(LOW_VOLTAGE);
+    stats.recordTrip(OVERCURRENT);
+    stats.recordTrip(LOW_VOLTAGE);
+
+    const LifetimeStatsRecord &r = stats.record();
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 10.0, r.chargeOut_Ah);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 5.0, r.chargeIn_Ah);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 125.0, r.energyOut_Wh);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4, 67.5, r.energyIn_Wh);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0.1, r.cycles);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.9f, r.deepestSoc);
+    TEST_ASSERT_EQUAL_FLOAT(10.8f, r.minVoltage_V);
+    TEST_ASSERT_EQUAL_FLOAT(13.5f, r.maxVoltage_V);
+    TEST_ASSERT_EQUAL_UINT32(90, r.secondsBelowLvd);
+    TEST_ASSERT_EQUAL_UINT32(2, r.trips[LOW_VOLTAGE]);
+    TEST_ASSERT_EQUAL_UINT32(1, r.trips[OVERCURRENT]);
+
+    // Bounded checkpoints: nothing before the interval, then one write
+    TEST_ASSERT_FALSE(stats.checkpoint(60000));
+    TEST_ASSERT_TRUE(stats.checkpoint(LifetimeStats::checkpointInterval));
+    TEST_ASSERT_FALSE(stats.checkpoint(2 * LifetimeStats::checkpointInterval));   // unchanged
+    stats.recordTrip(OVERVOLTAGE);
+    TEST_ASSERT_FALSE(stats.checkpoint(LifetimeStats::checkpointInterval + 1000));
+    TEST_ASSERT_TRUE(stats.checkpoint(LifetimeStats::checkpointInterval + 1000, true));
+
+    LifetimeStats reloaded;
+    TEST_ASSERT_TRUE(reloaded.load());
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 10.0, reloaded.record().chargeOut_Ah);
+    TEST_ASSERT_EQUAL_UINT32(1, reloaded.record().trips[OVERVOLTAGE]);
+
+    // Protection trips are counted by the ADC helper
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setLoadConnected(false, OVERCURRENT);
+    adc.setLoadConnected(false, OVERCURRENT);                           // already off: not a new trip
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getLifetimeStats().trips[OVERCURRENT]);
+    adc.setLoadConnected(true, NONE);
+    adc.setLoadConnected(false, MANUAL);                                // by hand: not a trip
+    TEST_ASSERT_EQUAL_UINT32(0, adc.getLifetimeStats().trips[MANUAL]);
+
+    // begin() loads the stored history before it touches the load switch
+    INA226_ADC booted(0x40, 0.001, 100.0);
+    booted.begin(6, 10);
+    TEST_ASSERT_EQUAL_UINT32(1, booted.getLifetimeStats().trips[OVERVOLTAGE]);
+    booted.setLoadConnected(false, OVERCURRENT);
+    TEST_ASSERT_EQUAL_UINT32(2, booted.getLifetimeStats().trips[OVERCURRENT]);
+    TEST_ASSERT_EQUAL_UINT32(1, booted.getLifetimeStats().trips[OVERVOLTAGE]);
+    Preferences::clear_static();
+
+    // A version 1 record (four trip slots) is migrated, then saved in the new layout
+    LifetimeStatsRecordV1 v1;
+    memset(&v1, 0, sizeof(v1));
+    v1.chargeOut_Ah = 42.0;
+    v1.deepestSoc = 0.3f;
+    v1.trips[OVERCURRENT] = 7;
+    v1.version = 1;
+    v1.crc = SocJournal::crc32(&v1, offsetof(LifetimeStatsRecordV1, crc));
+    Preferences prefs;
+    prefs.begin(NVS_LIFETIME_NAMESPACE, false);
+    prefs.putBytes(NVS_KEY_LIFETIME_STATS, &v1, sizeof(v1));
+    prefs.end();
+    LifetimeStats migrated;
+    TEST_ASSERT_TRUE(migrated.load());
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 42.0, migrated.record().chargeOut_Ah);
+    TEST_ASSERT_EQUAL_UINT32(7, migrated.record().trips[OVERCURRENT]);
+    TEST_ASSERT_EQUAL_UINT32(0, migrated.record().trips[OVERVOLTAGE]);
+    TEST_ASSERT_EQUAL_UINT32(0, migrated.record().ocRetries);
+    TEST_ASSERT_TRUE(migrated.checkpoint(0, true));
+    LifetimeStats current;
+    TEST_ASSERT_TRUE(current.load());
+    TEST_ASSERT_EQUAL_UINT32(7, current.record().trips[OVERCURRENT]);
+    Preferences::clear_static();
+}
+
+void test_capacity_learning(void) {
+    const uint64_t nAsPerAh = (uint64_t)CoulombCounter::nAsPerAh;
+    CapacityEstimator est(100.0f);
+
+    // Full charge, then 64Ah delivered down to an OCV anchor at 20 %: 80Ah pack
+    TEST_ASSERT_FALSE(est.addAnchor(1.0f, 0.0f, 0, 0));
+    TEST_ASSERT_FALSE(est.addAnchor(0.8f, 0.02f, 0, 16 * nAsPerAh));  // too shallow, keeps the full anchor
+    TEST_ASSERT_FALSE(est.addAnchor(0.5f, 0.10f, 0, 40 * nAsPerAh));  // flat part of the curve: ignored
+    TEST_ASSERT_TRUE(est.addAnchor(0.2f, 0.02f, 0, 64 * nAsPerAh));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 80.0f, est.lastEstimate_Ah());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 100.0f - 0.4f * 20.0f, est.capacity_Ah());  // gain 0.5 x 0.8 span
+    TEST_ASSERT_EQUAL_UINT32(1, est.estimateCount());
+
+    // Recharged in between: not a clean discharge, the next anchor starts over
+    TEST_ASSERT_FALSE(est.addAnchor(0.9f, 0.02f, 60 * nAsPerAh, 64 * nAsPerAh));
+    // Partial cycle between two OCV anchors converges further
+    TEST_ASSERT_TRUE(est.addAnchor(0.4f, 0.02f, 60 * nAsPerAh, 108 * nAsPerAh));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 88.0f, est.lastEstimate_Ah());
+    TEST_ASSERT_TRUE(est.capacity_Ah() < 92.0f && est.capacity_Ah() > 88.0f);
+    // Implausible result (wrong anchor) is rejected
+    est.addAnchor(1.0f, 0.0f, 200 * nAsPerAh, 108 * nAsPerAh);
+    TEST_ASSERT_FALSE(est.addAnchor(0.5f, 0.02f, 200 * nAsPerAh, 118 * nAsPerAh));
+    TEST_ASSERT_EQUAL_UINT32(2, est.estimateCount());
+
+    Preferences::clear_static();
+    est.save();
+    CapacityEstimator reloaded(100.0f);
+    TEST_ASSERT_TRUE(reloaded.load());
+    TEST_ASSERT_EQUAL_FLOAT(est.capacity_Ah(), reloaded.capacity_Ah());
+    CapacityEstimator otherPack(200.0f);
+    TEST_ASSERT_FALSE(otherPack.load());
+    TEST_ASSERT_EQUAL_FLOAT(200.0f, otherPack.capacity_Ah());
+
+    // Integrated: detected full charge, 68Ah out, rest at 12.65V (15 % on the
+    // LiFePO4 curve): an 80Ah pack
+    Preferences::clear_static();
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    ChargeDetectorParams p = {14.0f, 4.0f, 180};
+    adc.setChargeDetectorParams(p);
+    INA226_WE::mockBusVoltage_V = 14.1f;
+    INA226_WE::mockCurrent_mA = -2000.0f;
+    uint32_t ms = 1000;
+    for (; ms <= 200000; ms += 10000) {
+        set_mock_millis(ms);
+        adc.readSensors();
+        adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getChargeDetector().fullChargeCount());
+    INA226_WE::mockBusVoltage_V = 12.65f;
+    INA226_WE::mockCurrent_mA = 68000.0f;
+    set_mock_millis(ms);
+    adc.readSensors();
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    ms += 3600UL * 1000UL;
+    set_mock_millis(ms);
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    INA226_WE::mockCurrent_mA = 0.0f;
+    for (uint32_t end = ms + 31UL * 60UL * 1000UL; ms <= end; ms += 60000) {
+        set_mock_millis(ms);
+        adc.readSensors();
+        adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getCapacityEstimator().estimateCount());
+    TEST_ASSERT_FLOAT_WITHIN(0.3f, 80.0f, adc.getCapacityEstimator().lastEstimate_Ah());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.915f, adc.getStateOfHealth());
+    TEST_ASSERT_EQUAL_FLOAT(adc.getCapacityEstimator().capacity_Ah(), adc.getEffectiveCapacity_Ah());
+    TEST_ASSERT_TRUE(adc.getStateOfCharge() < 0.2f);
+
+    // Same cycle resting on the LiFePO4 plateau (13.07V, 54 %): the reading
+    // still resyncs SOC but is no anchor, however plausible its estimate
+    Preferences::clear_static();
+    INA226_ADC flat(0x40, 0.001, 100.0);
+    flat.setChargeDetectorParams(p);
+    INA226_WE::mockBusVoltage_V = 14.1f;
+    INA226_WE::mockCurrent_mA = -2000.0f;
+    for (ms = 1000; ms <= 200000; ms += 10000) {
+        set_mock_millis(ms);
+        flat.readSensors();
+        flat.updateBatteryCapacity(flat.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, flat.getChargeDetector().fullChargeCount());
+    INA226_WE::mockBusVoltage_V = 13.07f;
+    INA226_WE::mockCurrent_mA = 40000.0f;
+    set_mock_millis(ms);
+    flat.readSensors();
+    flat.updateBatteryCapacity(flat.getCurrent_mA() / 1000.0f);
+    ms += 3600UL * 1000UL;
+    set_mock_millis(ms);
+    flat.updateBatteryCapacity(flat.getCurrent_mA() / 1000.0f);
+    INA226_WE::mockCurrent_mA = 0.0f;
+    for (uint32_t end = ms + 31UL * 60UL * 1000UL; ms <= end; ms += 60000) {
+        set_mock_millis(ms);
+        flat.readSensors();
+        flat.updateBatteryCapacity(flat.getCurrent_mA() / 1000.0f);
+    }
+    TEST_ASSERT_TRUE(flat.getOcvResync().lastOnPlateau());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.54f, flat.getOcvResync().lastOcvSoc());
+    TEST_ASSERT_EQUAL_UINT32(0, flat.getCapacityEstimator().estimateCount());
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, flat.getStateOfHealth());
+    INA226_WE::mockBusVoltage_V = 0.0f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+}
+
+void test_soc_ekf_converges(void) {
+    SocEkf ekf;
+    size_t n;
+    const OcvPoint *curve = AgmChemistry::ocvCurve(n);
+    ekf.setCurve(curve, n);
+
+    float slope;
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 12.30f, ekf.ocvFromSoc(0.5f, slope));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 1.2f, slope);
+
+    // Truth: 100Ah at 90 %, R0 12 mOhm, one RC branch. Filter starts at 60 %.
+    ekf.reset(0.6f, 0.3f, 0.01f);
+    float soc = 0.9f, vp = 0.0f;
+    const float r0 = 0.012f, r1 = 0.005f, tau = 60.0f;
+    const float a = expf(-0.25f / tau);
+    for (uint32_t k = 0; k < 4UL * 3600UL * 4UL; ++k) {
+        // 5A base load with a 30A load two minutes in every ten
+        const float i = ((k / 4) % 600) < 120 ? 30.0f : 5.0f;
+        const float delta = k ? -i * 0.25f / 3600.0f / 100.0f : 0.0f;
+        soc += delta;
+        vp = a * vp + (1.0f - a) * r1 * i;
+        float d;
+        const float v = ekf.ocvFromSoc(soc, d) - r0 * i - vp;
+        ekf.update(delta, i, v, k * 250);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, soc, ekf.soc());
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, r0, ekf.r0_Ohm());
+    TEST_ASSERT_TRUE(ekf.socSigma() < 0.05f);
+
+    // On USB power only the prediction runs: nothing to hand back to the counter
+    uint32_t t = 4UL * 3600UL * 4UL * 250UL;
+    ekf.update(-0.0001f, 1.0f, 5.0f, t);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, ekf.lastCorrection());
+    // A sag the model does not explain pulls SOC down beyond the counted step
+    const float prior = ekf.soc();
+    ekf.update(0.0f, 5.0f, 11.5f, t += 250);
+    TEST_ASSERT_TRUE(ekf.lastCorrection() < 0.0f);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6f, ekf.soc() - prior, ekf.lastCorrection());
+
+    // Full charge detected elsewhere: SOC taken over, R0 kept
+    ekf.setSoc(1.0f, 0.005f);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, ekf.soc());
+    TEST_ASSERT_FLOAT_WITHIN(0.002f, r0, ekf.r0_Ohm());
+}
+
+void test_rainflow_counting(void) {
+    Preferences::clear_static();
+    RainflowCounter rf;
+    const float path[] = {1.0f, 0.55f, 0.67f, 0.61f, 0.93f, 0.2f, 1.0f, 0.9f};
+    for (size_t i = 0; i < sizeof(path) / sizeof(path[0]); ++i) {
+        rf.addSoc(path[i]);
+        rf.addSoc(path[i] + 0.002f);                                   // inside the deadband
+        rf.addSoc(path[i]);
+    }
+    // 0.67-0.61 and 0.55-0.93 close as full cycles, 1.0-0.2 is a half cycle
+    // (peaks 0.002 higher, from the wiggle). None sits at its bin's midpoint,
+    // and each is weighted by its own depth.
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, rf.cycles(0));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, rf.cycles(3));
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, rf.cycles(8));
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.062f, rf.meanDepth(0));
+    TEST_ASSERT_FLOAT_WITHIN(2e-3f, 0.062f + 0.382f + 0.5f * 0.802f, rf.equivalentFullCycles());
+    const float expectedDamage = (powf(0.062f, 1.2f) + powf(0.382f, 1.2f) + 0.5f * powf(0.802f, 1.2f)) / 400.0f;
+    TEST_ASSERT_FLOAT_WITHIN(expectedDamage * 0.01f, expectedDamage, rf.damage(400.0f, 1.2f));
+    TEST_ASSERT_EQUAL(2, rf.residueCount());
+
+    // Histogram and residue survive a restart
+    TEST_ASSERT_TRUE(rf.checkpoint(1000, true));
+    RainflowCounter restored;
+    TEST_ASSERT_TRUE(restored.load());
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, restored.cycles(8));
+    TEST_ASSERT_EQUAL_FLOAT(rf.equivalentFullCycles(), restored.equivalentFullCycles());
+    TEST_ASSERT_EQUAL(2, restored.residueCount());
+    TEST_ASSERT_FALSE(restored.checkpoint(2000));                       // nothing new
+
+    // A count-only record from before depth sums loads at bin midpoints
+    RainflowRecordV1 old;
+    memset(&old, 0, sizeof(old));
+    old.halfCycles[3] = 4;
+    old.crc = SocJournal::crc32(&old, offsetof(RainflowRecordV1, crc));
+    Preferences prefs;
+    prefs.begin(NVS_RAINFLOW_NAMESPACE, false);
+    prefs.putBytes(NVS_KEY_RAINFLOW, &old, sizeof(old));
+    prefs.end();
+    RainflowCounter migrated;
+    TEST_ASSERT_TRUE(migrated.load());
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.35f, migrated.meanDepth(3));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.7f, migrated.equivalentFullCycles());
+    TEST_ASSERT_TRUE(migrated.checkpoint(2000, true));
+    Preferences::clear_static();
+
+    // A long converging oscillation cannot grow the residue past the stack
+    RainflowCounter conv;
+    for (int k = 0; k < 40; ++k) {
+        const float amp = 0.5f - k * 0.012f;
+        conv.addSoc(0.5f + ((k & 1) ? amp : -amp));
+    }
+    TEST_ASSERT_TRUE(conv.residueCount() <= RainflowCounter::stackSize);
+    TEST_ASSERT_TRUE(conv.equivalentFullCycles() > 0.0f);
 }
 
 void test_run_flat_time_formatted(void) {
@@ -120,7 +982,7 @@ void test_run_flat_time_formatted(void) {
         INA226_ADC adc(0x40, 0.001, 100.0);
         // Set current capacity to 50Ah by discharging for 1h at 50A
         set_mock_millis(1);
-        adc.updateBatteryCapacity(0); // init
+        adc.updateBatteryCapacity(50.0); // init
         set_mock_millis(1 + 3600 * 1000);
         adc.updateBatteryCapacity(50.0);
         TEST_ASSERT_EQUAL_FLOAT(50.0, adc.getBatteryCapacity());
@@ -136,7 +998,7 @@ void test_run_flat_time_formatted(void) {
         INA226_ADC adc(0x40, 0.001, 100.0);
         // Set current capacity to 99.6Ah
         set_mock_millis(1);
-        adc.updateBatteryCapacity(0); // init
+        adc.updateBatteryCapacity(0.4); // init
         set_mock_millis(1 + 3600 * 1000);
         adc.updateBatteryCapacity(0.4);
 
@@ -171,23 +1033,72 @@ void test_averaged_run_flat_time(void) {
     bool warning;
 
     // 1. Initial state
-    String result = adc.getAveragedRunFlatTime(10.0, 12.0, warning);
+    set_mock_millis(0);
+    adc.updateBatteryCapacity(10.0f);
+    String result = adc.getAveragedRunFlatTime(12.0, warning);
     TEST_ASSERT_EQUAL_STRING("Gathering data...", result.c_str());
 
-    // 2. Not enough samples yet
+    // 2. Average covers the warm-up time; the 10 s drawn leave 99.97 Ah -> 9.997 h
     set_mock_millis(10000); // 10s
-    result = adc.getAveragedRunFlatTime(10.0, 12.0, warning);
-    TEST_ASSERT_EQUAL_STRING("10 hours until flat", result.c_str());
+    adc.updateBatteryCapacity(10.0f);
+    result = adc.getAveragedRunFlatTime(12.0, warning);
+    TEST_ASSERT_EQUAL_STRING("9 hours until flat", result.c_str());
+    TEST_ASSERT_TRUE(warning);
+
+    // Reading is free of side effects: repeated calls change nothing
+    for (int i = 0; i < 20; ++i) adc.getAveragedRunFlatTime(12.0, warning);
+    TEST_ASSERT_EQUAL_STRING("9 hours until flat", adc.getAveragedRunFlatTime(12.0, warning).c_str());
+
+    // 3. Load drops to 5 A for one time constant: 5 + 5/e = 6.84 A -> 14.5 h
+    TEST_ASSERT_EQUAL_FLOAT(300.0f, adc.getRunFlatTimeConstant_s());
+    for (uint32_t t = 20000; t <= 310000; t += 10000) {
+        set_mock_millis(t);
+        adc.updateBatteryCapacity(5.0f);
+    }
+    result = adc.getAveragedRunFlatTime(12.0, warning);
+    TEST_ASSERT_EQUAL_STRING("14 hours until flat", result.c_str());
+    TEST_ASSERT_FALSE(warning);
 
-    // 3. Provide enough samples for averaging
-    set_mock_millis(20000); // 20s
-    adc.getAveragedRunFlatTime(10.0, 12.0, warning);
-    set_mock_millis(30000); // 30s
-    adc.getAveragedRunFlatTime(5.0, 12.0, warning); // run flat time is 20 hours
+    // Same history sampled ten times as often gives the same answer
+    {
+        INA226_ADC fast(0x40, 0.001, 100.0);
+        for (uint32_t t = 0; t <= 10000; t += 1000) {
+            set_mock_millis(t);
+            fast.updateBatteryCapacity(10.0f);
+        }
+        for (uint32_t t = 11000; t <= 310000; t += 1000) {
+            set_mock_millis(t);
+            fast.updateBatteryCapacity(5.0f);
+        }
+        TEST_ASSERT_EQUAL_STRING(result.c_str(), fast.getAveragedRunFlatTime(12.0, warning).c_str());
+    }
 
-    // Average of 10h, 10h, 20h is 13.33h
-    result = adc.getAveragedRunFlatTime(5.0, 12.0, warning);
-    TEST_ASSERT_EQUAL_STRING("13 hours until flat", result.c_str());
+    // A single idle sample barely moves the current average
+    set_mock_millis(320000);
+    adc.updateBatteryCapacity(0.0f);
+    set_mock_millis(330000);
+    adc.updateBatteryCapacity(5.0f);
+    result = adc.getAveragedRunFlatTime(12.0, warning);
+    TEST_ASSERT_EQUAL_STRING("15 hours until flat", result.c_str());
+
+    // Same text straight into the telemetry field
+    struct_message_ae_smart_shunt_1 msg;
+    memset(msg.runFlatTime, 'x', sizeof(msg.runFlatTime));
+    adc.getAveragedRunFlatTime(12.0, warning, msg.runFlatTime, sizeof(msg.runFlatTime));
+    TEST_ASSERT_EQUAL_STRING("15 hours until flat", msg.runFlatTime);
+
+    // Bounded: a short buffer is truncated and still terminated
+    char small[8];
+    adc.getAveragedRunFlatTime(12.0, warning, small, sizeof(small));
+    TEST_ASSERT_EQUAL_STRING("15 hour", small);
+
+    // Time constant is validated and persisted
+    TEST_ASSERT_FALSE(adc.setRunFlatTimeConstant_s(0.0f));
+    TEST_ASSERT_TRUE(adc.setRunFlatTimeConstant_s(60.0f));
+    Preferences prefs;
+    prefs.begin(NVS_BATTERY_MODEL_NAMESPACE, true);
+    TEST_ASSERT_EQUAL_FLOAT(60.0f, prefs.getFloat(NVS_KEY_RUN_FLAT_TAU, 0.0f));
+    prefs.end();
 }
 
 void test_calibration_persistence(void) {
@@ -214,6 +1125,215 @@ void test_calibration_persistence(void) {
     }
 }
 
+void test_calibration_table_interpolation(void) {
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    std::vector<CalPoint> points = {{2000.0f, 2100.0f}, {0.0f, 0.0f}, {1000.0f, 1000.0f}};
+    TEST_ASSERT_TRUE(adc.saveCalibrationTable(100, points));
+
+    // Reload from NVS: a stored table takes priority over any factory table
+    INA226_ADC adc2(0x40, 0.001, 100.0);
+    TEST_ASSERT_TRUE(adc2.loadCalibrationTable(100));
+    TEST_ASSERT_FALSE(adc2.isUsingFactoryCalibration());
+
+    size_t count = 0;
+    const CalPoint *table = adc2.getCalibrationTable(count);
+    TEST_ASSERT_EQUAL(3, count);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, table[0].raw_mA); // sorted
+
+    INA226_WE::mockCurrent_mA = 1500.0;
+    adc2.readSensors();
+    TEST_ASSERT_EQUAL_FLOAT(1550.0f, adc2.getCurrent_mA());
+
+    // No NVS table and no factory table compiled in for this rating
+    TEST_ASSERT_FALSE(adc2.loadCalibrationTable(450));
+    TEST_ASSERT_FALSE(adc2.hasCalibrationTable());
+}
+
+void test_factory_calibration_fallback(void) {
+    Preferences::clear_static();
+    static const CalPoint points50[] = {{0.0f, 0.0f}, {1000.0f, 1020.0f}, {10000.0f, 10100.0f}};
+    static const FactoryCalTable tables[] = {{50, 0.00095f, points50, 3}, {0, 0.0f, nullptr, 0}};
+    INA226_ADC::setFactoryCalTables(tables);
+    TEST_ASSERT_NULL(INA226_ADC::getFactoryCalibration(100));
+    TEST_ASSERT_TRUE(INA226_ADC::getFactoryCalibration(50) == &tables[0]);
+
+    // Fresh board, nothing in NVS: begin() takes the factory resistance and table
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.begin(6, 10);
+    TEST_ASSERT_EQUAL_FLOAT(0.00095f, adc.getShuntResistance_Ohms());
+    TEST_ASSERT_TRUE(adc.isUsingFactoryCalibration());
+    INA226_WE::mockCurrent_mA = 5500.0f;
+    adc.readSensors();
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 5560.0f, adc.getCurrent_mA());       // halfway from 1020 to 10100
+
+    // A field table wins; clearing it falls back to the factory table
+    std::vector<CalPoint> field = {{0.0f, 0.0f}, {10000.0f, 10000.0f}};
+    TEST_ASSERT_TRUE(adc.saveCalibrationTable(50, field));
+    TEST_ASSERT_FALSE(adc.isUsingFactoryCalibration());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 5500.0f, adc.getCurrent_mA());
+    TEST_ASSERT_TRUE(adc.clearCalibrationTable(50));
+    TEST_ASSERT_TRUE(adc.isUsingFactoryCalibration());
+    TEST_ASSERT_TRUE(adc.hasCalibrationTable());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 5560.0f, adc.getCurrent_mA());
+
+    // No factory table for the rating: clearing leaves the raw reading
+    TEST_ASSERT_TRUE(adc.saveCalibrationTable(100, field));
+    TEST_ASSERT_TRUE(adc.clearCalibrationTable(100));
+    TEST_ASSERT_FALSE(adc.hasCalibrationTable());
+    INA226_ADC::setFactoryCalTables(nullptr);
+    INA226_WE::mockCurrent_mA = 0.0f;
+    Preferences::clear_static();
+
+    // A board flashed with a 100A table and no shunt chosen yet starts on 100A
+    static const CalPoint points100[] = {{0.0f, 0.0f}, {20000.0f, 20400.0f}};
+    static const FactoryCalTable tables100[] = {{100, 0.00048f, points100, 2}, {0, 0.0f, nullptr, 0}};
+    INA226_ADC::setFactoryCalTables(tables100);
+    TEST_ASSERT_EQUAL(100, INA226_ADC::getFactoryDefaultShunt());
+    INA226_ADC fresh(0x40, 0.001, 100.0);
+    fresh.begin(6, 10);
+    TEST_ASSERT_EQUAL(100, fresh.getActiveShuntA());
+    TEST_ASSERT_EQUAL_FLOAT(0.00048f, fresh.getShuntResistance_Ohms());
+    TEST_ASSERT_TRUE(fresh.isUsingFactoryCalibration());
+    INA226_WE::mockCurrent_mA = 10000.0f;
+    fresh.readSensors();
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10200.0f, fresh.getCurrent_mA());
+    // A rating chosen in the field still wins
+    Preferences prefs;
+    prefs.begin(NVS_CAL_NAMESPACE, false);
+    prefs.putUShort(NVS_KEY_ACTIVE_SHUNT, 50);
+    prefs.end();
+    INA226_ADC chosen(0x40, 0.001, 100.0);
+    chosen.begin(6, 10);
+    TEST_ASSERT_EQUAL(50, chosen.getActiveShuntA());
+    TEST_ASSERT_FALSE(chosen.isUsingFactoryCalibration());
+    INA226_ADC::setFactoryCalTables(nullptr);
+    TEST_ASSERT_EQUAL(50, INA226_ADC::getFactoryDefaultShunt());
+    INA226_WE::mockCurrent_mA = 0.0f;
+    Preferences::clear_static();
+}
+
+class FakeJigTarget : public CalJigTarget {
+public:
+    FakeJigTarget() : now(0), committedShunt(0), ohms(0.0f), raw(1000.0f), noise(0.0f), reads(0) {}
+    void readSample(float &raw_mA, float &cal_mA, float &shunt_mV, float &bus_V) override {
+        raw_mA = raw + ((reads++ & 1) ? noise : -noise);
+        cal_mA = raw_mA; shunt_mV = 1.0f; bus_V = 13.0f;
+    }
+    unsigned long nowMs() override { return now; }
+    void delayMs(unsigned long ms) override { now += ms; }
+    bool selectShunt(uint16_t) override { return true; }
+    bool commitTable(uint16_t shuntRatedA, const std::vector<CalPoint> &points) override {
+        committedShunt = shuntRatedA; committed = points; return true;
+    }
+    bool commitShuntOhms(float o) override { ohms = o; return true; }
+    void setLoadConnected(bool) override {}
+    void armAlert(float) override {}
+    bool pollAlertFired() override { return false; }
+    void restoreAlert() override {}
+    void writeLine(const char *line) override { last = line; }
+
+    unsigned long now;
+    uint16_t committedShunt;
+    float ohms;
+    std::vector<CalPoint> committed;
+    std::string last;
+    float raw;
+    float noise;        // alternate samples sit this far either side of raw
+    unsigned reads;
+};
+
+void test_cal_jig_protocol(void) {
+    FakeJigTarget target;
+    CalJig jig(target);
+    jig.begin();
+    TEST_ASSERT_TRUE(jig.isActive());
+
+    jig.handleLine("cal:shunt 100");
+    TEST_ASSERT_EQUAL_STRING("#0,OK,*", target.last.substr(0, 7).c_str());
+    // Frame checksum covers everything between '#' and '*'
+    size_t star = target.last.find('*');
+    unsigned sum = (unsigned)strtoul(target.last.c_str() + star + 1, nullptr, 16);
+    TEST_ASSERT_EQUAL(CalJig::checksum(target.last.c_str() + 1, target.last.c_str() + star), sum);
+
+    jig.handleLine("CAL:POINT 0,0");
+    jig.handleLine("CAL:TARGET 1010");
+    jig.handleLine("CAL:SAMPLE 4");
+    jig.handleLine("CAL:COMMIT");
+    TEST_ASSERT_EQUAL(100, target.committedShunt);
+    TEST_ASSERT_EQUAL(2, target.committed.size());
+    TEST_ASSERT_EQUAL_FLOAT(1000.0f, target.committed[1].raw_mA);
+    TEST_ASSERT_EQUAL_FLOAT(1010.0f, target.committed[1].true_mA);
+
+    // 1 mV at 1.01 A
+    jig.handleLine("CAL:OHMS:COMMIT");
+    TEST_ASSERT_EQUAL_FLOAT(0.001f / 1.01f, target.ohms);
+
+    jig.handleLine("BOGUS");
+    TEST_ASSERT_EQUAL_STRING("#6,ERR,UNKNOWN_COMMAND", target.last.substr(0, 22).c_str());
+
+    // 0.5 mA of noise on a 50 A reading: sum(x^2)/n - mean^2 in float would
+    // lose it entirely
+    target.raw = 50000.0f;
+    target.noise = 0.5f;
+    jig.handleLine("CAL:TARGET 50000");
+    jig.handleLine("CAL:SAMPLE 100");
+    TEST_ASSERT_EQUAL_STRING("#8,OK,50000.000,1.0000,0.500,3*", target.last.substr(0, 31).c_str());
+
+    jig.handleLine("JIG:EXIT");
+    TEST_ASSERT_FALSE(jig.isActive());
+}
+
+void test_cal_math_shared_helpers(void) {
+    std::vector<CalPoint> pts = {{2000.0f, 2100.0f}, {0.0f, 5.0f}, {1000.0f, 1000.0f}, {1000.0f, 1040.0f}};
+    sortAndDedupCalPoints(pts);
+    TEST_ASSERT_EQUAL(3, pts.size());
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, pts[0].raw_mA);
+    TEST_ASSERT_EQUAL_FLOAT(1020.0f, pts[1].true_mA); // duplicates averaged
+
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, interpolateCalTable(pts.data(), pts.size(), -50.0f));   // clamp low
+    TEST_ASSERT_EQUAL_FLOAT(1560.0f, interpolateCalTable(pts.data(), pts.size(), 1500.0f));
+    TEST_ASSERT_EQUAL_FLOAT(2100.0f, interpolateCalTable(pts.data(), pts.size(), 9000.0f)); // clamp high
+    TEST_ASSERT_EQUAL_FLOAT(123.0f, interpolateCalTable(nullptr, 0, 123.0f));             // identity
+
+    // 1 mOhm shunt; the zero-current point is skipped
+    const float amps[] = {0.0f, 1.0f, 10.0f};
+    const float mV[] = {0.01f, 1.0f, 10.0f};
+    size_t valid = 0;
+    TEST_ASSERT_FLOAT_WITHIN(1e-9f, 0.001f, averageShuntOhms(amps, mV, 3, valid));
+    TEST_ASSERT_EQUAL(2, valid);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, averageShuntOhms(amps, mV, 1, valid));
+    TEST_ASSERT_EQUAL(0, valid);
+}
+
+void test_cal_sweep_fit_and_decimate(void) {
+    CalSweep sweep;
+    TEST_ASSERT_TRUE(sweep.begin(100.0f, 10000.0f));
+    TEST_ASSERT_FALSE(sweep.begin(1.0f, 10000.0f)); // too many bins
+    TEST_ASSERT_TRUE(sweep.begin(100.0f, 10000.0f));
+
+    // Sensor reads 2% high above 5A, exact below: two straight segments
+    for (int i = 0; i <= 1000; ++i) {
+        float ref = i * 10.0f;
+        float raw = ref <= 5000.0f ? ref : 5000.0f + (ref - 5000.0f) * 1.02f;
+        TEST_ASSERT_TRUE(sweep.addSample(raw, ref));
+    }
+    // One bin sees a wild reading -> rejected as an outlier bin
+    sweep.addSample(3000.0f + 500.0f, 3000.0f);
+    TEST_ASSERT_FALSE(sweep.addSample(0.0f, 20000.0f)); // out of range
+
+    std::vector<CalPoint> dense;
+    size_t rejected = sweep.buildDenseTable(dense);
+    TEST_ASSERT_EQUAL(1, rejected);
+    TEST_ASSERT_EQUAL(100, dense.size());
+
+    std::vector<CalPoint> reduced;
+    float worst = CalSweep::decimate(dense, 1.0f, reduced);
+    TEST_ASSERT_TRUE(worst <= 1.0f);
+    TEST_ASSERT_TRUE(reduced.size() <= 4);
+    TEST_ASSERT_EQUAL_FLOAT(dense.front().raw_mA, reduced.front().raw_mA);
+    TEST_ASSERT_EQUAL_FLOAT(dense.back().raw_mA, reduced.back().raw_mA);
+}
+
 void test_espnow_handler(void) {
     uint8_t broadcastAddress[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
     ESPNowHandler handler(broadcastAddress);
@@ -258,13 +1378,8 @@ void test_main_loop_logic(void) {
     set_mock_millis(1000 + 3600 * 1000);
     adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
 
-    float remainingAh = adc.getBatteryCapacity();
-    shunt_message.batteryCapacity = remainingAh;
-    if (ratedCapacity > 0.0f) {
-        shunt_message.batterySOC = remainingAh / ratedCapacity;
-    } else {
-        shunt_message.batterySOC = 0.0f;
-    }
+    shunt_message.batteryCapacity = adc.getBatteryCapacity();
+    shunt_message.batterySOC = adc.getStateOfCharge();
 
     // Assertions
     TEST_ASSERT_EQUAL_FLOAT(12.8, shunt_message.batteryVoltage);
@@ -298,29 +1413,429 @@ void test_protection_settings_persistence(void) {
 void test_low_voltage_disconnect(void) {
     INA226_ADC adc(0x40, 0.001, 100.0);
     adc.setProtectionSettings(9.0f, 0.5f, 50.0f);
+    set_mock_millis(0);
     adc.setLoadConnected(true);
 
-    INA226_WE::mockBusVoltage_V = 8.9f; // Below cutoff
+    // Below cutoff: blanked while arming (2s), then debounced (2s)
+    INA226_WE::mockBusVoltage_V = 8.9f;
+    for (uint32_t t = 0; t < 4000; t += 250) {
+        set_mock_millis(t);
+        adc.readSensors();
+        adc.checkAndHandleProtection();
+        TEST_ASSERT_TRUE(adc.isLoadConnected());
+    }
+    TEST_ASSERT_EQUAL(ProtectionEngine::ARMED, adc.getProtection().state());
+    set_mock_millis(4000);
     adc.readSensors();
     adc.checkAndHandleProtection();
 
     TEST_ASSERT_FALSE(adc.isLoadConnected());
+    TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, adc.getProtection().state());
     TEST_ASSERT_EQUAL(LOW, mock_digital_write_get_last_value(LOAD_SWITCH_PIN));
     TEST_ASSERT_TRUE(mock_esp_deep_sleep_called());
 }
 
-void test_overcurrent_disconnect(void) {
+void test_ir_compensated_low_voltage(void) {
+    ResistanceEstimator est;
+    TEST_ASSERT_FALSE(est.addSample(2.0f, 12.80f, 0));
+    TEST_ASSERT_FALSE(est.addSample(2.0f, 12.80f, 250));
+    TEST_ASSERT_TRUE(est.addSample(42.0f, 12.00f, 500));               // 0.8V / 40A = 20 mOhm
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.020f, est.resistance_Ohm());
+    TEST_ASSERT_EQUAL_UINT32(500, est.lastUpdateMs());
+    TEST_ASSERT_TRUE(est.addSample(2.0f, 12.90f, 750));                 // load off: 22.5 mOhm
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.020f + 0.2f * 0.0025f, est.resistance_Ohm());
+    TEST_ASSERT_FALSE(est.addSample(42.0f, 12.00f, 5000));              // too far apart
+    TEST_ASSERT_FALSE(est.addSample(2.0f, 12.00f, 5250));               // voltage did not move: rejected
+    TEST_ASSERT_FALSE(est.addSample(12.0f, 10.00f, 5500));              // 200 mOhm: not a battery
+    TEST_ASSERT_EQUAL_UINT32(2, est.stepCount());
+
+    // 40A load sags a 12.4V battery with 15 mOhm to 11.8V, below an 11.9V cutoff
     INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setProtectionSettings(11.9f, 0.5f, 50.0f);
+    adc.setLoadConnected(true);
+    INA226_WE::mockBusVoltage_V = 12.4f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+    set_mock_millis(1000);
+    adc.readSensors();
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    INA226_WE::mockBusVoltage_V = 11.8f;
+    INA226_WE::mockCurrent_mA = 40000.0f;
+    set_mock_millis(1250);
+    adc.readSensors();
+    adc.updateBatteryCapacity(adc.getCurrent_mA() / 1000.0f);
+    TEST_ASSERT_TRUE(adc.getResistanceEstimator().hasEstimate());
+    // 0.6V of drop, added back only up to the 0.5V hysteresis
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 12.3f, adc.getCompensatedVoltage_V());
+    uint32_t t = 1250;
+    for (; t <= 6000; t += 250) {
+        set_mock_millis(t);
+        adc.checkAndHandleProtection();
+    }
+    TEST_ASSERT_TRUE(adc.isLoadConnected());
+
+    // Without compensation the same sag trips once debounced
+    adc.setIrCompensation(false);
+    for (uint32_t end = t + 2000; t <= end; t += 250) {
+        set_mock_millis(t);
+        adc.checkAndHandleProtection();
+    }
+    TEST_ASSERT_FALSE(adc.isLoadConnected());
+    INA226_WE::mockBusVoltage_V = 0.0f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+}
+
+// Feed one current for a while at 250 ms samples; true if the load is still on
+static bool runCurrent(INA226_ADC &adc, uint32_t &t, float amps, uint32_t durationMs) {
+    INA226_WE::mockCurrent_mA = amps * 1000.0f;
+    for (uint32_t end = t + durationMs; t < end && adc.isLoadConnected();) {
+        t += 250;
+        set_mock_millis(t);
+        adc.readSensors();
+        adc.checkAndHandleProtection();
+    }
+    return adc.isLoadConnected();
+}
+
+void test_overcurrent_disconnect(void) {
+    INA226_ADC adc(0x40, 0.000944464, 100.0);           // Production shunt: reads up to ~86.7A
+    adc.setProtectionSettings(9.0f, 0.5f, 25.0f);      // I2t 5s at 2x, instant at 3x
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 75.0f, adc.getInstantTripCurrent_A());
+    INA226_WE::mockBusVoltage_V = 12.8f;
+    uint32_t t = 0;
+    set_mock_millis(t);
+    adc.setLoadConnected(true);
+
+    // Inrush at 2.4x for 1s rides through (trips after 3.2s), then cools off
+    TEST_ASSERT_TRUE(runCurrent(adc, t, 60.0f, 1000));
+    TEST_ASSERT_TRUE(adc.getProtection().heat() > 0.2f);
+    TEST_ASSERT_TRUE(runCurrent(adc, t, 5.0f, 10000));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, adc.getProtection().heat());
+    // Just above the threshold takes minutes
+    TEST_ASSERT_TRUE(runCurrent(adc, t, 25.5f, 60000));
+
+    // Sustained 2x trips in 5s
+    runCurrent(adc, t, 5.0f, 60000);
+    const uint32_t start = t;
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 50.0f, 10000));
+    TEST_ASSERT_TRUE(t - start >= 4750 && t - start <= 5250);
+    TEST_ASSERT_EQUAL(LOW, mock_digital_write_get_last_value(LOAD_SWITCH_PIN));
+    TEST_ASSERT_FALSE(mock_esp_deep_sleep_called()); // No sleep on overcurrent
+    // No retries configured: latched until switched on by hand
+    TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, adc.getProtection().state());
+    runCurrent(adc, t, 0.0f, 60000);
+    TEST_ASSERT_FALSE(adc.isLoadConnected());
+
+    // Above the instantaneous level one sample is enough
+    adc.setLoadConnected(true);
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 80.0f, 250));
+
+    // 3x of 50A is beyond the shunt's range: clamped to 95% of 81.92mV, so a
+    // short that saturates the reading still trips on the first sample
     adc.setProtectionSettings(9.0f, 0.5f, 50.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 82.4f, adc.getInstantTripCurrent_A());
+    TEST_ASSERT_EQUAL(SHUNT_OVER, INA226_WE::lastAlertType);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.95f * 0.08192f, INA226_WE::lastAlertLimit);
+    adc.setLoadConnected(true);
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 86.7f, 250));
+    INA226_WE::mockCurrent_mA = 0.0f;
+    INA226_WE::mockBusVoltage_V = 0.0f;
+}
+
+void test_overcurrent_auto_retry(void) {
+    Preferences::clear_static();
+    RtcState::invalidate();
+    INA226_ADC adc(0x40, 0.000944464, 100.0);
+    adc.setProtectionSettings(9.0f, 0.5f, 25.0f);      // instant at 75A
+    TEST_ASSERT_FALSE(adc.setOvercurrentRetries(11, 10.0f));
+    TEST_ASSERT_FALSE(adc.setOvercurrentRetries(2, 0.5f));
+    TEST_ASSERT_TRUE(adc.setOvercurrentRetries(2, 10.0f));
+    INA226_WE::mockBusVoltage_V = 12.8f;
+    uint32_t t = 0;
+    set_mock_millis(t);
     adc.setLoadConnected(true);
 
-    INA226_WE::mockCurrent_mA = 51000.0f; // 51A, above threshold
+    // Each short trips at once; the retries come back after 10s, then 20s
+    for (uint8_t attempt = 0; attempt < 2; ++attempt) {
+        TEST_ASSERT_FALSE(runCurrent(adc, t, 80.0f, 250));
+        const uint32_t trippedAt = t;
+        INA226_WE::mockCurrent_mA = 0.0f;
+        while (!adc.isLoadConnected() && t - trippedAt < 60000) {
+            t += 250;
+            set_mock_millis(t);
+            adc.readSensors();
+            adc.checkAndHandleProtection();
+        }
+        TEST_ASSERT_TRUE(adc.isLoadConnected());
+        TEST_ASSERT_EQUAL_UINT32(10000UL << attempt, t - trippedAt);
+        TEST_ASSERT_EQUAL_UINT32(attempt + 1, adc.getLifetimeStats().ocRetries);
+        // The count only clears after a window that doubles per retry: a
+        // fault that comes back after 61s still counts against it
+        TEST_ASSERT_EQUAL_UINT32(60000UL << (attempt + 1), adc.getProtection().retryWindowMs());
+        TEST_ASSERT_TRUE(runCurrent(adc, t, 0.0f, 61000));
+    }
+
+    // Third trip inside the retry window: locked out
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 80.0f, 250));
+    TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, adc.getProtection().state());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getLifetimeStats().ocLockouts);
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 0.0f, 120000));
+    TEST_ASSERT_EQUAL_UINT32(3, adc.getLifetimeStats().trips[OVERCURRENT]);
+
+    // A reset that keeps RTC memory does not start the retries over
+    adc.saveRtcSnapshot();
+    {
+        INA226_ADC rebooted(0x40, 0.000944464, 100.0);
+        TEST_ASSERT_TRUE(rebooted.restoreFromRtc());
+        rebooted.begin(6, 10);
+        TEST_ASSERT_FALSE(rebooted.isLoadConnected());
+        TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, rebooted.getProtection().state());
+        TEST_ASSERT_FALSE(runCurrent(rebooted, t, 0.0f, 120000));
+    }
+
+    // Nor does one inside a retry window: the next trip is the last
+    adc.setLoadConnected(true);
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 80.0f, 250));
+    INA226_WE::mockCurrent_mA = 0.0f;
+    t += 10000;
+    set_mock_millis(t);
     adc.readSensors();
     adc.checkAndHandleProtection();
+    TEST_ASSERT_TRUE(adc.isLoadConnected());
+    runCurrent(adc, t, 0.0f, 1000);
+    adc.saveRtcSnapshot();
+    {
+        INA226_ADC rebooted(0x40, 0.000944464, 100.0);
+        TEST_ASSERT_TRUE(rebooted.restoreFromRtc());
+        rebooted.begin(6, 10);
+        TEST_ASSERT_TRUE(rebooted.isLoadConnected());
+        TEST_ASSERT_EQUAL(ProtectionEngine::RETRY, rebooted.getProtection().state());
+        TEST_ASSERT_EQUAL(1, rebooted.getProtection().retries());
+    }
+
+    // Nor does one during the cooldown: the load stays off and recloses once
+    // the delay has run again, instead of latching as if out of retries
+    TEST_ASSERT_FALSE(runCurrent(adc, t, 80.0f, 250));
+    TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, adc.getProtection().state());
+    INA226_WE::mockCurrent_mA = 0.0f;
+    t += 5000;
+    set_mock_millis(t);
+    adc.saveRtcSnapshot();
+    {
+        INA226_ADC rebooted(0x40, 0.000944464, 100.0);
+        TEST_ASSERT_TRUE(rebooted.restoreFromRtc());
+        rebooted.begin(6, 10);
+        TEST_ASSERT_FALSE(rebooted.isLoadConnected());
+        TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, rebooted.getProtection().state());
+        TEST_ASSERT_EQUAL(1, rebooted.getProtection().retries());
+        const uint32_t bootedAt = t;
+        while (!rebooted.isLoadConnected() && t - bootedAt < 60000) {
+            t += 250;
+            set_mock_millis(t);
+            rebooted.readSensors();
+            rebooted.checkAndHandleProtection();
+        }
+        TEST_ASSERT_TRUE(rebooted.isLoadConnected());
+        TEST_ASSERT_EQUAL_UINT32(20000, t - bootedAt);                    // the second retry's delay, from boot
+        TEST_ASSERT_EQUAL(2, rebooted.getProtection().retries());
+    }
+    INA226_WE::mockBusVoltage_V = 0.0f;
+    RtcState::invalidate();
+    Preferences::clear_static();
+}
+
+void test_protection_engine(void) {
+    ProtectionEngine pe;
+    // Raw mA for 25A on the production shunt; 3x stays inside its ~86.7A range
+    ProtectionThresholds th = {25000, 75000, ProtectionEngine::i2tBudget(25000, 5.0f), 11500, 12500, 0, 0, 0, 0, 0};
+    pe.setThresholds(th);
+    ProtectionTiming timing = {2000, 1000, 30000, 60000, 2};
+    pe.setTiming(timing);
+    pe.onConnected(0);
+    TEST_ASSERT_EQUAL(ProtectionEngine::ARMING, pe.state());
+
+    // Low voltage: a blip shorter than the debounce does nothing
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 11000, 500));      // arming
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 11000, 1000));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ARMED, pe.state());
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 11000, 2750));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 12000, 3000));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 11000, 3250));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 11000, 5000));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_TRIP_LOW_VOLTAGE, pe.evaluate(0, 11000, 5250));
+    pe.onTripped(ProtectionEngine::FAULT_LOW_VOLTAGE, 5250);
+    TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, pe.state());
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 12400, 6000));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_RECONNECT, pe.evaluate(0, 12600, 7000));
+    pe.onConnected(7000);
+    TEST_ASSERT_EQUAL(ProtectionEngine::RETRY, pe.state());
+    TEST_ASSERT_EQUAL(0, pe.retries());                                                // low voltage is not a retry
+
+    // USB power: nothing is evaluated
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(86000, 5000, 7250));
+
+    // Overcurrent retries twice, after 30s then 60s, then latches
+    uint32_t t = 100000;
+    pe.evaluate(0, 12800, t);                                                          // heat from the USB sample drains
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_TRIP_OVERCURRENT, pe.evaluate(80000, 12800, t += 250));
+        pe.onTripped(ProtectionEngine::FAULT_OVERCURRENT, t);
+        if (attempt == 2) break;
+        const uint32_t backoff = 30000UL << attempt;
+        TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, pe.state());
+        TEST_ASSERT_EQUAL_UINT32(backoff, pe.recloseDelayMs());
+        TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 12800, t += backoff - 1000));
+        TEST_ASSERT_EQUAL_UINT32(1000, pe.recloseRemainingMs(t));
+        // Pre-reclose check: not onto a battery below the reconnect voltage
+        TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 12400, t += 1000));
+        TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_RECONNECT, pe.evaluate(0, 12800, t += 250));
+        pe.onConnected(t);
+        TEST_ASSERT_EQUAL(attempt + 1, pe.retries());
+    }
+    TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, pe.state());
+    TEST_ASSERT_EQUAL_UINT32(0, pe.recloseRemainingMs(t));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, pe.evaluate(0, 12800, t += 120000));
+
+    // Manual reconnect starts over; a clean retry window clears the count
+    pe.onConnected(t);
+    TEST_ASSERT_EQUAL(0, pe.retries());
+    pe.evaluate(80000, 12800, t += 250);
+    pe.onTripped(ProtectionEngine::FAULT_OVERCURRENT, t);
+    pe.evaluate(0, 12800, t += 30000);
+    pe.onConnected(t);
+    TEST_ASSERT_EQUAL(1, pe.retries());
+    TEST_ASSERT_EQUAL_UINT32(120000, pe.retryWindowMs());                              // doubled like the delay
+    pe.evaluate(0, 12800, t += 60000);
+    pe.evaluate(0, 12800, t += 59750);
+    TEST_ASSERT_EQUAL(ProtectionEngine::RETRY, pe.state());
+    pe.evaluate(0, 12800, t += 250);
+    TEST_ASSERT_EQUAL(ProtectionEngine::ARMED, pe.state());
+    TEST_ASSERT_EQUAL(0, pe.retries());
+
+    // Restored after a reset: an overcurrent trip that is not locked out goes
+    // back to COOLDOWN even if it was re-tripped before the retry limit was set
+    ProtectionEngine booted;
+    booted.setThresholds(th);
+    booted.onTripped(ProtectionEngine::FAULT_OVERCURRENT, 0);                          // maxRetries still 0
+    TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, booted.state());
+    booted.setTiming(timing);
+    booted.restore(1, false, 0);
+    TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, booted.state());
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_NONE, booted.evaluate(0, 12800, 59750));
+    TEST_ASSERT_EQUAL(ProtectionEngine::ACTION_RECONNECT, booted.evaluate(0, 12800, 60000));
+    booted.restore(2, true, 60000);
+    TEST_ASSERT_EQUAL(ProtectionEngine::TRIPPED, booted.state());
+}
 
+void test_alert_scheduler(void) {
+    AlertScheduler sched;
+    AlertLevels levels = {150.0f, 8.4f, 14.6f, 0.0f};
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_SHUNT_OVER, sched.function());
+
+    // Nothing close: shunt over stays
+    TEST_ASSERT_FALSE(sched.update(levels, 5.0f, 12.8f, 64.0f, 1000));
+    // Bus within 10 % of the floor: bus under
+    TEST_ASSERT_TRUE(sched.update(levels, 5.0f, 9.0f, 45.0f, 1250));
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_BUS_UNDER, sched.function());
+    // Heavy discharge takes the comparator back at once
+    TEST_ASSERT_TRUE(sched.update(levels, 80.0f, 9.0f, 720.0f, 1500));
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_SHUNT_OVER, sched.function());
+    // ...and bus under waits for the dwell time
+    TEST_ASSERT_FALSE(sched.update(levels, 5.0f, 9.0f, 45.0f, 1750));
+    TEST_ASSERT_TRUE(sched.update(levels, 5.0f, 9.0f, 45.0f, 2500));
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_BUS_UNDER, sched.function());
+
+    // Charging near the overvoltage cutoff: bus over
+    TEST_ASSERT_TRUE(sched.update(levels, -20.0f, 14.4f, 0.0f, 3500));
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_BUS_OVER, sched.function());
+
+    // The closest of several wins; a disabled level never does
+    levels.busOver_V = 0.0f;
+    levels.powerOver_W = 500.0f;
+    TEST_ASSERT_TRUE(sched.update(levels, 40.0f, 12.0f, 480.0f, 4500));
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_POWER_OVER, sched.function());
+    TEST_ASSERT_EQUAL_UINT32(5, sched.switchCount());
+    TEST_ASSERT_EQUAL_UINT32(1250, sched.armedTime_ms(AlertScheduler::ALERT_BUS_UNDER));
+    TEST_ASSERT_EQUAL_UINT32(1000, sched.armedTime_ms(AlertScheduler::ALERT_BUS_OVER));
+}
+
+void test_alert_function_trips(void) {
+    set_mock_millis(0);
+    INA226_ADC adc(0x40, 0.001, 100.0);
+    adc.setProtectionSettings(9.0f, 0.6f, 50.0f);      // hardware floor 8.4V
+    adc.setLoadConnected(true);
+    INA226_WE::mockBusVoltage_V = 9.1f;
+    INA226_WE::mockCurrent_mA = 0.0f;
+
+    // Bus under only once the load has armed
+    for (uint32_t t = 250; t <= 2000; t += 250) {
+        set_mock_millis(t);
+        adc.readSensors();
+        adc.checkAndHandleProtection();
+        adc.updateAlertSchedule();
+        if (t < 2000) TEST_ASSERT_EQUAL(AlertScheduler::ALERT_SHUNT_OVER, adc.getAlertScheduler().function());
+    }
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_BUS_UNDER, adc.getAlertScheduler().function());
+
+    // A bus-under alert is a low-voltage trip
+    const uint32_t lvTrips = adc.getLifetimeStats().trips[LOW_VOLTAGE];
+    adc.handleAlert();
+    adc.processAlert();
     TEST_ASSERT_FALSE(adc.isLoadConnected());
-    TEST_ASSERT_EQUAL(LOW, mock_digital_write_get_last_value(LOAD_SWITCH_PIN));
-    TEST_ASSERT_FALSE(mock_esp_deep_sleep_called()); // No sleep on overcurrent
+    TEST_ASSERT_EQUAL_UINT32(lvTrips + 1, adc.getLifetimeStats().trips[LOW_VOLTAGE]);
+    TEST_ASSERT_EQUAL(ProtectionEngine::COOLDOWN, adc.getProtection().state());
+    set_mock_millis(2250);
+    adc.updateAlertSchedule();
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_SHUNT_OVER, adc.getAlertScheduler().function());
+
+    // Overvoltage: must sit above the reconnect voltage; trips in software too
+    TEST_ASSERT_FALSE(adc.setOvervoltageCutoff_V(9.5f));
+    TEST_ASSERT_TRUE(adc.setOvervoltageCutoff_V(14.6f));
+    adc.setLoadConnected(true);
+    INA226_WE::mockBusVoltage_V = 14.7f;
+    set_mock_millis(2500);
+    const uint32_t ovTrips = adc.getLifetimeStats().trips[OVERVOLTAGE];
+    adc.readSensors();
+    adc.checkAndHandleProtection();
+    TEST_ASSERT_FALSE(adc.isLoadConnected());
+    TEST_ASSERT_EQUAL_UINT32(ovTrips + 1, adc.getLifetimeStats().trips[OVERVOLTAGE]);
+    INA226_WE::mockBusVoltage_V = 14.2f;
+    set_mock_millis(2750);
+    adc.readSensors();
+    adc.checkAndHandleProtection();
+    TEST_ASSERT_FALSE(adc.isLoadConnected());                          // above 14.6V - 0.6V
+    INA226_WE::mockBusVoltage_V = 13.8f;
+    set_mock_millis(3000);
+    adc.readSensors();
+    adc.checkAndHandleProtection();
+    TEST_ASSERT_TRUE(adc.isLoadConnected());
+    TEST_ASSERT_TRUE(adc.setOvervoltageCutoff_V(0.0f));
+
+    // Power over is programmed in mW, and the shunt level stays in range
+    INA226_ADC prod(0x40, 0.000944464, 100.0);
+    prod.setProtectionSettings(9.0f, 0.6f, 50.0f);     // 150A instant requested, beyond the shunt
+    TEST_ASSERT_TRUE(prod.setPowerLimit_W(500.0f));
+    prod.setLoadConnected(true);
+    INA226_WE::mockBusVoltage_V = 12.8f;
+    INA226_WE::mockCurrent_mA = 37000.0f;               // 474W: within 10% of the limit
+    uint32_t t = 5000;
+    for (; t <= 7000 && prod.getAlertScheduler().function() != AlertScheduler::ALERT_POWER_OVER; t += 250) {
+        set_mock_millis(t);
+        prod.readSensors();
+        prod.checkAndHandleProtection();
+        prod.updateAlertSchedule();
+    }
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_POWER_OVER, prod.getAlertScheduler().function());
+    TEST_ASSERT_EQUAL(POWER_OVER, INA226_WE::lastAlertType);
+    TEST_ASSERT_EQUAL_FLOAT(500000.0f, INA226_WE::lastAlertLimit);
+    INA226_WE::mockCurrent_mA = 60000.0f;               // above half the clamped instant level
+    set_mock_millis(t += 1000);
+    prod.readSensors();
+    prod.updateAlertSchedule();
+    TEST_ASSERT_EQUAL(AlertScheduler::ALERT_SHUNT_OVER, prod.getAlertScheduler().function());
+    TEST_ASSERT_EQUAL(SHUNT_OVER, INA226_WE::lastAlertType);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.95f * 0.08192f, INA226_WE::lastAlertLimit);
+    INA226_WE::mockCurrent_mA = 0.0f;
+    INA226_WE::mockBusVoltage_V = 12.8f;
 }
 
 void test_voltage_reconnect(void) {
@@ -340,9 +1855,12 @@ void test_alert_disconnect(void) {
     INA226_ADC adc(0x40, 0.001, 100.0);
     adc.setLoadConnected(true);
 
-    // Simulate ISR
+    // Simulate ISR: the gate opens before the loop runs
     adc.handleAlert();
     TEST_ASSERT_TRUE(adc.isAlertTriggered());
+    TEST_ASSERT_EQUAL(LOW, mock_digital_write_get_last_value(LOAD_SWITCH_PIN));
+    TEST_ASSERT_TRUE(adc.isLoadConnected());
+    TEST_ASSERT_EQUAL_UINT32(0, adc.getIsrGateOffLatency().count());
 
     // Simulate main loop processing
     adc.processAlert();
@@ -350,22 +1868,79 @@ void test_alert_disconnect(void) {
     TEST_ASSERT_FALSE(adc.isLoadConnected());
     TEST_ASSERT_EQUAL(LOW, mock_digital_write_get_last_value(LOAD_SWITCH_PIN));
     TEST_ASSERT_FALSE(adc.isAlertTriggered());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getIsrGateOffLatency().count());
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getAlertHandledLatency().count());
+
+    // A second alert with the load already off is not a gate-off sample
+    adc.handleAlert();
+    adc.processAlert();
+    TEST_ASSERT_EQUAL_UINT32(1, adc.getIsrGateOffLatency().count());
 }
 
+void test_latency_histogram(void) {
+    LatencyHistogram h;
+    TEST_ASSERT_EQUAL_UINT32(0, h.quantileUpper(0.99f));
+    h.add(0);
+    h.add(1);
+    h.add(3);
+    h.add(100);     // bin 6: 64..127
+    TEST_ASSERT_EQUAL_UINT32(4, h.count());
+    TEST_ASSERT_EQUAL_UINT32(2, h.bin(0));
+    TEST_ASSERT_EQUAL_UINT32(1, h.bin(1));
+    TEST_ASSERT_EQUAL_UINT32(1, h.bin(6));
+    TEST_ASSERT_EQUAL_UINT32(100, h.max());
+    TEST_ASSERT_EQUAL_UINT32(127, h.quantileUpper(0.99f));
+    TEST_ASSERT_EQUAL_UINT32(1, h.quantileUpper(0.5f));
+    h.add(0xFFFFFFFFUL);
+    TEST_ASSERT_EQUAL_UINT32(1, h.bin(31));
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFUL, LatencyHistogram::binUpper(31));
+    h.reset();
+    TEST_ASSERT_EQUAL_UINT32(0, h.count());
+}
+
+// Defined after main()
+void test_usb_power_no_disconnect(void);
+void test_alert_ignored_when_disconnected(void);
+
 int main(int argc, char **argv) {
     UNITY_BEGIN();
     RUN_TEST(test_current_calibration);
     RUN_TEST(test_battery_capacity);
+    RUN_TEST(test_coulomb_counter_precision);
+    RUN_TEST(test_soc_journal);
+    RUN_TEST(test_rtc_state_survives_reset);
+    RUN_TEST(test_sleep_drain_credited);
+    RUN_TEST(test_lvd_fast_wake);
+    RUN_TEST(test_battery_model);
+    RUN_TEST(test_ocv_resync_at_rest);
+    RUN_TEST(test_full_charge_detection);
+    RUN_TEST(test_time_to_full_taper);
+    RUN_TEST(test_load_profile_run_flat);
+    RUN_TEST(test_lifetime_stats);
+    RUN_TEST(test_capacity_learning);
+    RUN_TEST(test_soc_ekf_converges);
+    RUN_TEST(test_rainflow_counting);
     RUN_TEST(test_run_flat_time_formatted);
     RUN_TEST(test_averaged_run_flat_time);
     RUN_TEST(test_calibration_persistence);
+    RUN_TEST(test_calibration_table_interpolation);
+    RUN_TEST(test_factory_calibration_fallback);
+    RUN_TEST(test_cal_jig_protocol);
+    RUN_TEST(test_cal_math_shared_helpers);
+    RUN_TEST(test_cal_sweep_fit_and_decimate);
     RUN_TEST(test_espnow_handler);
     RUN_TEST(test_main_loop_logic);
     RUN_TEST(test_protection_settings_persistence);
     RUN_TEST(test_low_voltage_disconnect);
+    RUN_TEST(test_ir_compensated_low_voltage);
     RUN_TEST(test_overcurrent_disconnect);
+    RUN_TEST(test_overcurrent_auto_retry);
+    RUN_TEST(test_protection_engine);
     RUN_TEST(test_voltage_reconnect);
     RUN_TEST(test_alert_disconnect);
+    RUN_TEST(test_latency_histogram);
+    RUN_TEST(test_alert_scheduler);
+    RUN_TEST(test_alert_function_trips);
     RUN_TEST(test_usb_power_no_disconnect);
     RUN_TEST(test_alert_ignored_when_disconnected);
     UNITY_END();
@@ -0,0 +1,435 @@
+// Reference host client for the calibration jig protocol (firmware/src/cal_jig.h).
+//
+// Drives a full production calibration without an operator: shunt resistance
+// sweep, multi-point current table, commit, and the load-switch / alert self-tests.
+//
+// Build (Linux):
+//   g++ -std=c++11 -O2 -Ifirmware/src -o cal_jig_client
+//       tools/cal_jig_client/cal_jig_client.cpp firmware/src/cal_jig.cpp firmware/src/cal_sweep.cpp firmware/src/cal_math.cpp
+//
+// Run against the built-in simulated shunt + programmable load:
+//   ./cal_jig_client --sim [--shunt 50] [--sweep]
+// --sweep replaces the nine fixed table points with a slow ramp that is binned,
+// fitted and decimated on the device (CAL:SWEEP:*).
+// Run against a real unit (and optionally a SCPI electronic load):
+//   ./cal_jig_client --port /dev/ttyACM0 [--load-port /dev/ttyUSB0] [--shunt 50]
+// Replay a command file (e.g. from tools/cal_solver --jig) instead of calibrating:
+//   ./cal_jig_client --port /dev/ttyACM0 --import unit42.jig
+
+#include "cal_jig.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+// ---------------------------------------------------------------------------
+// Programmable load
+
+class ProgrammableLoad {
+public:
+    virtual ~ProgrammableLoad() {}
+    virtual void setCurrent(float amps) = 0;
+    virtual float measureCurrent_mA() = 0;   // reference reading of the true current
+    virtual void wait(unsigned long ms) = 0;
+};
+
+// ---------------------------------------------------------------------------
+// Simulated hardware: a shunt with gain/offset error, self-heating non-linearity,
+// noise and a load whose current settles exponentially after each step. Time is
+// virtual.
+
+class SimulatedShunt : public CalJigTarget, public ProgrammableLoad {
+public:
+    SimulatedShunt()
+        : m_nowMs(0), m_setpointA(0.0f), m_actualA(0.0f), m_loadOn(true),
+          m_trueOhms(0.000981f), m_assumedOhms(0.000944464f),
+          m_offset_mA(6.0f), m_alertAmps(0.0f), m_alertFired(false),
+          m_rng(1234), m_noise(0.0f, 2.0f) {}
+
+    // ProgrammableLoad
+    void setCurrent(float amps) override { m_setpointA = amps; }
+    float measureCurrent_mA() override { return (m_loadOn ? m_actualA : 0.0f) * 1000.0f; }
+    void wait(unsigned long ms) override { delayMs(ms); }
+
+    // CalJigTarget
+    void readSample(float &raw_mA, float &cal_mA, float &shunt_mV, float &bus_V) override {
+        float trueA = m_loadOn ? m_actualA : 0.0f;
+        // The INA226 derives current from shunt voltage and its configured resistance
+        shunt_mV = trueA * m_trueOhms * 1000.0f + m_noise(m_rng) * 0.001f;
+        float heating = 1.0f + 2e-6f * trueA * trueA;   // shunt warms up at high current
+        raw_mA = trueA * 1000.0f * heating * (m_trueOhms / m_assumedOhms) + m_offset_mA + m_noise(m_rng);
+        cal_mA = applyTable(raw_mA);
+        bus_V = 13.2f;
+        if (m_alertAmps > 0.0f && trueA > m_alertAmps) {
+            m_alertFired = true;
+        }
+    }
+    unsigned long nowMs() override { return m_nowMs; }
+    void delayMs(unsigned long ms) override {
+        // first-order load response, tau = 250 ms
+        m_actualA += (m_setpointA - m_actualA) * (1.0f - expf(-(float)ms / 250.0f));
+        m_nowMs += ms;
+    }
+    bool selectShunt(uint16_t) override { return true; }
+    bool commitTable(uint16_t, const std::vector<CalPoint> &points) override {
+        m_table = points;
+        std::sort(m_table.begin(), m_table.end(),
+                  [](const CalPoint &a, const CalPoint &b) { return a.raw_mA < b.raw_mA; });
+        return true;
+    }
+    bool commitShuntOhms(float ohms) override { m_assumedOhms = ohms; return true; }
+    void setLoadConnected(bool connected) override { m_loadOn = connected; }
+    void armAlert(float amps) override { m_alertAmps = amps; m_alertFired = false; }
+    bool pollAlertFired() override {
+        float raw, cal, shunt, bus;
+        readSample(raw, cal, shunt, bus);
+        if (m_alertFired) {
+            m_loadOn = false; // the firmware drops the load on alert
+            return true;
+        }
+        return false;
+    }
+    void restoreAlert() override { m_alertAmps = 0.0f; }
+    void writeLine(const char *line) override { m_lastReply = line; }
+
+    const std::string &lastReply() const { return m_lastReply; }
+    float trueOhms() const { return m_trueOhms; }
+
+private:
+    float applyTable(float raw) const {
+        if (m_table.empty()) return raw;
+        if (raw <= m_table.front().raw_mA) return m_table.front().true_mA;
+        if (raw >= m_table.back().raw_mA) return m_table.back().true_mA;
+        for (size_t i = 1; i < m_table.size(); ++i) {
+            if (raw < m_table[i].raw_mA) {
+                const CalPoint &a = m_table[i - 1], &b = m_table[i];
+                return a.true_mA + (raw - a.raw_mA) * (b.true_mA - a.true_mA) / (b.raw_mA - a.raw_mA);
+            }
+        }
+        return raw;
+    }
+
+    unsigned long m_nowMs;
+    float m_setpointA, m_actualA;
+    bool m_loadOn;
+    float m_trueOhms, m_assumedOhms, m_offset_mA;
+    float m_alertAmps;
+    bool m_alertFired;
+    std::vector<CalPoint> m_table;
+    std::mt19937 m_rng;
+    std::normal_distribution<float> m_noise;
+    std::string m_lastReply;
+};
+
+// ---------------------------------------------------------------------------
+// Transports
+
+class Transport {
+public:
+    virtual ~Transport() {}
+    // Send one command line and return the framed reply line
+    virtual bool transact(const std::string &cmd, std::string &frame) = 0;
+};
+
+class SimTransport : public Transport {
+public:
+    explicit SimTransport(SimulatedShunt &sim) : m_sim(sim), m_jig(sim) { m_jig.begin(); }
+    bool transact(const std::string &cmd, std::string &frame) override {
+        m_jig.handleLine(cmd.c_str());
+        frame = m_sim.lastReply();
+        return true;
+    }
+private:
+    SimulatedShunt &m_sim;
+    CalJig m_jig;
+};
+
+static int openSerial(const char *path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) return -1;
+    termios tio;
+    memset(&tio, 0, sizeof(tio));
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tcsetattr(fd, TCSANOW, &tio);
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static bool readLine(int fd, std::string &line, int timeoutMs) {
+    line.clear();
+    while (true) {
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+        if (select(fd + 1, &set, nullptr, nullptr, &tv) <= 0) return false;
+        char c;
+        if (read(fd, &c, 1) != 1) return false;
+        if (c == '\n') return true;
+        if (c != '\r') line += c;
+    }
+}
+
+class SerialTransport : public Transport {
+public:
+    explicit SerialTransport(int fd) : m_fd(fd) {}
+    bool transact(const std::string &cmd, std::string &frame) override {
+        std::string out = cmd + "\n";
+        if (write(m_fd, out.data(), out.size()) != (ssize_t)out.size()) return false;
+        // Firmware debug output may be interleaved; the reply is the next '#' line
+        std::string line;
+        while (readLine(m_fd, line, 60000)) {
+            if (!line.empty() && line[0] == '#') {
+                frame = line;
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    int m_fd;
+};
+
+// SCPI electronic load on its own serial port (CURR <A>, INP ON)
+class ScpiLoad : public ProgrammableLoad {
+public:
+    explicit ScpiLoad(int fd) : m_fd(fd) { send("INP ON"); }
+    void setCurrent(float amps) override {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "CURR %.4f", amps);
+        send(buf);
+    }
+    float measureCurrent_mA() override {
+        send("MEAS:CURR?");
+        std::string line;
+        return readLine(m_fd, line, 2000) ? strtof(line.c_str(), nullptr) * 1000.0f : NAN;
+    }
+    void wait(unsigned long ms) override { usleep(ms * 1000); }
+private:
+    void send(const std::string &s) {
+        std::string out = s + "\n";
+        if (write(m_fd, out.data(), out.size()) < 0) perror("load write");
+    }
+    int m_fd;
+};
+
+// ---------------------------------------------------------------------------
+// Protocol client
+
+class JigClient {
+public:
+    explicit JigClient(Transport &t) : m_t(t), m_expectedSeq(0), m_failures(0) {}
+
+    // Returns true on OK; payload receives the reply payload
+    bool cmd(const std::string &command, std::string *payload = nullptr) {
+        return exchange(command, payload, true);
+    }
+    // Same, but only failures are printed (for high-rate sweep readings)
+    bool cmdQuiet(const std::string &command) {
+        return exchange(command, nullptr, false);
+    }
+
+    int failures() const { return m_failures; }
+
+private:
+    bool exchange(const std::string &command, std::string *payload, bool verbose) {
+        std::string frame;
+        if (!m_t.transact(command, frame)) {
+            fprintf(stderr, "  %-28s -> no reply\n", command.c_str());
+            m_failures++;
+            return false;
+        }
+        size_t star = frame.rfind('*');
+        if (frame.empty() || frame[0] != '#' || star == std::string::npos || star + 3 > frame.size()) {
+            fprintf(stderr, "  %-28s -> bad frame '%s'\n", command.c_str(), frame.c_str());
+            m_failures++;
+            return false;
+        }
+        unsigned expectedSum = CalJig::checksum(frame.c_str() + 1, frame.c_str() + star);
+        unsigned sum = (unsigned)strtoul(frame.substr(star + 1, 2).c_str(), nullptr, 16);
+        std::string body = frame.substr(1, star - 1);
+        size_t c1 = body.find(',');
+        size_t c2 = body.find(',', c1 + 1);
+        unsigned seq = (unsigned)strtoul(body.substr(0, c1).c_str(), nullptr, 10);
+        std::string status = body.substr(c1 + 1, c2 - c1 - 1);
+        std::string data = c2 == std::string::npos ? "" : body.substr(c2 + 1);
+        if (sum != expectedSum || seq != m_expectedSeq) {
+            fprintf(stderr, "  %-28s -> frame error (sum %02X/%02X seq %u/%u)\n",
+                    command.c_str(), sum, expectedSum, seq, m_expectedSeq);
+            m_failures++;
+            return false;
+        }
+        m_expectedSeq++;
+        if (verbose || status != "OK")
+            printf("  %-28s -> %s %s\n", command.c_str(), status.c_str(), data.c_str());
+        if (payload) *payload = data;
+        if (status != "OK") {
+            m_failures++;
+            return false;
+        }
+        return true;
+    }
+
+    Transport &m_t;
+    unsigned m_expectedSeq;
+    int m_failures;
+};
+
+static void measurePoint(JigClient &jig, ProgrammableLoad &load, float amps) {
+    char buf[64];
+    load.setCurrent(amps);
+    snprintf(buf, sizeof(buf), "CAL:TARGET %.3f", amps * 1000.0f);
+    jig.cmd(buf);
+    jig.cmd("CAL:SETTLE 5,5000");
+    jig.cmd("CAL:SAMPLE 8");
+}
+
+// Ramp slowly from 0 to full scale, pairing each device reading with the load's
+// reference measurement, then let the device fit and decimate the dense table.
+static void sweepTable(JigClient &jig, ProgrammableLoad &load, int shuntA) {
+    char buf[64];
+    const float binWidth_mA = 100.0f;
+    const float maxA = (float)shuntA;
+    snprintf(buf, sizeof(buf), "CAL:SWEEP:START %.1f,%.1f", binWidth_mA, maxA * 1000.0f);
+    jig.cmd(buf);
+
+    load.setCurrent(0.0f);
+    load.wait(1500);
+    const float step_mA = binWidth_mA / 6.0f;   // ~6 readings per bin
+    size_t sent = 0;
+    for (float set_mA = 0.0f; set_mA <= maxA * 1000.0f; set_mA += step_mA) {
+        load.setCurrent(set_mA / 1000.0f);
+        load.wait(60);
+        float ref = load.measureCurrent_mA();
+        snprintf(buf, sizeof(buf), "CAL:SWEEP:REF %.3f", ref);
+        jig.cmdQuiet(buf);
+        sent++;
+    }
+    printf("  (%u sweep readings)\n", (unsigned)sent);
+    jig.cmd("CAL:SWEEP:FIT 10");
+}
+
+static int runCalibration(JigClient &jig, ProgrammableLoad &load, int shuntA, bool sweep) {
+    char buf[64];
+    jig.cmd("*IDN?");
+    snprintf(buf, sizeof(buf), "CAL:SHUNT %d", shuntA);
+    jig.cmd(buf);
+
+    // 1. Shunt resistance. Committing it re-scales raw current, so table points
+    //    captured before this would be stale: clear them afterwards.
+    printf("Shunt resistance sweep\n");
+    const float ohmsLoads[] = {0.1f, 0.5f, 1.0f, 2.0f, 5.0f, 10.0f};
+    for (float a : ohmsLoads) measurePoint(jig, load, a);
+    jig.cmd("CAL:OHMS:COMMIT");
+    jig.cmd("CAL:CLEAR");
+
+    // 2. Current table: a programmable load can reach 100%, so nothing is extrapolated
+    printf("Current table\n");
+    if (sweep) {
+        sweepTable(jig, load, shuntA);
+    } else {
+        const float perc[] = {0.0f, 0.02f, 0.04f, 0.1f, 0.2f, 0.4f, 0.6f, 0.8f, 1.0f};
+        for (float p : perc) measurePoint(jig, load, shuntA * p);
+    }
+    jig.cmd("CAL:COMMIT");
+
+    // 3. Self-tests
+    printf("Self-tests\n");
+    load.setCurrent(1.0f);
+    jig.cmd("TEST:SWITCH?");
+    jig.cmd("TEST:ALERT 0.5,15000");
+    load.setCurrent(0.0f);
+    jig.cmd("JIG:EXIT");
+    return jig.failures();
+}
+
+// Send every non-comment line of a command file, then leave jig mode
+static int runImport(JigClient &jig, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') continue;
+        if (!jig.cmd(line)) break;   // stop before committing a partial table
+    }
+    fclose(f);
+    jig.cmd("JIG:EXIT");
+    return jig.failures();
+}
+
+int main(int argc, char **argv) {
+    bool sim = false;
+    bool sweep = false;
+    const char *port = nullptr;
+    const char *loadPort = nullptr;
+    const char *importPath = nullptr;
+    int shuntA = 50;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--sim")) sim = true;
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc) port = argv[++i];
+        else if (!strcmp(argv[i], "--load-port") && i + 1 < argc) loadPort = argv[++i];
+        else if (!strcmp(argv[i], "--shunt") && i + 1 < argc) shuntA = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--sweep")) sweep = true;
+        else if (!strcmp(argv[i], "--import") && i + 1 < argc) importPath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s --sim | --port <tty> [--load-port <tty>] [--shunt <A>] [--sweep] [--import <file>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int failures;
+    if (sim || !port) {
+        SimulatedShunt shunt;
+        SimTransport transport(shunt);
+        JigClient jig(transport);
+        failures = importPath ? runImport(jig, importPath) : runCalibration(jig, shunt, shuntA, sweep);
+        printf("Simulated jig time: %.1f s (true shunt %.9f Ohms)\n", shunt.nowMs() / 1000.0, shunt.trueOhms());
+    } else {
+        int fd = openSerial(port);
+        if (fd < 0) {
+            perror(port);
+            return 1;
+        }
+        // Switch the unit into jig mode and wait for its banner
+        const char enter[] = "j\n";
+        if (write(fd, enter, sizeof(enter) - 1) < 0) perror("write");
+        std::string line;
+        while (readLine(fd, line, 3000) && line != "JIG MODE") {}
+
+        SerialTransport transport(fd);
+        JigClient jig(transport);
+        int loadFd = loadPort ? openSerial(loadPort) : -1;
+        if (importPath) {
+            failures = runImport(jig, importPath);
+        } else if (loadFd >= 0) {
+            ScpiLoad load(loadFd);
+            failures = runCalibration(jig, load, shuntA, sweep);
+        } else {
+            fprintf(stderr, "No --load-port given: cannot set targets without a programmable load\n");
+            failures = 1;
+        }
+        if (loadFd >= 0) close(loadFd);
+        close(fd);
+    }
+
+    printf("%s (%d failure%s)\n", failures ? "CALIBRATION FAILED" : "CALIBRATION PASSED", failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}
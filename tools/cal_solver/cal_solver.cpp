@@ -0,0 +1,363 @@
+// Offline calibration solver.
+//
+// Solves shunt resistance, zero offset and a current table from recorded logs
+// instead of on the device, so a unit can be recalibrated from field data with
+// no jig and no physical access. Uses the same table arithmetic as the firmware
+// (firmware/src/cal_math.h) and the same binning/decimation as CAL:SWEEP
+// (firmware/src/cal_sweep.h).
+//
+// Inputs are CSV, one sample per line, '#' starts a comment:
+//   device log:    t_ms,raw_mA,shunt_mV     (device clock, e.g. polled MEAS?)
+//   reference log: t_ms,ref_mA              (reference meter clock)
+// The two clocks may be offset; the lag is found by cross-correlation.
+//
+// Build (Linux):
+//   g++ -std=c++11 -O2 -Ifirmware/src -o cal_solver
+//       tools/cal_solver/cal_solver.cpp firmware/src/cal_math.cpp firmware/src/cal_sweep.cpp
+//
+// Run:
+//   ./cal_solver --device dev.csv --ref meter.csv --shunt 100
+//                [--log-ohms <ohms>] [--max-lag 5000] [--bin 100] [--budget 10]
+//                [--export factory_cal/unit42.txt] [--jig unit42.jig]
+// --export writes a block for firmware/factory_cal/ (same format as the 'e'
+// command); --jig writes CAL:* commands for `cal_jig_client --import`.
+
+#include "cal_math.h"
+#include "cal_sweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct DeviceSample {
+    double t_ms;
+    float raw_mA;
+    float shunt_mV;
+};
+
+struct RefSample {
+    double t_ms;
+    float ref_mA;
+};
+
+// ---------------------------------------------------------------------------
+// Log parsing
+
+static bool parseNumbers(const char *line, double *out, int want) {
+    const char *p = line;
+    for (int i = 0; i < want; ++i) {
+        char *end = nullptr;
+        out[i] = strtod(p, &end);
+        if (end == p) return false;
+        p = end;
+        while (*p == ' ' || *p == '\t') ++p;
+        if (i + 1 < want) {
+            if (*p != ',') return false;
+            ++p;
+        }
+    }
+    return true;
+}
+
+template <typename F>
+static bool readCsv(const char *path, int columns, F onRow) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    unsigned lineNo = 0, skipped = 0;
+    while (fgets(line, sizeof(line), f)) {
+        ++lineNo;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        const char *p = line;
+        while (*p == ' ' || *p == '\t') ++p;
+        if (*p == '\0' || *p == '\n' || *p == '\r') continue;
+        double v[3];
+        if (!parseNumbers(p, v, columns)) {
+            skipped++;   // header row or corrupt line
+            continue;
+        }
+        onRow(v);
+    }
+    fclose(f);
+    if (skipped) fprintf(stderr, "%s: skipped %u unparsable line%s\n", path, skipped, skipped == 1 ? "" : "s");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Time alignment
+
+// Reference current at time t (linear between samples); false outside the log
+static bool refAt(const std::vector<RefSample> &ref, double t, float &out) {
+    if (ref.empty() || t < ref.front().t_ms || t > ref.back().t_ms) return false;
+    auto it = std::upper_bound(ref.begin(), ref.end(), t,
+                               [](double v, const RefSample &r) { return v < r.t_ms; });
+    if (it == ref.end()) {
+        out = ref.back().ref_mA;
+        return true;
+    }
+    const RefSample &b = *it;
+    const RefSample &a = *(it - 1);
+    double dt = b.t_ms - a.t_ms;
+    out = dt <= 0.0 ? b.ref_mA : (float)(a.ref_mA + (t - a.t_ms) * (b.ref_mA - a.ref_mA) / dt);
+    return true;
+}
+
+// Pearson correlation of raw vs. reference when the reference clock reads
+// device time + lag. Needs at least half the device samples to overlap.
+static double correlationAt(const std::vector<DeviceSample> &dev, const std::vector<RefSample> &ref, double lag) {
+    double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    size_t n = 0;
+    for (const DeviceSample &d : dev) {
+        float r;
+        if (!refAt(ref, d.t_ms + lag, r)) continue;
+        sx += d.raw_mA;  sy += r;
+        sxx += (double)d.raw_mA * d.raw_mA;  syy += (double)r * r;  sxy += (double)d.raw_mA * r;
+        n++;
+    }
+    if (n < 2 || n * 2 < dev.size()) return -2.0;
+    double cov = sxy - sx * sy / n;
+    double vx = sxx - sx * sx / n;
+    double vy = syy - sy * sy / n;
+    if (vx <= 0.0 || vy <= 0.0) return -2.0;
+    return cov / sqrt(vx * vy);
+}
+
+// Coarse scan in 'step' increments, then refine around the best lag at 1 ms
+static double findLag(const std::vector<DeviceSample> &dev, const std::vector<RefSample> &ref,
+                      double maxLag, double step, double &bestCorr) {
+    double best = 0.0;
+    bestCorr = -2.0;
+    for (double lag = -maxLag; lag <= maxLag; lag += step) {
+        double c = correlationAt(dev, ref, lag);
+        if (c > bestCorr) { bestCorr = c; best = lag; }
+    }
+    double coarse = best;
+    for (double lag = coarse - step; lag <= coarse + step; lag += 1.0) {
+        double c = correlationAt(dev, ref, lag);
+        if (c > bestCorr) { bestCorr = c; best = lag; }
+    }
+    return best;
+}
+
+// Median of a scratch vector (reordered)
+static float median(std::vector<float> &v) {
+    if (v.empty()) return 0.0f;
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+// ---------------------------------------------------------------------------
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+            "usage: %s --device <csv> --ref <csv> --shunt <A> [--log-ohms <ohms>]\n"
+            "          [--max-lag <ms>] [--bin <mA>] [--budget <mA>] [--settle-tol <mA>]\n"
+            "          [--min-ohms-current <mA>] [--export <file>] [--jig <file>]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    const char *devPath = nullptr;
+    const char *refPath = nullptr;
+    const char *exportPath = nullptr;
+    const char *jigPath = nullptr;
+    int shuntA = 0;
+    double logOhms = 0.0;
+    double maxLag = 5000.0;
+    float binWidth = 100.0f;
+    float budget = 10.0f;
+    float settleTol = 20.0f;
+    float minOhmsCurrent = 500.0f;
+    for (int i = 1; i < argc; ++i) {
+        bool hasArg = i + 1 < argc;
+        if (!strcmp(argv[i], "--device") && hasArg) devPath = argv[++i];
+        else if (!strcmp(argv[i], "--ref") && hasArg) refPath = argv[++i];
+        else if (!strcmp(argv[i], "--shunt") && hasArg) shuntA = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--log-ohms") && hasArg) logOhms = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--max-lag") && hasArg) maxLag = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--bin") && hasArg) binWidth = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--budget") && hasArg) budget = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--settle-tol") && hasArg) settleTol = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--min-ohms-current") && hasArg) minOhmsCurrent = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--export") && hasArg) exportPath = argv[++i];
+        else if (!strcmp(argv[i], "--jig") && hasArg) jigPath = argv[++i];
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!devPath || !refPath || shuntA <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // 1. Load logs
+    std::vector<DeviceSample> dev;
+    std::vector<RefSample> ref;
+    if (!readCsv(devPath, 3, [&](const double *v) { dev.push_back({v[0], (float)v[1], (float)v[2]}); })) return 1;
+    if (!readCsv(refPath, 2, [&](const double *v) { ref.push_back({v[0], (float)v[1]}); })) return 1;
+    auto byTime = [](const DeviceSample &a, const DeviceSample &b) { return a.t_ms < b.t_ms; };
+    std::sort(dev.begin(), dev.end(), byTime);
+    std::sort(ref.begin(), ref.end(), [](const RefSample &a, const RefSample &b) { return a.t_ms < b.t_ms; });
+    if (dev.size() < 10 || ref.size() < 10) {
+        fprintf(stderr, "Not enough samples (device %u, reference %u)\n", (unsigned)dev.size(), (unsigned)ref.size());
+        return 1;
+    }
+    printf("Device log:    %u samples over %.1f s\n", (unsigned)dev.size(), (dev.back().t_ms - dev.front().t_ms) / 1000.0);
+    printf("Reference log: %u samples over %.1f s\n", (unsigned)ref.size(), (ref.back().t_ms - ref.front().t_ms) / 1000.0);
+
+    // 2. Align clocks. Coarse step is half the device sample period.
+    double period = (dev.back().t_ms - dev.front().t_ms) / (double)(dev.size() - 1);
+    double step = std::max(1.0, period / 2.0);
+    double corr;
+    double lag = findLag(dev, ref, maxLag, step, corr);
+    if (corr < 0.9) {
+        fprintf(stderr, "Logs do not line up (best correlation %.3f at %+.0f ms); widen --max-lag?\n", corr, lag);
+        return 1;
+    }
+    printf("Clock lag:     %+.0f ms (correlation %.5f)\n", lag, corr);
+
+    // 3. Pair samples, dropping those where the reference is still moving: a
+    //    small residual misalignment there would look like sensor error.
+    struct Pair { float raw_mA; float shunt_mV; float ref_mA; };
+    std::vector<Pair> pairs;
+    size_t moving = 0;
+    for (const DeviceSample &d : dev) {
+        float r, before, after;
+        double t = d.t_ms + lag;
+        if (!refAt(ref, t, r) || !refAt(ref, t - period, before) || !refAt(ref, t + period, after)) continue;
+        if (fabsf(after - before) > settleTol) {
+            moving++;
+            continue;
+        }
+        pairs.push_back({d.raw_mA, d.shunt_mV, r});
+    }
+    printf("Pairs:         %u used, %u dropped while current was changing\n", (unsigned)pairs.size(), (unsigned)moving);
+    if (pairs.size() < 10) {
+        fprintf(stderr, "Not enough settled pairs\n");
+        return 1;
+    }
+
+    // 4. Shunt offset: intercept of shunt_mV against true current (least squares).
+    //    Only used to correct the resistance fit. It is not exported: the device
+    //    has no shunt-voltage offset setting, and it reads as a constant raw
+    //    current that the table (step 6) already maps back to the reference,
+    //    so applying it again would correct it twice.
+    double si = 0, sv = 0, sii = 0, siv = 0;
+    for (const Pair &p : pairs) {
+        double a = p.ref_mA / 1000.0;
+        si += a; sv += p.shunt_mV; sii += a * a; siv += a * p.shunt_mV;
+    }
+    double n = (double)pairs.size();
+    double denom = n * sii - si * si;
+    float offset_mV = denom > 0.0 ? (float)((sv * sii - si * siv) / denom) : 0.0f;
+
+    // 5. Shunt resistance: the device's R = V/I average, over offset-corrected
+    //    pairs with enough current for the ratio to be meaningful
+    std::vector<float> ohmsA, ohmsMV;
+    for (const Pair &p : pairs) {
+        if (p.ref_mA < minOhmsCurrent) continue;
+        ohmsA.push_back(p.ref_mA / 1000.0f);
+        ohmsMV.push_back(p.shunt_mV - offset_mV);
+    }
+    size_t validOhms = 0;
+    float ohms = averageShuntOhms(ohmsA.data(), ohmsMV.data(), ohmsA.size(), validOhms);
+    if (validOhms == 0) {
+        fprintf(stderr, "No pairs above %.0f mA to solve shunt resistance\n", minOhmsCurrent);
+        return 1;
+    }
+
+    // Raw current scales with 1/ohms on the device, so express the log's raw
+    // readings as they will read once the solved resistance is committed.
+    if (logOhms <= 0.0) {
+        std::vector<float> ratios;
+        for (const Pair &p : pairs)
+            if (fabsf(p.raw_mA) >= minOhmsCurrent) ratios.push_back(p.shunt_mV / p.raw_mA * 1000.0f);
+        logOhms = median(ratios) / 1000.0;
+        if (!(logOhms > 0.0)) {
+            fprintf(stderr, "Cannot infer the resistance the log was recorded with; pass --log-ohms\n");
+            return 1;
+        }
+    }
+    const float rescale = (float)(logOhms / ohms);
+    printf("Shunt:         %.9f Ohms from %u pairs (log recorded at %.9f), offset %+.4f mV\n",
+           ohms, (unsigned)validOhms, logOhms, offset_mV);
+
+    // 6. Current table: same bin/reject/decimate path as an on-device sweep
+    float maxRef = 0.0f;
+    for (const Pair &p : pairs) maxRef = std::max(maxRef, p.ref_mA);
+    float width = binWidth;
+    CalSweep sweep;
+    while (!sweep.begin(width, maxRef)) width *= 2.0f;   // keep within maxBins
+    if (width != binWidth) printf("Bin width raised to %.0f mA to cover %.0f mA\n", width, maxRef);
+    for (const Pair &p : pairs) sweep.addSample(p.raw_mA * rescale, p.ref_mA);
+
+    std::vector<CalPoint> dense, table;
+    size_t rejected = sweep.buildDenseTable(dense);
+    if (dense.size() < 2) {
+        fprintf(stderr, "Not enough accepted bins (%u rejected)\n", (unsigned)rejected);
+        return 1;
+    }
+    float worst = CalSweep::decimate(dense, budget, table);
+    sortAndDedupCalPoints(table);
+    float zeroOffset_mA = interpolateCalTable(table.data(), table.size(), 0.0f);
+    printf("Table:         %u dense bins (%u rejected) -> %u points, worst decimation error %.2f mA\n",
+           (unsigned)dense.size(), (unsigned)rejected, (unsigned)table.size(), worst);
+    printf("Zero offset:   %+.2f mA\n", zeroOffset_mA);
+
+    // 7. Residuals of every pair through the solved table vs. uncorrected raw
+    double sumSqCal = 0, sumSqRaw = 0;
+    float maxCal = 0.0f;
+    for (const Pair &p : pairs) {
+        float raw = p.raw_mA * rescale;
+        float e = interpolateCalTable(table.data(), table.size(), raw) - p.ref_mA;
+        sumSqCal += (double)e * e;
+        sumSqRaw += (double)(raw - p.ref_mA) * (raw - p.ref_mA);
+        maxCal = std::max(maxCal, fabsf(e));
+    }
+    printf("Residual:      rms %.2f mA, max %.2f mA (uncorrected rms %.2f mA)\n",
+           sqrt(sumSqCal / n), maxCal, sqrt(sumSqRaw / n));
+
+    // 8. Outputs
+    if (exportPath) {
+        FILE *f = fopen(exportPath, "w");
+        if (!f) {
+            perror(exportPath);
+            return 1;
+        }
+        fprintf(f, "// cal_solver: %s + %s, lag %+.0f ms, %u pairs, rms %.2f mA\n",
+                devPath, refPath, lag, (unsigned)pairs.size(), sqrt(sumSqCal / n));
+        fprintf(f, "// offset %+.4f mV (%+.2f mA raw): corrected by the table\n", offset_mV, offset_mV / ohms);
+        fprintf(f, "// shunt_ohms = %.9f\n", ohms);
+        fprintf(f, "std::vector<CalPoint> preCalibratedPoints_%d = {\n", shuntA);
+        for (const CalPoint &p : table) fprintf(f, "    {%.6f, %.6f},\n", p.raw_mA, p.true_mA);
+        fprintf(f, "};\n");
+        fclose(f);
+        printf("Wrote %s\n", exportPath);
+    }
+    if (jigPath) {
+        FILE *f = fopen(jigPath, "w");
+        if (!f) {
+            perror(jigPath);
+            return 1;
+        }
+        // Resistance first: committing it re-scales raw current, which the
+        // table's raw axis already assumes
+        fprintf(f, "# cal_solver: %s + %s\n", devPath, refPath);
+        fprintf(f, "# offset %+.4f mV (%+.2f mA raw): corrected by the table\n", offset_mV, offset_mV / ohms);
+        fprintf(f, "CAL:SHUNT %d\n", shuntA);
+        fprintf(f, "CAL:OHMS %.9f\n", ohms);
+        fprintf(f, "CAL:CLEAR\n");
+        for (const CalPoint &p : table) fprintf(f, "CAL:POINT %.6f,%.6f\n", p.raw_mA, p.true_mA);
+        fprintf(f, "CAL:COMMIT\n");
+        fclose(f);
+        printf("Wrote %s\n", jigPath);
+    }
+    return 0;
+}
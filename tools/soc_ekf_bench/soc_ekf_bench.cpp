@@ -0,0 +1,128 @@
+// Host benchmark for the SOC Kalman filter (firmware/src/soc_ekf.h).
+//
+// Simulates a battery with the same single-RC equivalent circuit the filter
+// assumes, feeds the filter a noisy terminal voltage and a slightly biased
+// coulomb count, and reports the cost of one update (CPU cycles on x86 via
+// rdtsc, nanoseconds everywhere) together with the SOC error, starting from a
+// deliberately wrong SOC. The host has a hardware FPU and the ESP32-C3 does
+// not, so the target is several times slower per update than shown here.
+//
+// Build (Linux):
+//   g++ -std=c++11 -O2 -Ifirmware/src -o soc_ekf_bench
+//       tools/soc_ekf_bench/soc_ekf_bench.cpp firmware/src/soc_ekf.cpp
+//
+// Run:
+//   ./soc_ekf_bench [--hours 24] [--start-soc 0.6]
+
+#include "soc_ekf.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+struct SimBattery {
+    double capacityAh = 100.0;
+    double soc = 0.9;
+    double r0 = 0.012;
+    double r1 = 0.006;
+    double tau = 90.0;
+    double vp = 0.0;
+};
+
+// Load profile: base load, periodic heavy loads, an hour of charging every 8 h
+static double loadAt(double t_s) {
+    const double hour = fmod(t_s / 3600.0, 8.0);
+    if (hour >= 7.0) return -20.0;
+    double a = 3.0;
+    if (fmod(t_s, 600.0) < 120.0) a += 25.0;
+    return a;
+}
+
+int main(int argc, char **argv) {
+    double hours = 24.0;
+    float startSoc = 0.6f;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--hours") && i + 1 < argc) hours = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--start-soc") && i + 1 < argc) startSoc = (float)atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--hours 24] [--start-soc 0.6]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    SimBattery bat;
+    SocEkf ekf;
+    ekf.reset(startSoc, 0.3f, 0.01f);
+
+    std::mt19937 rng(1);
+    std::normal_distribution<double> vNoise(0.0, 0.01);
+    const double counterBias = 1.01;      // counter reads 1 % high
+    const uint32_t stepMs = 250;
+    const size_t steps = (size_t)(hours * 3600.0 * 1000.0 / stepMs);
+
+    std::vector<double> ns;
+    ns.reserve(steps);
+    uint64_t cycles = 0;
+    double maxErrLastHour = 0.0;
+
+    for (size_t k = 0; k <= steps; ++k) {
+        const double t = k * stepMs / 1000.0;
+        const double i = loadAt(t);
+        const double dt = stepMs / 1000.0;
+
+        // Truth
+        double deltaTrue = -i * dt / 3600.0 / bat.capacityAh;
+        if (k > 0) {
+            bat.soc = std::min(1.0, std::max(0.0, bat.soc + deltaTrue));
+            const double a = exp(-dt / bat.tau);
+            bat.vp = a * bat.vp + (1.0 - a) * bat.r1 * i;
+        } else {
+            deltaTrue = 0.0;
+        }
+        float dVdSoc;
+        const double ocv = ekf.ocvFromSoc((float)bat.soc, dVdSoc);
+        const double v = ocv - bat.r0 * i - bat.vp + vNoise(rng);
+
+        auto t0 = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+        const uint64_t c0 = __rdtsc();
+#endif
+        ekf.update((float)(deltaTrue * counterBias), (float)i, (float)v, (uint32_t)(k * stepMs));
+#ifdef HAVE_RDTSC
+        cycles += __rdtsc() - c0;
+#endif
+        auto t1 = std::chrono::steady_clock::now();
+        ns.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+
+        if (t > (hours - 1.0) * 3600.0) {
+            maxErrLastHour = std::max(maxErrLastHour, fabs(ekf.soc() - bat.soc));
+        }
+    }
+
+    std::vector<double> sorted = ns;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double x : ns) sum += x;
+
+    printf("updates          : %zu (%.1f h at %u ms)\n", ns.size(), hours, (unsigned)stepMs);
+#ifdef HAVE_RDTSC
+    printf("cycles/update    : %.0f (rdtsc, mean)\n", (double)cycles / ns.size());
+#endif
+    printf("ns/update        : mean %.1f, median %.1f, p99 %.1f\n",
+           sum / ns.size(), sorted[sorted.size() / 2], sorted[sorted.size() * 99 / 100]);
+    printf("start SOC        : filter %.2f, true 0.90\n", startSoc);
+    printf("end SOC          : filter %.4f, true %.4f (sigma %.4f)\n", ekf.soc(), bat.soc, ekf.socSigma());
+    printf("max |err| last h : %.4f\n", maxErrLastHour);
+    printf("R0               : filter %.4f Ohm, true %.4f Ohm\n", ekf.r0_Ohm(), bat.r0);
+    return 0;
+}